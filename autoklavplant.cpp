@@ -0,0 +1,92 @@
+#include "autoklavplant.h"
+
+#include <QtMath>
+
+#include "constants.h"
+
+static constexpr double AMBIENT_TEMP = 20.0;
+static constexpr double COOLING_WATER_TEMP = 15.0;
+static constexpr double ATMOSPHERE = 1.01325; // [bar]
+
+// Saturated steam pressure, Magnus approximation [bar absolute]
+static double saturationPressure(double temp)
+{
+    return 0.0061094 * qExp(17.625 * temp / (temp + 243.04));
+}
+
+// First order approach of value towards target with time constant tau
+static double approach(double value, double target, double tau, double dt)
+{
+    return value + (target - value) * qMin(1.0, dt / tau);
+}
+
+void AutoklavPlant::setCoil(int coil, bool value)
+{
+    if (coil >= 0 && coil < COIL_COUNT)
+        coils[coil] = value;
+}
+
+bool AutoklavPlant::coil(int coil) const
+{
+    return coil >= 0 && coil < COIL_COUNT && coils[coil];
+}
+
+void AutoklavPlant::step(double dt)
+{
+    auto &v = state;
+
+    // Chamber water, filled from the tank before the pump can circulate it
+    if (coil(CONSTANTS::AUTOKLAV_FILL) && v.tankWaterLevel > 0) {
+        chamberWater = qMin(100.0, chamberWater + 0.6 * dt);
+        v.tankWaterLevel = qMax(0.0, v.tankWaterLevel - 0.1 * dt);
+    }
+    if (coil(CONSTANTS::WATER_DRAIN)) {
+        chamberWater = qMax(0.0, chamberWater - 1.0 * dt);
+    }
+
+    const bool circulating = coil(CONSTANTS::PUMP) && chamberWater > 10;
+
+    // Steam supply from the burner
+    const bool steam = coil(CONSTANTS::STEAM_HEATING) && !v.burnerFault;
+    v.steamPressure = approach(v.steamPressure, steam ? 6.0 : 0.0, 20, dt);
+    v.heaterTemp = approach(v.heaterTemp, steam ? 160.0 : v.temp, 60, dt);
+
+    // Chamber temperature
+    double temp = v.temp;
+    if (steam)
+        temp = approach(temp, 140.0, circulating ? 400 : 900, dt);
+    if (coil(CONSTANTS::ELECTRIC_HEATING))
+        temp = approach(temp, 130.0, 900, dt);
+    if (coil(CONSTANTS::COOLING) && v.tankWaterLevel > 0)
+        temp = approach(temp, COOLING_WATER_TEMP, circulating ? 250 : 600, dt);
+    if (coil(CONSTANTS::COOLING_HELPER))
+        temp = approach(temp, COOLING_WATER_TEMP, 600, dt);
+    v.temp = approach(temp, AMBIENT_TEMP, 5000, dt);
+
+    // Product core lags behind the chamber
+    v.tempK = approach(v.tempK, v.temp, 300, dt);
+
+    // Expansion vessel
+    v.expansionTemp = approach(v.expansionTemp, v.temp * 0.9, 120, dt);
+    if (coil(CONSTANTS::EXTENSION_COOLING))
+        v.expansionTemp = approach(v.expansionTemp, 30.0, 60, dt);
+
+    // Pressure is the steam gauge pressure plus air pushed in by INCREASE_PRESSURE, which slowly leaks
+    if (coil(CONSTANTS::INCREASE_PRESSURE))
+        airOverpressure = qMin(2.5, airOverpressure + 0.01 * dt);
+    airOverpressure = qMax(0.0, airOverpressure - 0.0005 * dt);
+    v.pressure = qMax(0.0, saturationPressure(v.temp) - ATMOSPHERE) + airOverpressure;
+
+    // Water tank
+    if (coil(CONSTANTS::FILL_TANK_WITH_WATER))
+        v.tankWaterLevel = qMin(110.0, v.tankWaterLevel + 0.3 * dt);
+    if (coil(CONSTANTS::COOLING))
+        v.tankWaterLevel = qMax(0.0, v.tankWaterLevel - 0.05 * dt);
+
+    if (coil(CONSTANTS::TANK_HEATING) && v.tankWaterLevel > 0)
+        v.tankTemp = approach(v.tankTemp, 100.0, 600, dt);
+    else
+        v.tankTemp = approach(v.tankTemp, AMBIENT_TEMP, 5000, dt);
+
+    v.waterShortage = v.tankWaterLevel < 5;
+}
@@ -0,0 +1,49 @@
+#ifndef AUTOKLAVPLANT_H
+#define AUTOKLAVPLANT_H
+
+#include <array>
+
+/**
+ * @brief Simple lumped model of the autoklav used by the slave simulator.
+ *
+ * Reacts to the relay coils (indexed as CONSTANTS digital outputs) and produces the process
+ * values read by the analog transmitters. The model is only meant to be plausible enough to drive
+ * the state machine through a complete process, not to be physically accurate.
+ */
+class AutoklavPlant
+{
+public:
+    static constexpr int COIL_COUNT = 12;
+
+    struct Values {
+        double temp = 20;           // Chamber temperature [°C]
+        double tempK = 20;          // Product core temperature [°C]
+        double expansionTemp = 20;  // [°C]
+        double heaterTemp = 20;     // [°C]
+        double tankTemp = 20;       // [°C]
+        double tankWaterLevel = 50; // [%]
+        double pressure = 0;        // Chamber overpressure [bar]
+        double steamPressure = 0;   // [bar]
+
+        bool doorClosed = true;
+        bool burnerFault = false;
+        bool waterShortage = false;
+    };
+
+    void step(double dtSeconds);
+
+    void setCoil(int coil, bool value);
+    bool coil(int coil) const;
+
+    const Values &values() const { return state; }
+    Values &values() { return state; }
+
+private:
+    Values state;
+    std::array<bool, COIL_COUNT> coils{};
+
+    double airOverpressure = 0; // Added by INCREASE_PRESSURE on top of the steam pressure [bar]
+    double chamberWater = 0;    // Filled by AUTOKLAV_FILL, needed before the pump circulates [%]
+};
+
+#endif // AUTOKLAVPLANT_H
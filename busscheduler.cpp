@@ -0,0 +1,272 @@
+#include "busscheduler.h"
+
+#include <chrono>
+
+BusScheduler::BusScheduler()
+    : capacity{16, 32, 32, 16},
+      maxWait{0, 500'000'000, 2'000'000'000, 5'000'000'000}
+{
+    for (int i = 0; i < PriorityCount; i++) {
+        queues[i].reserve(capacity[i]);
+    }
+}
+
+template <typename F>
+static F chain(F first, F second)
+{
+    if (!first)
+        return second;
+    if (!second)
+        return first;
+
+    return [first, second](auto &&...args) {
+        first(args...);
+        second(args...);
+    };
+}
+
+static bool sameKey(const ModbusRequest &a, const ModbusRequest &b)
+{
+    return a.slaveAddress == b.slaveAddress && a.registerType == b.registerType
+           && a.startAddress == b.startAddress && a.count == b.count && a.operation == b.operation;
+}
+
+static bool overlaps(const ModbusRequest &a, const ModbusRequest &b)
+{
+    return a.slaveAddress == b.slaveAddress && a.registerType == b.registerType
+           && a.startAddress < b.startAddress + b.count && b.startAddress < a.startAddress + a.count;
+}
+
+BusScheduler::EnqueueResult BusScheduler::enqueue(Priority priority, ModbusRequest request, qint64 nowNs, ModbusRequest *evicted)
+{
+    auto &queue = queues[priority];
+    auto &stats = classStats[priority];
+
+    const int pending = findPending(queue, request);
+    if (pending >= 0) {
+        coalesce(queue[pending], std::move(request));
+        stats.coalesced++;
+        return Coalesced;
+    }
+
+    EnqueueResult result = Queued;
+
+    if (queue.size() >= capacity[priority]) {
+        // The oldest read is the least valuable, anything fresher supersedes it
+        int oldestRead = -1;
+        for (int i = 0; i < queue.size(); i++) {
+            if (queue[i].operation == ModbusRequest::Read) {
+                oldestRead = i;
+                break;
+            }
+        }
+
+        stats.dropped++;
+
+        if (oldestRead < 0) {
+            return Rejected;
+        }
+
+        ModbusRequest removed = queue.takeAt(oldestRead);
+        if (evicted) {
+            *evicted = std::move(removed);
+        }
+        result = Evicted;
+    }
+
+    request.enqueuedAtNs = nowNs;
+    queue.enqueue(std::move(request));
+    stats.enqueued++;
+    return result;
+}
+
+int BusScheduler::findPending(const QQueue<ModbusRequest> &queue, const ModbusRequest &request)
+{
+    // Newest first. A write queued after the match that touches the same registers must keep its
+    // order relative to the request, so the request is not moved ahead of it.
+    for (int i = queue.size() - 1; i >= 0; i--) {
+        const auto &pending = queue[i];
+
+        // Each scan read is counted by its cycle, two of them are never merged
+        if (sameKey(pending, request) && (pending.scanBlock < 0 || request.scanBlock < 0))
+            return i;
+
+        if ((pending.operation == ModbusRequest::Write || request.operation == ModbusRequest::Write)
+            && overlaps(pending, request))
+            return -1;
+    }
+
+    return -1;
+}
+
+void BusScheduler::coalesce(ModbusRequest &pending, ModbusRequest &&request)
+{
+    // A retried write is older intent than a pending fresh one and never overrides its values
+    if (request.operation == ModbusRequest::Write && (request.attempts == 0 || pending.attempts > 0)) {
+        pending.values = std::move(request.values);
+        pending.description = std::move(request.description);
+    }
+
+    if (pending.scanBlock < 0) {
+        pending.scanBlock = request.scanBlock;
+    }
+
+    // Older waiters first, so the last callback sees the newest state
+    pending.callback = chain(std::move(pending.callback), std::move(request.callback));
+    pending.errorCallback = chain(std::move(pending.errorCallback), std::move(request.errorCallback));
+}
+
+bool BusScheduler::dequeue(ModbusRequest &request, qint64 nowNs, Priority *dequeuedPriority)
+{
+    int selected = -1;
+
+    // Highest class with a request that waited longer than allowed
+    for (int i = Control; i < PriorityCount; i++) {
+        if (!queues[i].isEmpty() && nowNs - queues[i].head().enqueuedAtNs > maxWait[i]) {
+            selected = i;
+            break;
+        }
+    }
+
+    // Highest non-empty class
+    int highest = -1;
+    for (int i = 0; i < PriorityCount; i++) {
+        if (!queues[i].isEmpty()) {
+            highest = i;
+            break;
+        }
+    }
+
+    if (highest < 0) {
+        return false;
+    }
+
+    // Safety requests are never overtaken
+    if (selected < 0 || highest == Safety) {
+        selected = highest;
+    } else if (selected != highest) {
+        classStats[selected].promoted++;
+    }
+
+    request = queues[selected].dequeue();
+
+    auto &stats = classStats[selected];
+    const qint64 wait = nowNs - request.enqueuedAtNs;
+    stats.dispatched++;
+    stats.totalWaitNs += wait;
+    stats.maxWaitNs = qMax(stats.maxWaitNs, wait);
+
+    if (dequeuedPriority) {
+        *dequeuedPriority = static_cast<Priority>(selected);
+    }
+
+    return true;
+}
+
+void BusScheduler::clear()
+{
+    for (auto &queue : queues) {
+        queue.clear();
+    }
+}
+
+void BusScheduler::clear(Priority priority)
+{
+    queues[priority].clear();
+}
+
+QList<ModbusRequest> BusScheduler::takeAll()
+{
+    QList<ModbusRequest> requests;
+    for (auto &queue : queues) {
+        requests.append(queue);
+        queue.clear();
+    }
+
+    return requests;
+}
+
+QList<ModbusRequest> BusScheduler::takeIf(const std::function<bool(const ModbusRequest &)> &predicate)
+{
+    QList<ModbusRequest> requests;
+    for (auto &queue : queues) {
+        for (auto it = queue.begin(); it != queue.end();) {
+            if (predicate(*it)) {
+                requests.append(std::move(*it));
+                it = queue.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    return requests;
+}
+
+bool BusScheduler::isEmpty() const
+{
+    for (const auto &queue : queues) {
+        if (!queue.isEmpty())
+            return false;
+    }
+
+    return true;
+}
+
+int BusScheduler::size() const
+{
+    int total = 0;
+    for (const auto &queue : queues) {
+        total += queue.size();
+    }
+
+    return total;
+}
+
+void BusScheduler::setCapacity(Priority priority, int newCapacity)
+{
+    capacity[priority] = newCapacity;
+    queues[priority].reserve(newCapacity);
+}
+
+BusScheduler::ClassStats BusScheduler::stats(Priority priority) const
+{
+    auto stats = classStats[priority];
+    stats.depth = queues[priority].size();
+    stats.capacity = capacity[priority];
+    return stats;
+}
+
+void BusScheduler::resetStats()
+{
+    classStats.fill(ClassStats());
+}
+
+qint64 BusScheduler::nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+QString BusScheduler::priorityName(Priority priority)
+{
+    switch (priority) {
+    case Safety:        return "safety";
+    case Control:       return "control";
+    case Periodic:      return "periodic";
+    case Diagnostic:    return "diagnostic";
+    case PriorityCount: break;
+    }
+    return "unknown";
+}
+
+bool BusScheduler::priorityFromName(const QString &name, Priority &priority)
+{
+    for (int i = 0; i < PriorityCount; i++) {
+        if (name.compare(priorityName(static_cast<Priority>(i)), Qt::CaseInsensitive) == 0) {
+            priority = static_cast<Priority>(i);
+            return true;
+        }
+    }
+    return false;
+}
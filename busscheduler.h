@@ -0,0 +1,111 @@
+#ifndef BUSSCHEDULER_H
+#define BUSSCHEDULER_H
+
+#include <QQueue>
+#include <QString>
+#include <QModbusDataUnit>
+#include <QModbusDevice>
+#include <array>
+#include <functional>
+
+struct ModbusRequest {
+    enum Operation {
+        Read, Write
+    };
+
+    quint8 slaveAddress;
+    QModbusDataUnit::RegisterType registerType;
+    quint16 startAddress;
+    quint16 count;
+    std::function<void(const QModbusDataUnit&, quint8)> callback;
+    QString description; // For debugging
+
+    Operation operation = Read;
+    QList<quint16> values;  // Payload for writes
+    int scanBlock = -1;     // Index into the scan plan for periodic reads, -1 otherwise
+    std::function<void(QModbusDevice::Error, quint8)> errorCallback; // Failed reads, writes after the last retry, dropped requests
+    int attempts = 0;
+    qint64 enqueuedAtNs = 0;
+    qint64 sentAtNs = 0;
+};
+
+/**
+ * @brief Single point through which every request reaches the half-duplex bus.
+ *
+ * Requests are split in priority classes, each with its own bounded queue. The highest non-empty
+ * class is served first, except when the head of a lower class has waited longer than the
+ * class maximum wait, in which case it is served to avoid starvation. Safety requests are never
+ * overtaken.
+ *
+ * A request for the same slave, register type, address and count as one still pending in its class
+ * is merged into it: the pending request keeps its place, takes the newest write values and calls
+ * the callbacks of both. When a class is full its oldest read is evicted to make room, only a
+ * class full of writes rejects new requests.
+ */
+class BusScheduler
+{
+public:
+    enum Priority {
+        Safety, Control, Periodic, Diagnostic, PriorityCount
+    };
+
+    enum EnqueueResult {
+        Queued,     // Added at the tail
+        Coalesced,  // Merged into a pending request with the same key
+        Evicted,    // Added after evicting the oldest pending read
+        Rejected    // Class full of writes, not added
+    };
+
+    struct ClassStats {
+        int depth = 0;
+        int capacity = 0;
+        quint64 enqueued = 0;
+        quint64 dispatched = 0;
+        quint64 dropped = 0;   // Rejected and evicted requests
+        quint64 coalesced = 0;
+        quint64 promoted = 0; // Dispatched ahead of a higher class due to starvation protection
+        qint64 totalWaitNs = 0;
+        qint64 maxWaitNs = 0;
+
+        qint64 averageWaitNs() const { return dispatched ? totalWaitNs / static_cast<qint64>(dispatched) : 0; }
+    };
+
+    BusScheduler();
+
+    EnqueueResult enqueue(Priority priority, ModbusRequest request, qint64 nowNs, ModbusRequest *evicted = nullptr);
+    bool dequeue(ModbusRequest &request, qint64 nowNs, Priority *dequeuedPriority = nullptr);
+
+    void clear();
+    void clear(Priority priority);
+    QList<ModbusRequest> takeAll();
+
+    /**
+     * @brief Removes and returns the pending requests matching \p predicate, in queue order.
+     */
+    QList<ModbusRequest> takeIf(const std::function<bool(const ModbusRequest &)> &predicate);
+
+    bool isEmpty() const;
+    int size() const;
+    int depth(Priority priority) const { return queues[priority].size(); }
+
+    void setCapacity(Priority priority, int capacity);
+    void setMaxWait(Priority priority, qint64 maxWaitNs) { maxWait[priority] = maxWaitNs; }
+
+    ClassStats stats(Priority priority) const;
+    void resetStats();
+
+    static qint64 nowNs();
+    static QString priorityName(Priority priority);
+    static bool priorityFromName(const QString &name, Priority &priority);
+
+private:
+    std::array<QQueue<ModbusRequest>, PriorityCount> queues;
+    std::array<int, PriorityCount> capacity;
+    std::array<qint64, PriorityCount> maxWait;
+    std::array<ClassStats, PriorityCount> classStats;
+
+    static int findPending(const QQueue<ModbusRequest> &queue, const ModbusRequest &request);
+    static void coalesce(ModbusRequest &pending, ModbusRequest &&request);
+};
+
+#endif // BUSSCHEDULER_H
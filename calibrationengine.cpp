@@ -0,0 +1,140 @@
+#include "calibrationengine.h"
+
+#include "dbmanager.h"
+#include "logger.h"
+
+bool CalibrationEngine::Calibration::polynomial(std::array<double, MAX_COEFFICIENTS> &result) const
+{
+    result.fill(0);
+
+    switch (type) {
+    case Linear:
+        result[0] = offset;
+        result[1] = scale;
+        return true;
+
+    case TwoPoint:
+        if (rawMax == rawMin)
+            return false;
+
+        result[1] = (maxValue - minValue) / (rawMax - rawMin);
+        result[0] = minValue - rawMin * result[1];
+        return true;
+
+    case Polynomial:
+        if (coefficients.isEmpty() || coefficients.size() > MAX_COEFFICIENTS)
+            return false;
+
+        for (int i = 0; i < coefficients.size(); i++) {
+            result[i] = coefficients[i];
+        }
+        return true;
+    }
+    return false;
+}
+
+CalibrationEngine::CalibrationEngine()
+{
+    table.write(identity());
+}
+
+void CalibrationEngine::setCalibrations(const QList<Calibration> &calibrations)
+{
+    QMutexLocker locker(&writeMutex);
+
+    auto coefficients = identity();
+
+    for (const auto &calibration : calibrations) {
+        std::array<double, MAX_COEFFICIENTS> pinCoefficients;
+
+        if (calibration.pinId >= SensorFrame::PIN_COUNT || !calibration.polynomial(pinCoefficients)) {
+            Logger::crit(QString("Calibration: Input pin %1 has an invalid calibration, raw value used").arg(calibration.pinId));
+            continue;
+        }
+
+        for (int k = 0; k < MAX_COEFFICIENTS; k++) {
+            coefficients.coefficient[k][calibration.pinId] = pinCoefficients[k];
+        }
+    }
+
+    table.write(coefficients);
+    Logger::info(QString("Calibration: %1 input pins calibrated").arg(calibrations.size()));
+}
+
+bool CalibrationEngine::updateCalibration(const Calibration &calibration)
+{
+    std::array<double, MAX_COEFFICIENTS> coefficients;
+
+    // The range of a two point calibration comes from the pin, only its raw points are checked here
+    if (!Sensor::inputPins.contains(calibration.pinId) || !calibration.polynomial(coefficients)) {
+        Logger::crit(QString("Calibration: Invalid calibration for input pin %1").arg(calibration.pinId));
+        return false;
+    }
+
+    auto &db = DbManager::instance();
+    if (!db.updateInputCalibration(calibration))
+        return false;
+
+    setCalibrations(db.loadCalibrations());
+    return true;
+}
+
+void CalibrationEngine::apply(SensorFrame &frame, quint32 pins) const
+{
+    const auto current = table.read();
+
+    // Horner's scheme over every pin at once, the fresh ones are picked afterwards
+    std::array<double, SensorFrame::PIN_COUNT> result = current.coefficient[MAX_COEFFICIENTS - 1];
+    for (int k = MAX_COEFFICIENTS - 2; k >= 0; k--) {
+        for (int i = 0; i < SensorFrame::PIN_COUNT; i++) {
+            result[i] = result[i] * frame.raw[i] + current.coefficient[k][i];
+        }
+    }
+
+    for (int i = 0; i < SensorFrame::PIN_COUNT; i++) {
+        if (pins & (1u << i)) {
+            frame.scaled[i] = result[i];
+            frame.value[i] = result[i];
+        }
+    }
+}
+
+bool CalibrationEngine::typeFromName(const QString &name, Calibration::Type &type)
+{
+    if (name == "linear") {
+        type = Calibration::Linear;
+    } else if (name == "twoPoint") {
+        type = Calibration::TwoPoint;
+    } else if (name == "polynomial") {
+        type = Calibration::Polynomial;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+QString CalibrationEngine::typeName(Calibration::Type type)
+{
+    switch (type) {
+    case Calibration::Linear:
+        return "linear";
+    case Calibration::TwoPoint:
+        return "twoPoint";
+    case Calibration::Polynomial:
+        return "polynomial";
+    }
+    return QString();
+}
+
+CalibrationEngine::Table CalibrationEngine::identity()
+{
+    Table identity{};
+    identity.coefficient[1].fill(1);
+    return identity;
+}
+
+CalibrationEngine &CalibrationEngine::instance()
+{
+    static CalibrationEngine instance;
+    return instance;
+}
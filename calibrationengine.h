@@ -0,0 +1,84 @@
+#ifndef CALIBRATIONENGINE_H
+#define CALIBRATIONENGINE_H
+
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <array>
+
+#include "seqlock.h"
+#include "sensor.h"
+
+/**
+ * @brief Converts decoded register values to process values with the calibration of the InputPin table.
+ *
+ * Every calibration is reduced to polynomial coefficients when it is set, so a frame is converted in
+ * one loop over all pins evaluating the same polynomial with per pin coefficients. The coefficient
+ * table is published through a SeqLock: the bus threads never wait for it, and a calibration changed
+ * through updateInputCalibration, updateInputPin or updateInputChannel is used from the next read on.
+ */
+class CalibrationEngine
+{
+public:
+    static constexpr int MAX_COEFFICIENTS = 4; // Up to a cubic
+
+    struct Calibration {
+        enum Type {
+            Linear,    // raw * scale + offset
+            TwoPoint,  // rawMin..rawMax mapped to minValue..maxValue, e.g. 4-20 mA transmitters
+            Polynomial // coefficients[0] + coefficients[1] * raw + ...
+        };
+
+        ushort pinId = 0;
+        Type type = Linear;
+        double scale = 1;
+        double offset = 0;
+        double rawMin = 0;
+        double rawMax = 0;
+        double minValue = 0;
+        double maxValue = 0;
+        QList<double> coefficients;
+
+        /**
+         * @brief Polynomial coefficients of the calibration, lowest order first. False if it can't be computed.
+         */
+        bool polynomial(std::array<double, MAX_COEFFICIENTS> &result) const;
+    };
+
+    CalibrationEngine(const CalibrationEngine&) = delete;
+    CalibrationEngine& operator=(const CalibrationEngine &) = delete;
+
+    /**
+     * @brief Replaces the calibration of every pin. Pins without one pass the raw value unchanged.
+     */
+    void setCalibrations(const QList<Calibration> &calibrations);
+
+    /**
+     * @brief Stores the calibration of one input pin and uses it from the next read on. minValue and maxValue are those of the pin.
+     */
+    bool updateCalibration(const Calibration &calibration);
+
+    /**
+     * @brief Converts SensorFrame::raw of the \p pins of \p frame to their scaled and process value. Safe to call from any thread.
+     */
+    void apply(SensorFrame &frame, quint32 pins) const;
+
+    static bool typeFromName(const QString &name, Calibration::Type &type);
+    static QString typeName(Calibration::Type type);
+    static CalibrationEngine &instance();
+
+private:
+    CalibrationEngine();
+
+    // Coefficient k of every pin is contiguous, the conversion loop runs over pins
+    struct Table {
+        std::array<std::array<double, SensorFrame::PIN_COUNT>, MAX_COEFFICIENTS> coefficient;
+    };
+
+    QMutex writeMutex; // Set from the main thread
+    SeqLock<Table> table;
+
+    static Table identity();
+};
+
+#endif // CALIBRATIONENGINE_H
@@ -0,0 +1,72 @@
+#include "changenotifier.h"
+
+#include <cmath>
+
+#include "logger.h"
+
+double ChangeNotifier::Deadband::threshold() const
+{
+    return type == Percent ? width / 100.0 * std::abs(maxValue - minValue) : width;
+}
+
+void ChangeNotifier::setDeadbands(const QList<Deadband> &deadbands)
+{
+    QMutexLocker locker(&mutex);
+
+    thresholds.fill(0);
+    for (const auto &deadband : deadbands) {
+        if (deadband.pinId >= SensorFrame::PIN_COUNT || deadband.width < 0) {
+            Logger::crit(QString("Deadband: Input pin %1 has an invalid deadband, every change reported").arg(deadband.pinId));
+            continue;
+        }
+
+        thresholds[deadband.pinId] = deadband.threshold();
+    }
+}
+
+quint32 ChangeNotifier::update(SensorFrame &frame, quint32 pins)
+{
+    QMutexLocker locker(&mutex);
+
+    quint32 changed = 0;
+    for (int i = 0; i < SensorFrame::PIN_COUNT; i++) {
+        const quint32 bit = 1u << i;
+        if (!(pins & bit))
+            continue;
+
+        // The first value of a pin is always reported
+        if ((reportedPins & bit) && !(std::abs(frame.value[i] - reported[i]) > thresholds[i]))
+            continue;
+
+        reported[i] = frame.value[i];
+        reportedPins |= bit;
+        frame.generation[i]++;
+        changed |= bit;
+    }
+
+    return changed;
+}
+
+void ChangeNotifier::notify(quint32 pins, quint64 sequence)
+{
+    if (pins)
+        emit valuesChanged(pins, sequence);
+}
+
+bool ChangeNotifier::typeFromName(const QString &name, Deadband::Type &type)
+{
+    if (name == "absolute") {
+        type = Deadband::Absolute;
+    } else if (name == "percent") {
+        type = Deadband::Percent;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+ChangeNotifier &ChangeNotifier::instance()
+{
+    static ChangeNotifier instance;
+    return instance;
+}
@@ -0,0 +1,71 @@
+#ifndef CHANGENOTIFIER_H
+#define CHANGENOTIFIER_H
+
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <array>
+
+#include "sensor.h"
+
+/**
+ * @brief Reports input values only when they move outside their deadband.
+ *
+ * Every published frame is compared with the value last reported for each fresh pin. A pin whose
+ * value moved further than its deadband gets its generation counter in the frame incremented and
+ * becomes the new reference, and valuesChanged() is emitted once for all pins of the frame that
+ * changed. Consumers can skip unchanged data by comparing generations or by waiting for the signal,
+ * as watchSensorPinValues does.
+ */
+class ChangeNotifier : public QObject
+{
+    Q_OBJECT
+public:
+    struct Deadband {
+        enum Type {
+            Absolute, // In process units
+            Percent   // Of the range minValue..maxValue of the pin
+        };
+
+        ushort pinId = 0;
+        Type type = Absolute;
+        double width = 0; // 0 reports every change
+        double minValue = 0;
+        double maxValue = 0;
+
+        double threshold() const;
+    };
+
+    ChangeNotifier(const ChangeNotifier&) = delete;
+    ChangeNotifier& operator=(const ChangeNotifier &) = delete;
+
+    void setDeadbands(const QList<Deadband> &deadbands);
+
+    /**
+     * @brief Updates the generations of the \p pins of \p frame, returns the pins that changed.
+     * Called under the publish lock of the sensor frame.
+     */
+    quint32 update(SensorFrame &frame, quint32 pins);
+
+    /**
+     * @brief Emits valuesChanged() for the \p pins update() reported, once the frame of \p sequence is published.
+     */
+    void notify(quint32 pins, quint64 sequence);
+
+    static bool typeFromName(const QString &name, Deadband::Type &type);
+    static ChangeNotifier &instance();
+
+signals:
+    // Emitted from the I/O thread of the bus that read the values
+    void valuesChanged(quint32 pins, quint64 sequence);
+
+private:
+    ChangeNotifier() = default;
+
+    QMutex mutex; // Deadbands are set from the main thread
+    std::array<double, SensorFrame::PIN_COUNT> thresholds{};
+    std::array<double, SensorFrame::PIN_COUNT> reported{};
+    quint32 reportedPins = 0;
+};
+
+#endif // CHANGENOTIFIER_H
@@ -21,12 +21,12 @@ namespace CONSTANTS {
     inline const ushort STEAM_PRESSURE = 8;  // steamPressure
     inline const ushort PRESSURE = 9;  // pressure
 
-    // Digital input constants, we use raw values from cwt slave 1 and then shift them by 10 for mapInputSensor
+    // Digital input constants, we use raw values from cwt slave 1 and then shift them by 10 for Sensor::inputPins
     inline const ushort DOOR_CLOSED = 0;  // doorClosed
     inline const ushort BURNER_FAULT = 1;  // burnerFault
     inline const ushort WATER_SHORTAGE = 2;  // waterShortage
 
-    // Shifted digital input constants for mapInputPin
+    // Shifted digital input constants for Sensor::inputPins
     inline const ushort DOOR_CLOSED_SHIFTED = DOOR_CLOSED + DIGITAL_INPUT_SHIFT;  // doorClosed
     inline const ushort BURNER_FAULT_SHIFTED = BURNER_FAULT + DIGITAL_INPUT_SHIFT;  // burnerFault
     inline const ushort WATER_SHORTAGE_SHIFTED = WATER_SHORTAGE + DIGITAL_INPUT_SHIFT;  // waterShortage
@@ -38,7 +38,7 @@ namespace CONSTANTS {
     inline const ushort COOLING_HELPER = 3;  // coolingHelper
     inline const ushort AUTOKLAV_FILL = 4;  // autoklavFill
     inline const ushort WATER_DRAIN = 5;  // waterDrain
-    inline ushort STEAM_HEATING = 6;  // heating
+    inline const ushort STEAM_HEATING = 6;  // heating
     inline const ushort PUMP = 7;  // pump
     inline const ushort INCREASE_PRESSURE = 8;  // increasePressure
     inline const ushort ALARM_SIGNAL = 9;  // alarmSignal
@@ -47,8 +47,6 @@ namespace CONSTANTS {
 
     inline const quint16 MODBUS_COIL_ON = 0xFF00;  // Modbus coil ON value
     inline const quint16 MODBUS_COIL_OFF = 0x0000;  // Modbus coil OFF value
-
-    inline const float SENSOR_PIN_SCALING_FACTOR = 10.0;
 }
 
 #endif // CONSTANTS_H
@@ -1,17 +1,21 @@
 #include "dbmanager.h"
 
 #include <QThread>
+#include <algorithm>
 
 #include "sensor.h"
 #include "logger.h"
 #include "globals.h"
 #include "globalerrors.h"
 #include "statemachine.h"
+#include "relayimage.h"
 
 DbManager::DbManager()
 {
     QString path;
-    if (QDir("C:/Development/db").exists()) {
+    if (!Globals::databaseDir.isEmpty() && QDir(Globals::databaseDir).exists()) {
+        path = Globals::databaseDir;
+    } else if (QDir("C:/Development/db").exists()) {
         path = "C:/Development/db";
     } else if (QDir("C:/db").exists()) {
         path = "C:/db";
@@ -36,6 +40,148 @@ DbManager::DbManager()
     Logger::info("Database: ok");
 }
 
+void DbManager::upgradeSchema()
+{
+    // Added with the InputPin channel definition, the seeded pins get the channels init.sql gives them
+    const auto channelColumns = addMissingColumns("InputPin", {
+        {"slaveId", "INTEGER"},
+        {"functionCode", "INTEGER NOT NULL DEFAULT 3 CHECK (functionCode IN (1, 2, 3, 4))"},
+        {"register", "INTEGER NOT NULL DEFAULT 1"},
+        {"count", "INTEGER NOT NULL DEFAULT 1"},
+        {"dataType", "TEXT NOT NULL DEFAULT 'uint16' CHECK (dataType IN ('uint16', 'int16', 'uint32', 'int32', 'float32', 'bool'))"},
+        {"scale", "REAL NOT NULL DEFAULT 1"},
+        {"pollPeriodMs", "INTEGER NOT NULL DEFAULT 0"}
+    });
+
+    if (channelColumns.contains("slaveId")) {
+        const QStringList channels = {
+            "UPDATE InputPin SET slaveId = id, scale = 0.1 WHERE id BETWEEN 2 AND 7",
+            "UPDATE InputPin SET slaveId = id, scale = 0.01 WHERE id IN (8, 9)",
+            "UPDATE InputPin SET slaveId = 1, functionCode = 2, register = id - 10, dataType = 'bool' WHERE id BETWEEN 10 AND 12"
+        };
+
+        for (const auto &statement : channels) {
+            QSqlQuery query(m_db);
+            if (!query.exec(statement)) {
+                Logger::crit(QString("Database: Unable to set the input channels: %1").arg(query.lastError().text()));
+                GlobalErrors::setError(GlobalErrors::DbError);
+            }
+        }
+    }
+
+    // Not served to the SCADA until a register is assigned
+    addMissingColumns("InputPin", {
+        {"scadaRegister", "INTEGER"}
+    });
+
+    // Minimum on/off times of the outputs
+    addMissingColumns("OutputPin", {
+        {"minOnMs", "INTEGER NOT NULL DEFAULT 0"},
+        {"minOffMs", "INTEGER NOT NULL DEFAULT 0"}
+    });
+
+    // Calibrations, the defaults keep the linear scale of the existing pins
+    addMissingColumns("InputPin", {
+        {"calibration", "TEXT NOT NULL DEFAULT 'linear' CHECK (calibration IN ('linear', 'twoPoint', 'polynomial'))"},
+        {"offset", "REAL NOT NULL DEFAULT 0"},
+        {"rawMin", "REAL NOT NULL DEFAULT 0"},
+        {"rawMax", "REAL NOT NULL DEFAULT 0"},
+        {"coefficients", "TEXT"}
+    });
+
+    // Deadbands, the seeded pins get the ones init.sql gives them
+    const auto deadbandColumns = addMissingColumns("InputPin", {
+        {"deadband", "REAL NOT NULL DEFAULT 0"},
+        {"deadbandType", "TEXT NOT NULL DEFAULT 'absolute' CHECK (deadbandType IN ('absolute', 'percent'))"}
+    });
+
+    if (deadbandColumns.contains("deadband")) {
+        const QStringList deadbands = {
+            "UPDATE InputPin SET deadband = 0.1 WHERE id IN (2, 3, 4, 5, 6)",
+            "UPDATE InputPin SET deadband = 0.01 WHERE id IN (8, 9)",
+            "UPDATE InputPin SET deadband = 0.5, deadbandType = 'percent' WHERE id = 7"
+        };
+
+        for (const auto &statement : deadbands) {
+            QSqlQuery query(m_db);
+            if (!query.exec(statement)) {
+                Logger::crit(QString("Database: Unable to set the deadbands: %1").arg(query.lastError().text()));
+                GlobalErrors::setError(GlobalErrors::DbError);
+            }
+        }
+    }
+
+    // Created empty, the seeded rules have to be commissioned first
+    createMissingTable("Interlock",
+        "id INTEGER PRIMARY KEY, alias TEXT, pinId INTEGER NOT NULL REFERENCES InputPin(id), "
+        "condition TEXT NOT NULL CHECK (condition IN ('above', 'below')), limitValue REAL NOT NULL, "
+        "hysteresis REAL NOT NULL DEFAULT 0, outputs TEXT NOT NULL, enabled INTEGER NOT NULL DEFAULT 1");
+
+    // Created empty, the inputs stay unfiltered
+    createMissingTable("InputFilter",
+        "id INTEGER PRIMARY KEY, pinId INTEGER NOT NULL REFERENCES InputPin(id), stage INTEGER NOT NULL, "
+        "type TEXT NOT NULL CHECK (type IN ('ema', 'median', 'spike', 'rate')), parameter REAL NOT NULL, "
+        "enabled INTEGER NOT NULL DEFAULT 1, UNIQUE (pinId, stage)");
+}
+
+QStringList DbManager::tableColumns(const QString &table)
+{
+    QStringList columns;
+
+    QSqlQuery query(m_db);
+    if (!query.exec(QString("PRAGMA table_info(%1)").arg(table))) {
+        Logger::crit(QString("Database: Unable to read the columns of %1: %2").arg(table, query.lastError().text()));
+        return columns;
+    }
+
+    while (query.next()) {
+        columns.append(query.value(1).toString());
+    }
+
+    return columns;
+}
+
+void DbManager::createMissingTable(const QString &table, const QString &columns)
+{
+    if (!tableColumns(table).isEmpty())
+        return;
+
+    QSqlQuery query(m_db);
+    if (!query.exec(QString("CREATE TABLE IF NOT EXISTS %1 (%2)").arg(table, columns))) {
+        Logger::crit(QString("Database: Unable to create %1: %2").arg(table, query.lastError().text()));
+        GlobalErrors::setError(GlobalErrors::DbError);
+        return;
+    }
+
+    Logger::info(QString("Database: Created table %1").arg(table));
+}
+
+QStringList DbManager::addMissingColumns(const QString &table, const QList<QPair<QString, QString>> &columns)
+{
+    QStringList added;
+
+    const auto existing = tableColumns(table);
+    if (existing.isEmpty())
+        return added;
+
+    for (const auto &column : columns) {
+        if (existing.contains(column.first))
+            continue;
+
+        QSqlQuery query(m_db);
+        if (!query.exec(QString("ALTER TABLE %1 ADD COLUMN \"%2\" %3").arg(table, column.first, column.second))) {
+            Logger::crit(QString("Database: Unable to add %1.%2: %3").arg(table, column.first, query.lastError().text()));
+            GlobalErrors::setError(GlobalErrors::DbError);
+            continue;
+        }
+
+        Logger::info(QString("Database: Added column %1.%2").arg(table, column.first));
+        added.append(column.first);
+    }
+
+    return added;
+}
+
 QString DbManager::loadGlobal(QString name)
 {
     QSqlQuery query(m_db);
@@ -88,14 +234,6 @@ bool DbManager::updateGlobal(QString name, QString value)
 
 void DbManager::loadInputPins()
 {
-    // Get number of sensors
-    QSqlQuery count_query("SELECT COUNT(*) FROM InputPin", m_db);
-
-    // Resize Sensor::sensors to number of sensors
-    if (count_query.exec() && count_query.next()) {
-        Sensor::inputPins.reserve(count_query.value(0).toInt());
-    }
-
     QSqlQuery query("SELECT * FROM InputPin", m_db);
     while (query.next()) {
         auto id = query.value(0).toUInt();
@@ -103,28 +241,36 @@ void DbManager::loadInputPins()
         auto minValue = query.value(2).toDouble();
         auto maxValue = query.value(3).toDouble();
 
-        Sensor::inputPins.append(Sensor(id, minValue, maxValue));
-        Sensor::mapInputPin.insert(id, &Sensor::inputPins.last());
+        if (!Sensor::inputPins.add(Sensor(id, minValue, maxValue))) {
+            Logger::crit(QString("Database: Input pin %1 (%2) is outside of the pin registry").arg(id).arg(alias));
+        }
     }
 }
 
 void DbManager::loadOutputPins()
 {
-    // Get number of sensors
-    QSqlQuery count_query("SELECT COUNT(*) FROM OutputPin", m_db);
+    QSqlQuery query(m_db);
+    if (!query.exec("SELECT id, alias, minOnMs, minOffMs FROM OutputPin")) {
+        Logger::crit(QString("Database: Unable to load minimum on/off times, outputs switch without them: %1").arg(query.lastError().text()));
+        GlobalErrors::setError(GlobalErrors::DbError);
 
-    // Resize Sensor::sensors to number of sensors
-    if (count_query.exec() && count_query.next()) {
-        Sensor::outputPins.reserve(count_query.value(0).toInt());
+        // Without the outputs the relay image and the SCADA coils would stay empty
+        if (!query.exec("SELECT id, alias, 0, 0 FROM OutputPin")) {
+            Logger::crit(QString("Database: Unable to load output pins: %1").arg(query.lastError().text()));
+            return;
+        }
     }
 
-    QSqlQuery query("SELECT * FROM OutputPin", m_db);
     while (query.next()) {
         auto id = query.value(0).toUInt();
         auto alias = query.value(1).toString(); // alias is not used anywhere, just provides descriptions for virtual arduino pins
 
-        Sensor::outputPins.append(Sensor(id));
-        Sensor::mapOutputPin.insert(id, &Sensor::outputPins.last());
+        if (!Sensor::outputPins.add(Sensor(id))) {
+            Logger::crit(QString("Database: Output pin %1 (%2) is outside of the pin registry").arg(id).arg(alias));
+            continue;
+        }
+
+        RelayImage::instance().setMinimumTimes(id, query.value(2).toInt(), query.value(3).toInt());
     }
 }
 
@@ -146,6 +292,316 @@ bool DbManager::updateInputPin(uint id, double newMinValue, double newMaxValue)
     return true;
 }
 
+QVector<ScanChannel> DbManager::loadInputChannels()
+{
+    QVector<ScanChannel> channels;
+
+    QSqlQuery query(m_db);
+    if (!query.exec("SELECT id, alias, slaveId, functionCode, register, count, dataType, scale, pollPeriodMs, scadaRegister "
+                    "FROM InputPin WHERE slaveId IS NOT NULL ORDER BY id")) {
+        Logger::crit(QString("Database: Unable to load input channels: %1").arg(query.lastError().text()));
+        GlobalErrors::setError(GlobalErrors::DbError);
+        return channels;
+    }
+
+    while (query.next()) {
+        ScanChannel channel;
+        channel.pinId = query.value(0).toUInt();
+        channel.description = query.value(1).toString();
+        channel.slaveAddress = static_cast<quint8>(query.value(2).toUInt());
+        channel.address = static_cast<quint16>(query.value(4).toUInt());
+        channel.count = static_cast<quint16>(query.value(5).toUInt());
+        channel.scale = query.value(7).toDouble();
+        channel.pollPeriodMs = query.value(8).toInt();
+        channel.scadaRegister = query.value(9).isNull() ? -1 : query.value(9).toInt();
+
+        if (!ScanChannel::registerTypeFromFunctionCode(query.value(3).toInt(), channel.registerType)
+            || !ScanChannel::dataTypeFromName(query.value(6).toString(), channel.dataType)
+            || !channel.isValid()) {
+            Logger::crit(QString("Database: Input pin %1 has an invalid channel definition, not polled").arg(channel.pinId));
+            GlobalErrors::setError(GlobalErrors::DbError);
+            continue;
+        }
+
+        channels.append(channel);
+    }
+
+    return channels;
+}
+
+QList<CalibrationEngine::Calibration> DbManager::loadCalibrations()
+{
+    QList<CalibrationEngine::Calibration> calibrations;
+
+    QSqlQuery query(m_db);
+    if (!query.exec("SELECT id, calibration, scale, offset, rawMin, rawMax, minValue, maxValue, coefficients FROM InputPin ORDER BY id")) {
+        Logger::crit(QString("Database: Unable to load calibrations: %1").arg(query.lastError().text()));
+        GlobalErrors::setError(GlobalErrors::DbError);
+        return calibrations;
+    }
+
+    while (query.next()) {
+        CalibrationEngine::Calibration calibration;
+        calibration.pinId = query.value(0).toUInt();
+        calibration.scale = query.value(2).toDouble();
+        calibration.offset = query.value(3).toDouble();
+        calibration.rawMin = query.value(4).toDouble();
+        calibration.rawMax = query.value(5).toDouble();
+        calibration.minValue = query.value(6).toDouble();
+        calibration.maxValue = query.value(7).toDouble();
+
+        bool ok = CalibrationEngine::typeFromName(query.value(1).toString(), calibration.type);
+        for (const auto &coefficient : query.value(8).toString().split(',', Qt::SkipEmptyParts)) {
+            bool coefficientOk;
+            calibration.coefficients.append(coefficient.trimmed().toDouble(&coefficientOk));
+            ok = ok && coefficientOk;
+        }
+
+        if (!ok) {
+            Logger::crit(QString("Database: Input pin %1 has an invalid calibration, raw value used").arg(calibration.pinId));
+            GlobalErrors::setError(GlobalErrors::DbError);
+            continue;
+        }
+
+        calibrations.append(calibration);
+    }
+
+    return calibrations;
+}
+
+bool DbManager::updateInputCalibration(const CalibrationEngine::Calibration &calibration)
+{
+    QStringList coefficients;
+    for (const auto coefficient : calibration.coefficients) {
+        coefficients.append(QString::number(coefficient, 'g', 17));
+    }
+
+    QSqlQuery query(m_db);
+    query.prepare("UPDATE InputPin SET calibration = :calibration, scale = :scale, offset = :offset, rawMin = :rawMin, "
+                  "rawMax = :rawMax, coefficients = :coefficients WHERE id = :id");
+    query.bindValue(":id", calibration.pinId);
+    query.bindValue(":calibration", CalibrationEngine::typeName(calibration.type));
+    query.bindValue(":scale", calibration.scale);
+    query.bindValue(":offset", calibration.offset);
+    query.bindValue(":rawMin", calibration.rawMin);
+    query.bindValue(":rawMax", calibration.rawMax);
+    query.bindValue(":coefficients", coefficients.isEmpty() ? QVariant() : QVariant(coefficients.join(',')));
+
+    if (!query.exec() || query.numRowsAffected() == 0) {
+        Logger::crit(QString("Database: Unable to update the calibration of input pin %1").arg(calibration.pinId));
+        Logger::crit(QString("SQL error: %1").arg(query.lastError().text()));
+        return false;
+    }
+
+    Logger::info(QString("Database: Update calibration of input pin %1").arg(calibration.pinId));
+    return true;
+}
+
+QList<ChangeNotifier::Deadband> DbManager::loadDeadbands()
+{
+    QList<ChangeNotifier::Deadband> deadbands;
+
+    QSqlQuery query(m_db);
+    if (!query.exec("SELECT id, deadbandType, deadband, minValue, maxValue FROM InputPin ORDER BY id")) {
+        Logger::crit(QString("Database: Unable to load deadbands: %1").arg(query.lastError().text()));
+        GlobalErrors::setError(GlobalErrors::DbError);
+        return deadbands;
+    }
+
+    while (query.next()) {
+        ChangeNotifier::Deadband deadband;
+        deadband.pinId = query.value(0).toUInt();
+        deadband.width = query.value(2).toDouble();
+        deadband.minValue = query.value(3).toDouble();
+        deadband.maxValue = query.value(4).toDouble();
+
+        if (!ChangeNotifier::typeFromName(query.value(1).toString(), deadband.type)) {
+            Logger::crit(QString("Database: Input pin %1 has an unknown deadband type, every change reported").arg(deadband.pinId));
+            continue;
+        }
+
+        deadbands.append(deadband);
+    }
+
+    return deadbands;
+}
+
+bool DbManager::updateInputChannel(const ScanChannel &channel)
+{
+    QSqlQuery query(m_db);
+    query.prepare("UPDATE InputPin SET slaveId = :slaveId, functionCode = :functionCode, register = :register, count = :count, "
+                  "dataType = :dataType, scale = :scale, pollPeriodMs = :pollPeriodMs WHERE id = :id");
+    query.bindValue(":id", channel.pinId);
+    query.bindValue(":slaveId", channel.slaveAddress);
+    query.bindValue(":functionCode", channel.functionCode());
+    query.bindValue(":register", channel.address);
+    query.bindValue(":count", channel.count);
+    query.bindValue(":dataType", ScanChannel::dataTypeName(channel.dataType));
+    query.bindValue(":scale", channel.scale);
+    query.bindValue(":pollPeriodMs", channel.pollPeriodMs);
+
+    if (!query.exec() || query.numRowsAffected() == 0) {
+        Logger::crit(QString("Database: Unable to update input channel %1").arg(channel.pinId));
+        Logger::crit(QString("SQL error: %1").arg(query.lastError().text()));
+        return false;
+    }
+
+    Logger::info(QString("Database: Update input channel %1").arg(channel.pinId));
+    return true;
+}
+
+QList<ScanProfile> DbManager::loadScanProfiles()
+{
+    QList<ScanProfile> profiles;
+
+    QSqlQuery query(m_db);
+    if (!query.exec("SELECT state, pinId, pollPeriodMs, priority FROM ScanProfile")) {
+        Logger::warn(QString("Database: Unable to load scan profiles: %1").arg(query.lastError().text()));
+        return profiles;
+    }
+
+    while (query.next()) {
+        ScanProfile profile;
+        profile.state = query.value(0).toInt();
+        profile.pinId = query.value(1).toUInt();
+        profile.pollPeriodMs = query.value(2).toInt();
+
+        if (!BusScheduler::priorityFromName(query.value(3).toString(), profile.priority)
+            || profile.priority == BusScheduler::Safety || profile.pollPeriodMs < 0) {
+            Logger::crit(QString("Database: Invalid scan profile of pin %1 in state %2").arg(profile.pinId).arg(profile.state));
+            continue;
+        }
+
+        profiles.append(profile);
+    }
+
+    return profiles;
+}
+
+QList<InterlockEngine::Rule> DbManager::loadInterlocks()
+{
+    QList<InterlockEngine::Rule> rules;
+
+    QSqlQuery query(m_db);
+    if (!query.exec("SELECT id, alias, pinId, condition, limitValue, hysteresis, outputs FROM Interlock WHERE enabled = 1")) {
+        Logger::crit(QString("Database: Unable to load interlocks: %1").arg(query.lastError().text()));
+        GlobalErrors::setError(GlobalErrors::DbError);
+        return rules;
+    }
+
+    while (query.next()) {
+        InterlockEngine::Rule rule;
+        rule.id = query.value(0).toInt();
+        rule.alias = query.value(1).toString();
+        rule.pinId = query.value(2).toUInt();
+        rule.condition = query.value(3).toString() == "below" ? InterlockEngine::Rule::Below : InterlockEngine::Rule::Above;
+        rule.limit = query.value(4).toDouble();
+        rule.hysteresis = query.value(5).toDouble();
+
+        for (const auto &output : query.value(6).toString().split(',', Qt::SkipEmptyParts)) {
+            bool ok;
+            const auto pin = output.trimmed().toUShort(&ok);
+            if (ok && Sensor::outputPins.contains(pin)) {
+                rule.outputs.append(pin);
+            } else {
+                Logger::crit(QString("Database: Interlock %1 has an unknown output '%2'").arg(rule.id).arg(output));
+            }
+        }
+
+        if (rule.outputs.isEmpty()) {
+            Logger::crit(QString("Database: Interlock %1 has no outputs, ignored").arg(rule.id));
+            continue;
+        }
+
+        rules.append(rule);
+    }
+
+    return rules;
+}
+
+QList<FilterEngine::Stage> DbManager::loadInputFilters()
+{
+    QList<FilterEngine::Stage> stages;
+
+    QSqlQuery query(m_db);
+    if (!query.exec("SELECT pinId, type, parameter FROM InputFilter WHERE enabled = 1 ORDER BY pinId, stage")) {
+        Logger::crit(QString("Database: Unable to load input filters: %1").arg(query.lastError().text()));
+        GlobalErrors::setError(GlobalErrors::DbError);
+        return stages;
+    }
+
+    while (query.next()) {
+        FilterEngine::Stage stage;
+        stage.pinId = query.value(0).toUInt();
+        stage.parameter = query.value(2).toDouble();
+
+        if (!FilterEngine::typeFromName(query.value(1).toString(), stage.type)) {
+            Logger::crit(QString("Database: Unknown filter '%1' for input pin %2").arg(query.value(1).toString()).arg(stage.pinId));
+            continue;
+        }
+
+        stages.append(stage);
+    }
+
+    return stages;
+}
+
+QList<ModbusMaster::BusConfig> DbManager::loadModbusBuses()
+{
+    QList<ModbusMaster::BusConfig> buses;
+
+    QSqlQuery query(m_db);
+    if (!query.exec("SELECT id, type, name, port, baudRate, parity, stopBits, turnaroundUs, scanIntervalMs, maxInFlight "
+                    "FROM ModbusBus ORDER BY id")) {
+        Logger::warn(QString("Database: Unable to load Modbus buses: %1").arg(query.lastError().text()));
+        return buses;
+    }
+
+    while (query.next()) {
+        ModbusMaster::BusConfig bus;
+        bus.id = query.value(0).toInt();
+        const auto type = query.value(1).toString();
+        bus.type = type == "tcp" ? ModbusMaster::BusConfig::Tcp
+                   : type == "rtu-native" ? ModbusMaster::BusConfig::NativeRtu
+                                          : ModbusMaster::BusConfig::Rtu;
+        bus.name = query.value(2).toString();
+        bus.portName = query.value(3).toString();
+        bus.serialSettings = SerialSettings::fromValues(query.value(4).toInt(), query.value(5).toInt(), query.value(6).toInt());
+        bus.turnaroundUs = query.value(7).toInt();
+        bus.scanIntervalMs = query.value(8).toInt();
+        bus.maxInFlight = query.value(9).toInt();
+
+        buses.append(bus);
+    }
+
+    QSqlQuery slaveQuery(m_db);
+    if (!slaveQuery.exec("SELECT address, busId, turnaroundUs FROM ModbusSlave")) {
+        Logger::warn(QString("Database: Unable to load Modbus slaves: %1").arg(slaveQuery.lastError().text()));
+        return {};
+    }
+
+    while (slaveQuery.next()) {
+        const auto address = static_cast<quint8>(slaveQuery.value(0).toUInt());
+        const auto busId = slaveQuery.value(1).toInt();
+
+        auto bus = std::find_if(buses.begin(), buses.end(), [busId](const ModbusMaster::BusConfig &bus) {
+            return bus.id == busId;
+        });
+
+        if (bus == buses.end()) {
+            Logger::crit(QString("Database: Slave %1 assigned to unknown bus %2").arg(address).arg(busId));
+            continue;
+        }
+
+        bus->slaves.append(address);
+        if (!slaveQuery.value(2).isNull()) {
+            bus->slaveTurnaroundUs.insert(address, slaveQuery.value(2).toInt());
+        }
+    }
+
+    return buses;
+}
+
 QList<ProcessRow> DbManager::getAllProcessesOrderedDesc()
 {
     QSqlQuery query("SELECT process.id as id, process.batchLTO, process.productName, process.productQuantity, processStart, targetF, processLength, Bacteria.id as bacteriaId, Bacteria.name as bacteriaName, Bacteria.description as bacteriaDescription, d0, z, targetHeatingTime, targetCoolingTime FROM Process LEFT JOIN Bacteria ON Process.bacteriaId = Bacteria.id ORDER BY Process.processStart DESC", m_db);
@@ -8,6 +8,11 @@
 
 #include "processlog.h"
 #include "process.h"
+#include "modbusmaster.h"
+#include "interlockengine.h"
+#include "filterengine.h"
+#include "calibrationengine.h"
+#include "changenotifier.h"
 
 /*
  * Globals:
@@ -19,6 +24,9 @@
  * pin      string
  * minValue double
  * maxValue double
+ *
+ * InputPin channel (pins without slaveId are not polled):
+ * slaveId, functionCode, register, count, dataType, scale, pollPeriodMs
  */
 
 class DbManager
@@ -34,6 +42,11 @@ public:
     DbManager(DbManager &&) = delete;
     DbManager & operator=(DbManager &&) = delete;
 
+    /**
+     * @brief Brings a database created by an older init.sql up to date, keeping its data.
+     */
+    void upgradeSchema();
+
     // Globals
     void loadGlobals();
     bool updateGlobal(QString name, QString value);
@@ -42,6 +55,21 @@ public:
     void loadInputPins();
     void loadOutputPins();
     bool updateInputPin(uint id, double newMinValue, double newMaxValue);
+    QVector<ScanChannel> loadInputChannels();
+    QList<CalibrationEngine::Calibration> loadCalibrations();
+    bool updateInputCalibration(const CalibrationEngine::Calibration &calibration);
+    QList<ChangeNotifier::Deadband> loadDeadbands();
+    bool updateInputChannel(const ScanChannel &channel);
+    QList<ScanProfile> loadScanProfiles();
+
+    // Interlocks
+    QList<InterlockEngine::Rule> loadInterlocks();
+
+    // Input filters, stages of every pin in chain order
+    QList<FilterEngine::Stage> loadInputFilters();
+
+    // Modbus
+    QList<ModbusMaster::BusConfig> loadModbusBuses();
 
     // Process
     QList<ProcessRow> getAllProcessesOrderedDesc();
@@ -76,6 +104,10 @@ private:
 
     QString loadGlobal(QString name);
 
+    QStringList tableColumns(const QString &table);
+    QStringList addMissingColumns(const QString &table, const QList<QPair<QString, QString>> &columns);
+    void createMissingTable(const QString &table, const QString &columns);
+
     QSqlDatabase m_db;
 
 };
@@ -0,0 +1,143 @@
+#include "filterengine.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "logger.h"
+
+bool FilterEngine::Stage::isValid() const
+{
+    if (pinId >= SensorFrame::PIN_COUNT)
+        return false;
+
+    switch (type) {
+    case Median:
+        return parameter >= 1 && parameter <= MAX_MEDIAN_WINDOW && static_cast<int>(parameter) % 2 == 1;
+    case Ema:
+    case Spike:
+    case RateClamp:
+        return parameter > 0;
+    }
+    return false;
+}
+
+void FilterEngine::setStages(const QList<Stage> &stages)
+{
+    QMutexLocker locker(&mutex);
+
+    chains = {};
+
+    int loaded = 0;
+    for (const auto &stage : stages) {
+        if (!stage.isValid() || chains[stage.pinId].stageCount == MAX_STAGES) {
+            Logger::crit(QString("Filters: Invalid or surplus stage for input pin %1 ignored").arg(stage.pinId));
+            continue;
+        }
+
+        auto &chain = chains[stage.pinId];
+        auto &state = chain.stages[chain.stageCount++];
+        state.type = stage.type;
+        state.parameter = stage.parameter;
+        loaded++;
+    }
+
+    Logger::info(QString("Filters: %1 stages loaded").arg(loaded));
+}
+
+void FilterEngine::apply(SensorFrame &frame, quint32 pins, qint64 timeMs)
+{
+    QMutexLocker locker(&mutex);
+
+    for (int pin = 0; pin < SensorFrame::PIN_COUNT; pin++) {
+        if (!(pins & (1u << pin)))
+            continue;
+
+        auto &chain = chains[pin];
+        double value = frame.scaled[pin];
+
+        if (chain.stageCount) {
+            const qint64 elapsedMs = chain.lastTimeMs ? timeMs - chain.lastTimeMs : 0;
+            chain.lastTimeMs = timeMs;
+
+            for (int i = 0; i < chain.stageCount; i++) {
+                value = step(chain.stages[i], value, elapsedMs);
+            }
+        }
+
+        frame.value[pin] = value;
+    }
+}
+
+double FilterEngine::step(StageState &stage, double input, qint64 elapsedMs)
+{
+    // The first sample passes every stage unchanged
+    if (!stage.primed) {
+        stage.primed = true;
+        stage.output = input;
+        stage.window[0] = input;
+        stage.windowCount = 1;
+        stage.windowNext = stage.type == Stage::Median ? 1 % static_cast<int>(stage.parameter) : 0;
+        return input;
+    }
+
+    switch (stage.type) {
+    case Stage::Ema: {
+        // Time constant instead of a fixed factor, the poll period changes with the scan profile
+        const double alpha = 1.0 - std::exp(-static_cast<double>(elapsedMs) / stage.parameter);
+        stage.output += alpha * (input - stage.output);
+        break;
+    }
+
+    case Stage::Median: {
+        const int size = static_cast<int>(stage.parameter);
+        stage.window[stage.windowNext] = input;
+        stage.windowNext = (stage.windowNext + 1) % size;
+        stage.windowCount = qMin(stage.windowCount + 1, size);
+
+        auto sorted = stage.window;
+        const auto middle = sorted.begin() + stage.windowCount / 2;
+        std::nth_element(sorted.begin(), middle, sorted.begin() + stage.windowCount);
+        stage.output = *middle;
+        break;
+    }
+
+    case Stage::Spike:
+        // A jump that persists is a real change, not a spike
+        if (std::abs(input - stage.output) > stage.parameter && ++stage.rejected <= SPIKE_LIMIT)
+            break;
+
+        stage.rejected = 0;
+        stage.output = input;
+        break;
+
+    case Stage::RateClamp: {
+        const double limit = stage.parameter * elapsedMs / 1000.0;
+        stage.output += qBound(-limit, input - stage.output, limit);
+        break;
+    }
+    }
+
+    return stage.output;
+}
+
+bool FilterEngine::typeFromName(const QString &name, Stage::Type &type)
+{
+    if (name == "ema") {
+        type = Stage::Ema;
+    } else if (name == "median") {
+        type = Stage::Median;
+    } else if (name == "spike") {
+        type = Stage::Spike;
+    } else if (name == "rate") {
+        type = Stage::RateClamp;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+FilterEngine &FilterEngine::instance()
+{
+    static FilterEngine instance;
+    return instance;
+}
@@ -0,0 +1,83 @@
+#ifndef FILTERENGINE_H
+#define FILTERENGINE_H
+
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <array>
+
+#include "sensor.h"
+
+/**
+ * @brief Digital filter chains of the input pins, applied to every published frame.
+ *
+ * Each pin runs its stages in order on the scaled value of the frame (SensorFrame::scaled) and the
+ * result becomes the process value (SensorFrame::value). Pins without stages pass the scaled value
+ * unchanged. All filter state is preallocated, filtering a frame doesn't allocate or look anything up.
+ * Interlocks see the unfiltered value of the bus, a spike may trip them but a filter never delays them.
+ */
+class FilterEngine
+{
+public:
+    static constexpr int MAX_STAGES = 4;
+    static constexpr int MAX_MEDIAN_WINDOW = 15;
+    static constexpr int SPIKE_LIMIT = 3; // Consecutive rejected samples after which the new level is taken
+
+    struct Stage {
+        enum Type {
+            Ema,       // parameter - time constant in ms
+            Median,    // parameter - window in samples, odd
+            Spike,     // parameter - largest accepted jump from the previous output
+            RateClamp  // parameter - largest change per second
+        };
+
+        ushort pinId = 0;
+        Type type = Ema;
+        double parameter = 0;
+
+        bool isValid() const;
+    };
+
+    FilterEngine(const FilterEngine&) = delete;
+    FilterEngine& operator=(const FilterEngine &) = delete;
+
+    /**
+     * @brief Replaces the chains of every pin, stages of a pin are run in list order. Resets the filter state.
+     */
+    void setStages(const QList<Stage> &stages);
+
+    /**
+     * @brief Filters the \p pins of \p frame read at the monotonic time \p timeMs, in place.
+     */
+    void apply(SensorFrame &frame, quint32 pins, qint64 timeMs);
+
+    static bool typeFromName(const QString &name, Stage::Type &type);
+    static FilterEngine &instance();
+
+private:
+    FilterEngine() = default;
+
+    struct StageState {
+        Stage::Type type = Stage::Ema;
+        double parameter = 0;
+        double output = 0;
+        bool primed = false;
+        int rejected = 0;
+        std::array<double, MAX_MEDIAN_WINDOW> window{};
+        int windowCount = 0;
+        int windowNext = 0;
+    };
+
+    struct Chain {
+        std::array<StageState, MAX_STAGES> stages{};
+        int stageCount = 0;
+        qint64 lastTimeMs = 0;
+    };
+
+    QMutex mutex; // Applied under the publish lock of the sensor frame, configured from the main thread
+    std::array<Chain, SensorFrame::PIN_COUNT> chains{};
+
+    static double step(StageState &stage, double input, qint64 elapsedMs);
+};
+
+#endif // FILTERENGINE_H
@@ -19,50 +19,53 @@ const QString GlobalErrors::ALREADY_STARTED = "Program je već pokrenut!";
 const QString GlobalErrors::MODBUS_WRITE_COIL_ERROR = "Greška prilikom uključivanja izlaznog senzora!";
 const QString GlobalErrors::MODBUS_READ_REGISTER_ERROR = "Greška prilikom čitanja podataka!";
 const QString GlobalErrors::WRONG_STATE_FOR_SKIP = "Trenutno stanje ne dopušta preskakanje na hlađenje!";
+const QString GlobalErrors::SENSOR_STALE_ERROR = "Neki senzori ne odgovaraju!";
+const QString GlobalErrors::INTERLOCK_ERROR = "Aktivirana je sigurnosna blokada izlaza!";
 
 void GlobalErrors::setError(Error error)
 {
-    if (errors.testFlag(error))
+    if (errors.fetch_or(error) & error)
         return;
 
-    errors |= error;
     Logger::crit(QString("Global error occured: %1").arg(error));
 }
 
 void GlobalErrors::removeError(Error error)
 {
-    if (!errors.testFlag(error))
+    if (!(errors.fetch_and(~error) & error))
         return;
 
-    errors ^= error;
     Logger::debug(QString("Global error resolved: %1").arg(error));
 }
 
 GlobalErrors::Errors GlobalErrors::getErrors()
 {
-    return errors;
+    return Errors::fromInt(errors.load());
 }
 
 QVector<QString> GlobalErrors::getErrorsString()
 {
     QVector<QString> err;
+    const auto current = getErrors();
 
     // Db error
-    if (errors.testFlag(Error::DbError)) err.push_back(DB_ERROR);
-    if (errors.testFlag(Error::DbGlobalsError)) err.push_back(DB_GLOBALS);
+    if (current.testFlag(Error::DbError)) err.push_back(DB_ERROR);
+    if (current.testFlag(Error::DbGlobalsError)) err.push_back(DB_GLOBALS);
     
     // Modbus errors
-    if (errors.testFlag(Error::ModbusError)) err.push_back(MODBUS_ERROR);
-    if (errors.testFlag(Error::OldDataError)) err.push_back(OLD_DATA_ERROR);
+    if (current.testFlag(Error::ModbusError)) err.push_back(MODBUS_ERROR);
+    if (current.testFlag(Error::OldDataError)) err.push_back(OLD_DATA_ERROR);
 
     // Autoklav errors
-    if (errors.testFlag(Error::DoorClosedError)) err.push_back(DOOR_CLOSED_ERROR);
-    if (errors.testFlag(Error::BurnerError)) err.push_back(BURNER_ERROR);
-    if (errors.testFlag(Error::WaterShortageError)) err.push_back(WATER_SHORTAGE_ERROR);
-    if (errors.testFlag(Error::AlreadyStarted)) err.push_back(ALREADY_STARTED);
-    if (errors.testFlag(Error::ModbusWriteCoilError)) err.push_back(MODBUS_WRITE_COIL_ERROR);
-    if (errors.testFlag(Error::ModbusReadRegisterError)) err.push_back(MODBUS_READ_REGISTER_ERROR);
-    if (errors.testFlag(Error::WrongStateForSkip)) err.push_back(WRONG_STATE_FOR_SKIP);
+    if (current.testFlag(Error::DoorClosedError)) err.push_back(DOOR_CLOSED_ERROR);
+    if (current.testFlag(Error::BurnerError)) err.push_back(BURNER_ERROR);
+    if (current.testFlag(Error::WaterShortageError)) err.push_back(WATER_SHORTAGE_ERROR);
+    if (current.testFlag(Error::AlreadyStarted)) err.push_back(ALREADY_STARTED);
+    if (current.testFlag(Error::ModbusWriteCoilError)) err.push_back(MODBUS_WRITE_COIL_ERROR);
+    if (current.testFlag(Error::ModbusReadRegisterError)) err.push_back(MODBUS_READ_REGISTER_ERROR);
+    if (current.testFlag(Error::WrongStateForSkip)) err.push_back(WRONG_STATE_FOR_SKIP);
+    if (current.testFlag(Error::SensorStaleError)) err.push_back(SENSOR_STALE_ERROR);
+    if (current.testFlag(Error::InterlockError)) err.push_back(INTERLOCK_ERROR);
 
     return err;
 }
@@ -2,6 +2,7 @@
 #define GLOBALERRORS_H
 
 #include <QFlags>
+#include <atomic>
 
 class GlobalErrors
 {
@@ -18,6 +19,8 @@ public:
         ModbusWriteCoilError = 0x100,
         ModbusReadRegisterError = 0x200,
         WrongStateForSkip = 0x400,
+        SensorStaleError = 0x800,
+        InterlockError = 0x1000,
     };
     Q_DECLARE_FLAGS(Errors, Error);
 
@@ -37,6 +40,8 @@ public:
     static const QString MODBUS_WRITE_COIL_ERROR;
     static const QString MODBUS_READ_REGISTER_ERROR;
     static const QString WRONG_STATE_FOR_SKIP;
+    static const QString SENSOR_STALE_ERROR;
+    static const QString INTERLOCK_ERROR;
 
     static void setError(Error error);
     static void removeError(Error error);
@@ -44,7 +49,8 @@ public:
     static QVector<QString> getErrorsString();
 
 private:
-    inline static Errors errors;
+    // Set from both the main and the Modbus I/O thread
+    inline static std::atomic<Errors::Int> errors{0};
 };
 
 Q_DECLARE_OPERATORS_FOR_FLAGS(GlobalErrors::Errors)
@@ -16,6 +16,18 @@ public:
     inline static int stateMachineTick = 5000;
     inline static int dbTick = 60000;
     inline static int serialDataOldTime = 5000;
+    inline static int modbusStatsDumpTick = 60000;
+    inline static int relayReconcileTick = 5000;
+    inline static int alarmPulseTime = 1000;
+    inline static int scadaPort = 1502;        // Modbus TCP server for the SCADA, 0 - off
+    inline static int historySamples = 36000;  // Full rate samples kept per input pin, applied on restart
+
+    // Line settings of the single bus used when the ModbusBus table is empty
+    inline static int serialBaudRate = 9600;
+    inline static int serialParity = 1;        // 0 - none, 1 - odd, 2 - even
+    inline static int serialStopBits = 1;
+    inline static int modbusTurnaroundUs = 0;  // Extra silence after a reply, for slow slaves
+
     inline static double k = 5;
     inline static double coolingThreshold = 50;
     inline static double expansionUpperTemp = 95;
@@ -24,10 +36,26 @@ public:
     inline static double maintainWaterTankTemp = 95;
     inline static double tankWaterLevelThreshold = 95;
 
+    // Set from the command line, not stored in the database
+    inline static QString serialPortName; // Overrides the port of the first bus
+    inline static QString databaseDir;
+    inline static QString captureFile;    // Modbus traffic of every bus is recorded here
+    inline static QString replayFile;     // Buses are replaced by a replay of this capture
+    inline static bool replayFast = false;
+
     inline static QHash<QString, VarRefType> variables = {
         {"stateMachineTick",        std::ref(stateMachineTick)},
         {"dbTick",                  std::ref(dbTick)},
         {"serialDataOldTime",       std::ref(serialDataOldTime)},
+        {"modbusStatsDumpTick",     std::ref(modbusStatsDumpTick)},
+        {"relayReconcileTick",      std::ref(relayReconcileTick)},
+        {"alarmPulseTime",          std::ref(alarmPulseTime)},
+        {"scadaPort",               std::ref(scadaPort)},
+        {"historySamples",          std::ref(historySamples)},
+        {"serialBaudRate",          std::ref(serialBaudRate)},
+        {"serialParity",            std::ref(serialParity)},
+        {"serialStopBits",          std::ref(serialStopBits)},
+        {"modbusTurnaroundUs",      std::ref(modbusTurnaroundUs)},
         {"k",                       std::ref(k)},
         {"coolingThreshold",        std::ref(coolingThreshold)},
         {"expansionUpperTemp",      std::ref(expansionUpperTemp)},
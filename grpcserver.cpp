@@ -4,7 +4,9 @@
 #include "autoklav.grpc.pb.h"
 
 #include <QCoreApplication>
+#include <QWaitCondition>
 #include <QtConcurrent/QtConcurrentRun>
+#include <memory>
 
 #include "sensor.h"
 #include "globals.h"
@@ -13,6 +15,12 @@
 #include "globalerrors.h"
 #include "invokeonmainthread.h"
 #include "logger.h"
+#include "modbusbuses.h"
+#include "relayimage.h"
+#include "interlockengine.h"
+#include "sensorhistory.h"
+#include "calibrationengine.h"
+#include "changenotifier.h"
 
 
 using grpc::Status;
@@ -50,13 +58,20 @@ private:
         Status stopProcess(grpc::ServerContext *context, const autoklav::Empty *request, autoklav::Status *replay) override;
         Status skipToCooling(grpc::ServerContext *context, const autoklav::Empty *request, autoklav::Status *replay) override;
         Status getSensorPinValues(grpc::ServerContext *context, const autoklav::Empty *request, autoklav::SensorValues *replay) override;
+        Status watchSensorPinValues(grpc::ServerContext *context, const autoklav::Empty *request, grpc::ServerWriter<autoklav::SensorValues> *writer) override;
         Status getSensorRelayValues(grpc::ServerContext *context, const autoklav::Empty *request, autoklav::SensorRelayValues *replay) override;
         Status updateInputPin(grpc::ServerContext *context, const autoklav::UpdateInputPinRequest *request, autoklav::Status *replay) override;
+        Status updateInputChannel(grpc::ServerContext *context, const autoklav::UpdateInputChannelRequest *request, autoklav::Status *replay) override;
+        Status updateInputCalibration(grpc::ServerContext *context, const autoklav::UpdateInputCalibrationRequest *request, autoklav::Status *replay) override;
+        Status getSensorHistory(grpc::ServerContext *context, const autoklav::SensorHistoryRequest *request, autoklav::SensorHistory *replay) override;
         Status getStateMachineValues(grpc::ServerContext *context, const autoklav::Empty *request, autoklav::StateMachineValues *replay) override;
         Status setRelayStatus(grpc::ServerContext *context, const autoklav::SetRelay *request, autoklav::Status *replay) override;
+        Status getModbusStats(grpc::ServerContext *context, const autoklav::Empty *request, autoklav::ModbusStats *replay) override;
 
         // Custom helper function
         void setStatusReply(autoklav::Status *replay, int code);
+        void setSensorValues(autoklav::SensorValues *replay, const SensorValues &sensorValues);
+        bool hasModbusError();
     };
 
     AutoklavServiceImpl service;
@@ -182,6 +197,81 @@ Status GRpcServer::Impl::AutoklavServiceImpl::updateInputPin(grpc::ServerContext
     return Status::OK;
 }
 
+Status GRpcServer::Impl::AutoklavServiceImpl::updateInputChannel(grpc::ServerContext *context, const autoklav::UpdateInputChannelRequest *request, autoklav::Status *replay)
+{
+    Q_UNUSED(context);
+
+    ScanChannel channel;
+    channel.pinId = request->id();
+    channel.slaveAddress = request->slaveid();
+    channel.address = request->register_();
+    channel.count = request->count();
+    channel.scale = request->scale();
+    channel.pollPeriodMs = request->pollperiodms();
+
+    bool success = ScanChannel::registerTypeFromFunctionCode(request->functioncode(), channel.registerType)
+                   && ScanChannel::dataTypeFromName(QString::fromStdString(request->datatype()), channel.dataType);
+
+    if (success) {
+        success = invokeOnMainThreadBlocking([channel](){
+            return ModbusBuses::instance().updateChannel(channel);
+        });
+    }
+
+    setStatusReply(replay, !success);
+    return Status::OK;
+}
+
+Status GRpcServer::Impl::AutoklavServiceImpl::updateInputCalibration(grpc::ServerContext *context, const autoklav::UpdateInputCalibrationRequest *request, autoklav::Status *replay)
+{
+    Q_UNUSED(context);
+
+    CalibrationEngine::Calibration calibration;
+    calibration.pinId = request->id();
+    calibration.scale = request->scale();
+    calibration.offset = request->offset();
+    calibration.rawMin = request->rawmin();
+    calibration.rawMax = request->rawmax();
+
+    for (const auto coefficient : request->coefficients()) {
+        calibration.coefficients.append(coefficient);
+    }
+
+    bool success = CalibrationEngine::typeFromName(QString::fromStdString(request->calibration()), calibration.type);
+
+    if (success) {
+        success = invokeOnMainThreadBlocking([calibration](){
+            return CalibrationEngine::instance().updateCalibration(calibration);
+        });
+    }
+
+    setStatusReply(replay, !success);
+    return Status::OK;
+}
+
+Status GRpcServer::Impl::AutoklavServiceImpl::getSensorHistory(grpc::ServerContext *context, const autoklav::SensorHistoryRequest *request, autoklav::SensorHistory *replay)
+{
+    Q_UNUSED(context);
+
+    // Served from memory, no need to wait for the main thread
+    const auto series = SensorHistory::instance().query(request->id(), request->fromms(), request->toms(), request->maxpoints());
+
+    replay->set_id(request->id());
+    replay->set_resolutionms(series.resolutionMs);
+
+    for (const auto &point : series.points) {
+        auto historyPoint = replay->add_points();
+        historyPoint->set_timestampms(point.timestampMs);
+        historyPoint->set_value(point.value);
+        historyPoint->set_min(point.min);
+        historyPoint->set_max(point.max);
+        historyPoint->set_raw(point.raw);
+        historyPoint->set_count(point.count);
+    }
+
+    return Status::OK;
+}
+
 Status GRpcServer::Impl::AutoklavServiceImpl::startProcess(grpc::ServerContext *context, const autoklav::StartProcessRequest *request, autoklav::Status *replay)
 {
     Q_UNUSED(context);
@@ -554,34 +644,63 @@ Status GRpcServer::Impl::AutoklavServiceImpl::getSensorPinValues(grpc::ServerCon
     Q_UNUSED(context);
     Q_UNUSED(request);
 
-    const auto sensorValues = invokeOnMainThreadBlocking([](){
-        return Sensor::getPinValues();
-    });
-
-    // Fetch error flags
-    QVector<QString> errorStrings = GlobalErrors::getErrorsString();
+    // Read from the published sensor frame, no need to wait for the main thread
+    const auto sensorValues = Sensor::getPinValues();
 
     // If there is a serial error, send abort status
-    for(const QString& errorString : errorStrings){
-        if(errorString == GlobalErrors::MODBUS_ERROR){
-            return Status(grpc::StatusCode::ABORTED, GlobalErrors::MODBUS_ERROR.toStdString());
+    if (hasModbusError())
+        return Status(grpc::StatusCode::ABORTED, GlobalErrors::MODBUS_ERROR.toStdString());
+
+    setSensorValues(replay, sensorValues);
+    return Status::OK;
+}
+
+Status GRpcServer::Impl::AutoklavServiceImpl::watchSensorPinValues(grpc::ServerContext *context, const autoklav::Empty *request, grpc::ServerWriter<autoklav::SensorValues> *writer)
+{
+    Q_UNUSED(request);
+
+    // Shared with the connection, a bus thread may still be emitting when this call returns
+    struct Pending {
+        QMutex mutex;
+        QWaitCondition changed;
+        bool values = true; // The current values are sent first
+    };
+    const auto pending = std::make_shared<Pending>();
+
+    // Runs on the bus thread that published the values, it only wakes this call
+    const auto connection = QObject::connect(&ChangeNotifier::instance(), &ChangeNotifier::valuesChanged, [pending]() {
+        QMutexLocker locker(&pending->mutex);
+        pending->values = true;
+        pending->changed.wakeOne();
+    });
+
+    Status status = Status::OK;
+    while (!context->IsCancelled()) {
+        {
+            QMutexLocker locker(&pending->mutex);
+            if (!pending->values)
+                pending->changed.wait(&pending->mutex, 1000); // Looks for a cancelled call every second
+            if (!pending->values)
+                continue;
+            pending->values = false;
         }
-    }
 
-    replay->set_temp(sensorValues.temp);
-    replay->set_expansiontemp(sensorValues.expansionTemp);
-    replay->set_heatertemp(sensorValues.heaterTemp);
-    replay->set_tanktemp(sensorValues.tankTemp);
-    replay->set_tempk(sensorValues.tempK);
-    replay->set_tankwaterlevel(sensorValues.tankWaterLevel);
-    replay->set_pressure(sensorValues.pressure);
-    replay->set_steampressure(sensorValues.steamPressure);
+        // Changes that arrive while writing are sent once, with the latest values
+        const auto sensorValues = Sensor::getPinValues();
 
-    replay->set_doorclosed(sensorValues.doorClosed);
-    replay->set_burnerfault(sensorValues.burnerFault);
-    replay->set_watershortage(sensorValues.waterShortage);
+        if (hasModbusError()) {
+            status = Status(grpc::StatusCode::ABORTED, GlobalErrors::MODBUS_ERROR.toStdString());
+            break;
+        }
 
-    return Status::OK;
+        autoklav::SensorValues values;
+        setSensorValues(&values, sensorValues);
+        if (!writer->Write(values))
+            break;
+    }
+
+    QObject::disconnect(connection);
+    return status;
 }
 
 Status GRpcServer::Impl::AutoklavServiceImpl::getSensorRelayValues(grpc::ServerContext *context, const autoklav::Empty *request, autoklav::SensorRelayValues *replay)
@@ -652,6 +771,7 @@ Status GRpcServer::Impl::AutoklavServiceImpl::getStateMachineValues(grpc::Server
     sensorValues->set_doorclosed(stateMachineValues.doorClosed);
     sensorValues->set_burnerfault(stateMachineValues.burnerFault);
     sensorValues->set_watershortage(stateMachineValues.waterShortage);
+    sensorValues->set_generation(stateMachineValues.generation);
 
     replay->set_dtemp(stateMachineValues.dTemp);
     replay->set_state(stateMachineValues.state);
@@ -667,9 +787,131 @@ Status GRpcServer::Impl::AutoklavServiceImpl::getStateMachineValues(grpc::Server
     return Status::OK;
 }
 
+static void setLatencySummary(autoklav::LatencySummary *summary, const LatencyHistogram &histogram)
+{
+    summary->set_count(histogram.count());
+    summary->set_minus(histogram.min());
+    summary->set_p50us(histogram.valueAtPercentile(50));
+    summary->set_p90us(histogram.valueAtPercentile(90));
+    summary->set_p99us(histogram.valueAtPercentile(99));
+    summary->set_maxus(histogram.max());
+    summary->set_meanus(histogram.mean());
+}
+
+Status GRpcServer::Impl::AutoklavServiceImpl::getModbusStats(grpc::ServerContext *context, const autoklav::Empty *request, autoklav::ModbusStats *replay)
+{
+    Q_UNUSED(context);
+    Q_UNUSED(request);
+
+    qint64 acquisitionTimeUs = 0;
+
+    for (const auto bus : ModbusBuses::instance().buses()) {
+        const auto &config = bus->busConfig();
+        const auto snapshot = bus->statsSnapshot();
+        auto busStats = replay->add_buses();
+
+        busStats->set_id(config.id);
+        busStats->set_name(config.name.toStdString());
+        busStats->set_port(config.portName.toStdString());
+
+        for (const auto &entry : snapshot.requests.entries()) {
+            auto slave = busStats->add_slaves();
+
+            slave->set_slaveaddress(entry.slaveAddress);
+            slave->set_registertype(ModbusStats::registerTypeName(entry.registerType).toStdString());
+            setLatencySummary(slave->mutable_queuewait(), entry.queueWait);
+            setLatencySummary(slave->mutable_response(), entry.response);
+            setLatencySummary(slave->mutable_endtoend(), entry.endToEnd);
+            slave->set_timeouts(entry.timeouts);
+            slave->set_crcerrors(entry.crcErrors);
+            slave->set_exceptions(entry.exceptions);
+            slave->set_othererrors(entry.otherErrors);
+            slave->set_drops(entry.drops);
+            slave->set_retries(entry.retries);
+        }
+
+        for (int i = 0; i < BusScheduler::PriorityCount; i++) {
+            const auto &classStats = snapshot.scheduler[i];
+            auto scheduler = busStats->add_scheduler();
+
+            scheduler->set_priority(BusScheduler::priorityName(static_cast<BusScheduler::Priority>(i)).toStdString());
+            scheduler->set_depth(classStats.depth);
+            scheduler->set_capacity(classStats.capacity);
+            scheduler->set_enqueued(classStats.enqueued);
+            scheduler->set_dispatched(classStats.dispatched);
+            scheduler->set_dropped(classStats.dropped);
+            scheduler->set_coalesced(classStats.coalesced);
+            scheduler->set_promoted(classStats.promoted);
+            scheduler->set_averagewaitus(classStats.averageWaitNs() / 1000);
+            scheduler->set_maxwaitus(classStats.maxWaitNs / 1000);
+        }
+
+        for (auto it = snapshot.health.slaves().cbegin(); it != snapshot.health.slaves().cend(); ++it) {
+            auto health = busStats->add_health();
+
+            health->set_slaveaddress(it.key());
+            health->set_breakerstate(SlaveHealth::stateName(it->state).toStdString());
+            health->set_timeoutms(snapshot.health.timeoutMs(it.key()));
+            health->set_consecutivefailures(it->consecutiveFailures);
+            health->set_successes(it->successes);
+            health->set_failures(it->failures);
+        }
+
+        busStats->set_scancycletimeus(snapshot.scanCycleTimeUs);
+        busStats->set_scanoverruns(snapshot.scanOverruns);
+        busStats->set_transport(bus->transport().toStdString());
+        busStats->set_framespersecond(snapshot.framesPerSecond);
+        setLatencySummary(busStats->mutable_scanjitter(), snapshot.scanJitter);
+
+        // Buses scan concurrently, a complete acquisition takes as long as the slowest one
+        acquisitionTimeUs = qMax(acquisitionTimeUs, snapshot.scanCycleTimeUs);
+    }
+
+    replay->set_acquisitiontimeus(acquisitionTimeUs);
+
+    const auto emergencyStop = RelayImage::instance().lastEmergencyStop();
+    replay->set_emergencystopus(emergencyStop.latencyUs);
+    replay->set_emergencystopverified(emergencyStop.verified);
+
+    const auto &interlocks = InterlockEngine::instance();
+    for (const auto &rule : interlocks.rules()) {
+        auto interlock = replay->add_interlocks();
+        interlock->set_id(rule.id);
+        interlock->set_alias(rule.alias.toStdString());
+        interlock->set_tripped(rule.tripped);
+        interlock->set_trips(rule.trips);
+    }
+    setLatencySummary(replay->mutable_interlockreaction(), interlocks.reactionTime());
+    replay->set_slowinterlockreactions(interlocks.slowReactions());
+
+    return Status::OK;
+}
+
 void GRpcServer::Impl::AutoklavServiceImpl::setStatusReply(autoklav::Status *replay, int code)
 {
     replay->set_code(code);
     replay->set_errors(GlobalErrors::getErrors());
     replay->set_errorsstring(GlobalErrors::getErrorsString().join("|").toStdString());
 }
+
+void GRpcServer::Impl::AutoklavServiceImpl::setSensorValues(autoklav::SensorValues *replay, const SensorValues &sensorValues)
+{
+    replay->set_temp(sensorValues.temp);
+    replay->set_expansiontemp(sensorValues.expansionTemp);
+    replay->set_heatertemp(sensorValues.heaterTemp);
+    replay->set_tanktemp(sensorValues.tankTemp);
+    replay->set_tempk(sensorValues.tempK);
+    replay->set_tankwaterlevel(sensorValues.tankWaterLevel);
+    replay->set_pressure(sensorValues.pressure);
+    replay->set_steampressure(sensorValues.steamPressure);
+
+    replay->set_doorclosed(sensorValues.doorClosed);
+    replay->set_burnerfault(sensorValues.burnerFault);
+    replay->set_watershortage(sensorValues.waterShortage);
+    replay->set_generation(sensorValues.generation);
+}
+
+bool GRpcServer::Impl::AutoklavServiceImpl::hasModbusError()
+{
+    return GlobalErrors::getErrorsString().contains(GlobalErrors::MODBUS_ERROR);
+}
@@ -5,6 +5,11 @@ CREATE TABLE Globals ( name TEXT NOT NULL UNIQUE, value TEXT NOT NULL );
 INSERT INTO Globals VALUES ( "stateMachineTick", "5000" );
 INSERT INTO Globals VALUES ( "dbTick", "60000" );
 INSERT INTO Globals VALUES ( "serialDataOldTime", "5000" );
+INSERT INTO Globals VALUES ( "modbusStatsDumpTick", "60000" );
+INSERT INTO Globals VALUES ( "relayReconcileTick", "5000" );
+INSERT INTO Globals VALUES ( "alarmPulseTime", "1000" );
+INSERT INTO Globals VALUES ( "scadaPort", "1502" );
+INSERT INTO Globals VALUES ( "historySamples", "36000" );
 INSERT INTO Globals VALUES ( "k", "5" );
 INSERT INTO Globals VALUES ( "coolingThreshold", "50" );
 INSERT INTO Globals VALUES ( "expansionUpperTemp", "95" );
@@ -19,46 +24,183 @@ CREATE TABLE InputPin (
     id INTEGER PRIMARY KEY,
     alias TEXT,
     minValue REAL NOT NULL,
-    maxValue REAL NOT NULL
+    maxValue REAL NOT NULL,
+    slaveId INTEGER,                                                -- NULL if the pin is not polled
+    functionCode INTEGER NOT NULL DEFAULT 3 CHECK (functionCode IN (1, 2, 3, 4)),
+    register INTEGER NOT NULL DEFAULT 1,
+    count INTEGER NOT NULL DEFAULT 1,                               -- Registers read, 2 for 32 bit types
+    dataType TEXT NOT NULL DEFAULT 'uint16' CHECK (dataType IN ('uint16', 'int16', 'uint32', 'int32', 'float32', 'bool')),
+    scale REAL NOT NULL DEFAULT 1,                                  -- Gain of the linear calibration
+    pollPeriodMs INTEGER NOT NULL DEFAULT 0,                        -- 0 polls on every scan cycle of the bus
+    scadaRegister INTEGER,                                          -- Float32 value on the SCADA server, NULL if not served
+    calibration TEXT NOT NULL DEFAULT 'linear' CHECK (calibration IN ('linear', 'twoPoint', 'polynomial')),
+    offset REAL NOT NULL DEFAULT 0,                                 -- linear: raw * scale + offset
+    rawMin REAL NOT NULL DEFAULT 0,                                 -- twoPoint: rawMin..rawMax is minValue..maxValue
+    rawMax REAL NOT NULL DEFAULT 0,
+    coefficients TEXT,                                              -- polynomial: c0,c1,c2,c3 over the raw value, c0 first
+    deadband REAL NOT NULL DEFAULT 0,                               -- Smallest change reported to consumers, 0 - every change
+    deadbandType TEXT NOT NULL DEFAULT 'absolute' CHECK (deadbandType IN ('absolute', 'percent')) -- percent of minValue..maxValue
 );
 
--- Input pins
-INSERT INTO InputPin (id, alias, minValue, maxValue) VALUES (2, 'temp', -48.35, 220.12);
-INSERT INTO InputPin (id, alias, minValue, maxValue) VALUES (3, 'tempK', -51.23, 217.24);
-INSERT INTO InputPin (id, alias, minValue, maxValue) VALUES (4, 'expansionTemp', -48.35, 220.12);
-INSERT INTO InputPin (id, alias, minValue, maxValue) VALUES (5, 'heaterTemp', -48.35, 220.12);
-INSERT INTO InputPin (id, alias, minValue, maxValue) VALUES (6, 'tankTemp', -48.35, 220.12);
-INSERT INTO InputPin (id, alias, minValue, maxValue) VALUES (7, 'tankWaterLevel', -43.731249999999875, 167.46874999999994);
-INSERT INTO InputPin (id, alias, minValue, maxValue) VALUES (8, 'pressure', -1.08, 5.064);
-INSERT INTO InputPin (id, alias, minValue, maxValue) VALUES (9, 'steamPressure', -0.00598, 16.16966);
-
--- Digital Pins read through Analog Inputs, converted from [analogMin, analogMax] to [0, 1]
-INSERT INTO InputPin (id, alias, minValue, maxValue) VALUES (10, 'doorClosed', 0, 1);
-INSERT INTO InputPin (id, alias, minValue, maxValue) VALUES (11, 'burnerFault', 0, 1);
-INSERT INTO InputPin (id, alias, minValue, maxValue) VALUES (12, 'waterShortage', 0, 1);
+-- Input pins, each analog transmitter is its own slave with the value in holding register 1
+INSERT INTO InputPin (id, alias, minValue, maxValue, slaveId, functionCode, register, count, dataType, scale, pollPeriodMs, scadaRegister) VALUES (2, 'temp', -48.35, 220.12, 2, 3, 1, 1, 'uint16', 0.1, 0, 0);
+INSERT INTO InputPin (id, alias, minValue, maxValue, slaveId, functionCode, register, count, dataType, scale, pollPeriodMs, scadaRegister) VALUES (3, 'tempK', -51.23, 217.24, 3, 3, 1, 1, 'uint16', 0.1, 0, 2);
+INSERT INTO InputPin (id, alias, minValue, maxValue, slaveId, functionCode, register, count, dataType, scale, pollPeriodMs, scadaRegister) VALUES (4, 'expansionTemp', -48.35, 220.12, 4, 3, 1, 1, 'uint16', 0.1, 0, 4);
+INSERT INTO InputPin (id, alias, minValue, maxValue, slaveId, functionCode, register, count, dataType, scale, pollPeriodMs, scadaRegister) VALUES (5, 'heaterTemp', -48.35, 220.12, 5, 3, 1, 1, 'uint16', 0.1, 0, 6);
+INSERT INTO InputPin (id, alias, minValue, maxValue, slaveId, functionCode, register, count, dataType, scale, pollPeriodMs, scadaRegister) VALUES (6, 'tankTemp', -48.35, 220.12, 6, 3, 1, 1, 'uint16', 0.1, 0, 8);
+INSERT INTO InputPin (id, alias, minValue, maxValue, slaveId, functionCode, register, count, dataType, scale, pollPeriodMs, scadaRegister) VALUES (7, 'tankWaterLevel', -43.731249999999875, 167.46874999999994, 7, 3, 1, 1, 'uint16', 0.1, 0, 10);
+INSERT INTO InputPin (id, alias, minValue, maxValue, slaveId, functionCode, register, count, dataType, scale, pollPeriodMs, scadaRegister) VALUES (8, 'pressure', -1.08, 5.064, 8, 3, 1, 1, 'uint16', 0.01, 0, 12);
+INSERT INTO InputPin (id, alias, minValue, maxValue, slaveId, functionCode, register, count, dataType, scale, pollPeriodMs, scadaRegister) VALUES (9, 'steamPressure', -0.00598, 16.16966, 9, 3, 1, 1, 'uint16', 0.01, 0, 14);
+
+-- Digital inputs of the CWT board, read with FC02 and mapped to pin = input + 10
+INSERT INTO InputPin (id, alias, minValue, maxValue, slaveId, functionCode, register, count, dataType, scale, pollPeriodMs, scadaRegister) VALUES (10, 'doorClosed', 0, 1, 1, 2, 0, 1, 'bool', 1, 0, 16);
+INSERT INTO InputPin (id, alias, minValue, maxValue, slaveId, functionCode, register, count, dataType, scale, pollPeriodMs, scadaRegister) VALUES (11, 'burnerFault', 0, 1, 1, 2, 1, 1, 'bool', 1, 0, 18);
+INSERT INTO InputPin (id, alias, minValue, maxValue, slaveId, functionCode, register, count, dataType, scale, pollPeriodMs, scadaRegister) VALUES (12, 'waterShortage', 0, 1, 1, 2, 2, 1, 'bool', 1, 0, 20);
+
+-- Deadbands, temperatures to 0.1 °C, pressures to 0.01 bar, the water level to 0.5 % of its range
+UPDATE InputPin SET deadband = 0.1 WHERE id IN (2, 3, 4, 5, 6);
+UPDATE InputPin SET deadband = 0.01 WHERE id IN (8, 9);
+UPDATE InputPin SET deadband = 0.5, deadbandType = 'percent' WHERE id = 7;
+
+-- ScanProfile, poll period and request priority of input pins per StateMachine::State
+-- (0 READY, 1 STARTING, 2 FILLING, 3 HEATING, 4 STERILIZING, 5 PRECOOLING, 6 COOLING, 7 FINISHING, 8 FINISHED).
+-- Pins without a row for the current state keep the pollPeriodMs of InputPin at periodic priority.
+DROP TABLE IF EXISTS ScanProfile;
+
+CREATE TABLE ScanProfile (
+    state INTEGER NOT NULL,
+    pinId INTEGER NOT NULL REFERENCES InputPin(id),
+    pollPeriodMs INTEGER NOT NULL,
+    priority TEXT NOT NULL DEFAULT 'periodic' CHECK (priority IN ('control', 'periodic', 'diagnostic')),
+    PRIMARY KEY (state, pinId)
+);
+
+-- Heating: temperatures and pressure follow the control loop, slow tank values
+INSERT INTO ScanProfile (state, pinId, pollPeriodMs, priority) VALUES (3, 2, 500, 'control');
+INSERT INTO ScanProfile (state, pinId, pollPeriodMs, priority) VALUES (3, 3, 500, 'control');
+INSERT INTO ScanProfile (state, pinId, pollPeriodMs, priority) VALUES (3, 6, 5000, 'diagnostic');
+INSERT INTO ScanProfile (state, pinId, pollPeriodMs, priority) VALUES (3, 7, 5000, 'diagnostic');
+
+-- Sterilizing: tempK drives the F value integral
+INSERT INTO ScanProfile (state, pinId, pollPeriodMs, priority) VALUES (4, 2, 250, 'control');
+INSERT INTO ScanProfile (state, pinId, pollPeriodMs, priority) VALUES (4, 3, 250, 'control');
+INSERT INTO ScanProfile (state, pinId, pollPeriodMs, priority) VALUES (4, 9, 500, 'control');
+INSERT INTO ScanProfile (state, pinId, pollPeriodMs, priority) VALUES (4, 5, 5000, 'diagnostic');
+INSERT INTO ScanProfile (state, pinId, pollPeriodMs, priority) VALUES (4, 6, 5000, 'diagnostic');
+INSERT INTO ScanProfile (state, pinId, pollPeriodMs, priority) VALUES (4, 7, 5000, 'diagnostic');
+
+-- Cooling: temperatures decide the end of the process
+INSERT INTO ScanProfile (state, pinId, pollPeriodMs, priority) VALUES (6, 2, 500, 'control');
+INSERT INTO ScanProfile (state, pinId, pollPeriodMs, priority) VALUES (6, 3, 500, 'control');
+
+-- Interlock, outputs forced off by the I/O layer as soon as an input crosses its limit,
+-- held off until the input is back within limit -/+ hysteresis. outputs are comma separated OutputPin ids.
+DROP TABLE IF EXISTS Interlock;
+
+CREATE TABLE Interlock (
+    id INTEGER PRIMARY KEY,
+    alias TEXT,
+    pinId INTEGER NOT NULL REFERENCES InputPin(id),
+    condition TEXT NOT NULL CHECK (condition IN ('above', 'below')),
+    limitValue REAL NOT NULL,
+    hysteresis REAL NOT NULL DEFAULT 0,
+    outputs TEXT NOT NULL,
+    enabled INTEGER NOT NULL DEFAULT 1
+);
+
+-- Seeded disabled: the polarity of the digital inputs and the pressure limit must be checked on the
+-- autoclave before a rule is enabled, a wrong polarity holds the heating off for good
+INSERT INTO Interlock (id, alias, pinId, condition, limitValue, hysteresis, outputs, enabled) VALUES (1, 'doorOpen', 10, 'below', 0.5, 0, '6,8,11', 0);
+INSERT INTO Interlock (id, alias, pinId, condition, limitValue, hysteresis, outputs, enabled) VALUES (2, 'overPressure', 9, 'above', 3.5, 0.3, '6,8', 0);
+INSERT INTO Interlock (id, alias, pinId, condition, limitValue, hysteresis, outputs, enabled) VALUES (3, 'burnerFault', 11, 'above', 0.5, 0, '6', 0);
+INSERT INTO Interlock (id, alias, pinId, condition, limitValue, hysteresis, outputs, enabled) VALUES (4, 'waterShortage', 12, 'above', 0.5, 0, '6', 0);
+
+-- InputFilter, filter chain run on every fresh value of an input pin, stages in ascending order.
+-- parameter: ema - time constant in ms, median - odd window in samples, spike - largest accepted jump,
+-- rate - largest change per second. At most 4 stages per pin.
+DROP TABLE IF EXISTS InputFilter;
+
+CREATE TABLE InputFilter (
+    id INTEGER PRIMARY KEY,
+    pinId INTEGER NOT NULL REFERENCES InputPin(id),
+    stage INTEGER NOT NULL,
+    type TEXT NOT NULL CHECK (type IN ('ema', 'median', 'spike', 'rate')),
+    parameter REAL NOT NULL,
+    enabled INTEGER NOT NULL DEFAULT 1,
+    UNIQUE (pinId, stage)
+);
+
+INSERT INTO InputFilter (id, pinId, stage, type, parameter) VALUES (1, 3, 1, 'spike', 5);
+INSERT INTO InputFilter (id, pinId, stage, type, parameter) VALUES (2, 3, 2, 'median', 3);
+INSERT INTO InputFilter (id, pinId, stage, type, parameter) VALUES (3, 3, 3, 'ema', 2000);
+INSERT INTO InputFilter (id, pinId, stage, type, parameter) VALUES (4, 2, 1, 'spike', 5);
+INSERT INTO InputFilter (id, pinId, stage, type, parameter) VALUES (5, 2, 2, 'median', 3);
 
 -- OutputPin, used for sending commands to the PLC through Modbus network, QT acts as clients that sends commands to the server PLC
+-- minOnMs and minOffMs hold back a change until the relay has been on or off that long, interlocks and the emergency stop excepted.
 DROP TABLE IF EXISTS OutputPin;
 
 CREATE TABLE OutputPin (
     id INTEGER PRIMARY KEY,
-    alias TEXT
+    alias TEXT,
+    minOnMs INTEGER NOT NULL DEFAULT 0,
+    minOffMs INTEGER NOT NULL DEFAULT 0
 );
 
 -- Digital Outputs
 INSERT INTO OutputPin (id, alias) VALUES (0, 'fillTankWithWater');
-INSERT INTO OutputPin (id, alias) VALUES (1, 'cooling');
+INSERT INTO OutputPin (id, alias, minOnMs, minOffMs) VALUES (1, 'cooling', 5000, 5000);
 INSERT INTO OutputPin (id, alias) VALUES (2, 'tankHeating');
 INSERT INTO OutputPin (id, alias) VALUES (3, 'coolingHelper');
 INSERT INTO OutputPin (id, alias) VALUES (4, 'autoklavFill');
 INSERT INTO OutputPin (id, alias) VALUES (5, 'waterDrain');
 INSERT INTO OutputPin (id, alias) VALUES (6, 'heating');
-INSERT INTO OutputPin (id, alias) VALUES (7, 'pump');
+INSERT INTO OutputPin (id, alias, minOnMs, minOffMs) VALUES (7, 'pump', 10000, 10000);
 INSERT INTO OutputPin (id, alias) VALUES (11, 'electricHeating');
 INSERT INTO OutputPin (id, alias) VALUES (8, 'increasePressure');
 INSERT INTO OutputPin (id, alias) VALUES (10, 'extensionCooling');
 INSERT INTO OutputPin (id, alias) VALUES (9, 'alarmSignal');
 
+-- ModbusBus, RS-485 segments (type 'rtu') or Modbus TCP gateways (type 'tcp', port is host:port), each with its own master.
+-- Type 'rtu-native' drives the serial port directly through termios, when built with AUTOKLAV_NATIVE_RTU (Linux).
+-- Parity is 0 - none, 1 - odd, 2 - even. maxInFlight is the number of outstanding TCP transactions, RTU always has one.
+DROP TABLE IF EXISTS ModbusBus;
+
+CREATE TABLE ModbusBus (
+    id INTEGER PRIMARY KEY,
+    type TEXT NOT NULL DEFAULT 'rtu' CHECK (type IN ('rtu', 'rtu-native', 'tcp')),
+    name TEXT NOT NULL,
+    port TEXT NOT NULL,
+    baudRate INTEGER NOT NULL DEFAULT 9600,
+    parity INTEGER NOT NULL DEFAULT 1,
+    stopBits INTEGER NOT NULL DEFAULT 1,
+    turnaroundUs INTEGER NOT NULL DEFAULT 0,
+    scanIntervalMs INTEGER NOT NULL DEFAULT 1000,
+    maxInFlight INTEGER NOT NULL DEFAULT 8
+);
+
+INSERT INTO ModbusBus (id, type, name, port, baudRate, parity, stopBits, turnaroundUs, scanIntervalMs) VALUES (1, 'rtu', 'main', 'COM7', 9600, 1, 1, 0, 1000);
+
+-- ModbusSlave, bus every slave address is wired to, turnaroundUs overrides the one of the bus
+DROP TABLE IF EXISTS ModbusSlave;
+
+CREATE TABLE ModbusSlave (
+    address INTEGER PRIMARY KEY,
+    busId INTEGER NOT NULL REFERENCES ModbusBus(id),
+    alias TEXT,
+    turnaroundUs INTEGER
+);
+
+INSERT INTO ModbusSlave (address, busId, alias) VALUES (1, 1, 'cwt');
+INSERT INTO ModbusSlave (address, busId, alias) VALUES (2, 1, 'temp');
+INSERT INTO ModbusSlave (address, busId, alias) VALUES (3, 1, 'tempK');
+INSERT INTO ModbusSlave (address, busId, alias) VALUES (4, 1, 'expansionTemp');
+INSERT INTO ModbusSlave (address, busId, alias) VALUES (5, 1, 'heaterTemp');
+INSERT INTO ModbusSlave (address, busId, alias) VALUES (6, 1, 'tankTemp');
+INSERT INTO ModbusSlave (address, busId, alias) VALUES (7, 1, 'tankWaterLevel');
+INSERT INTO ModbusSlave (address, busId, alias) VALUES (8, 1, 'steamPressure');
+INSERT INTO ModbusSlave (address, busId, alias) VALUES (9, 1, 'pressure');
+
 -- Bacteria
 drop table if exists Bacteria;
 create table Bacteria
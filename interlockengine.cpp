@@ -0,0 +1,138 @@
+#include "interlockengine.h"
+
+#include <QStringList>
+
+#include "busscheduler.h"
+#include "globalerrors.h"
+#include "logger.h"
+#include "relayimage.h"
+
+void InterlockEngine::setRules(const QList<Rule> &newRules)
+{
+    QMutexLocker locker(&mutex);
+    ruleList = newRules;
+
+    Logger::info(QString("Interlocks: %1 rules loaded").arg(ruleList.size()));
+}
+
+void InterlockEngine::evaluate(const SensorFrame &frame, quint32 pins)
+{
+    const qint64 nowNs = BusScheduler::nowNs();
+
+    QList<Rule> tripped;
+    QList<Rule> cleared;
+
+    {
+        QMutexLocker locker(&mutex);
+
+        for (auto &rule : ruleList) {
+            if (rule.pinId >= SensorFrame::PIN_COUNT || !(pins & (1u << rule.pinId)))
+                continue;
+
+            const double value = frame.value[rule.pinId];
+
+            if (!rule.tripped && rule.exceeds(value)) {
+                rule.tripped = true;
+                rule.trips++;
+                tripped.append(rule);
+            } else if (rule.tripped && rule.clears(value)) {
+                rule.tripped = false;
+                cleared.append(rule);
+            }
+        }
+    }
+
+    // Relays are switched without the lock, a dropped write reports back on this thread
+    for (const auto &rule : tripped) {
+        QStringList outputs;
+        for (const auto output : rule.outputs) {
+            outputs.append(QString::number(output));
+        }
+
+        Logger::crit(QString("Interlock '%1' tripped: pin %2 = %3 %4 %5, outputs %6 forced off")
+                         .arg(rule.alias)
+                         .arg(rule.pinId)
+                         .arg(frame.value[rule.pinId])
+                         .arg(rule.condition == Rule::Above ? ">" : "<")
+                         .arg(rule.limit)
+                         .arg(outputs.join(",")));
+
+        const auto alias = rule.alias;
+        RelayImage::instance().inhibit(rule.outputs, [this, alias, nowNs](bool ok) {
+            reacted(alias, nowNs, ok);
+        });
+    }
+
+    for (const auto &rule : cleared) {
+        Logger::warn(QString("Interlock '%1' cleared: pin %2 = %3").arg(rule.alias).arg(rule.pinId).arg(frame.value[rule.pinId]));
+        RelayImage::instance().release(rule.outputs);
+    }
+
+    if (!tripped.isEmpty() || !cleared.isEmpty()) {
+        updateError();
+    }
+}
+
+void InterlockEngine::reacted(const QString &alias, qint64 detectedAtNs, bool ok)
+{
+    const qint64 reactionUs = (BusScheduler::nowNs() - detectedAtNs) / 1000;
+
+    {
+        QMutexLocker locker(&mutex);
+        reaction.record(reactionUs);
+        if (reactionUs > REACTION_LIMIT_US)
+            slowReactionCount++;
+    }
+
+    if (!ok) {
+        Logger::crit(QString("Interlock '%1': outputs NOT switched off after %2 ms").arg(alias).arg(reactionUs / 1000.0, 0, 'f', 1));
+    } else if (reactionUs > REACTION_LIMIT_US) {
+        Logger::crit(QString("Interlock '%1': outputs off in %2 ms, over the %3 ms limit")
+                         .arg(alias)
+                         .arg(reactionUs / 1000.0, 0, 'f', 1)
+                         .arg(REACTION_LIMIT_US / 1000));
+    } else {
+        Logger::warn(QString("Interlock '%1': outputs off in %2 ms").arg(alias).arg(reactionUs / 1000.0, 0, 'f', 1));
+    }
+}
+
+void InterlockEngine::updateError()
+{
+    bool anyTripped = false;
+
+    {
+        QMutexLocker locker(&mutex);
+        for (const auto &rule : ruleList) {
+            anyTripped = anyTripped || rule.tripped;
+        }
+    }
+
+    if (anyTripped)
+        GlobalErrors::setError(GlobalErrors::InterlockError);
+    else
+        GlobalErrors::removeError(GlobalErrors::InterlockError);
+}
+
+QList<InterlockEngine::Rule> InterlockEngine::rules() const
+{
+    QMutexLocker locker(&mutex);
+    return ruleList;
+}
+
+LatencyHistogram InterlockEngine::reactionTime() const
+{
+    QMutexLocker locker(&mutex);
+    return reaction;
+}
+
+quint64 InterlockEngine::slowReactions() const
+{
+    QMutexLocker locker(&mutex);
+    return slowReactionCount;
+}
+
+InterlockEngine &InterlockEngine::instance()
+{
+    static InterlockEngine _instance;
+    return _instance;
+}
@@ -0,0 +1,72 @@
+#ifndef INTERLOCKENGINE_H
+#define INTERLOCKENGINE_H
+
+#include <QList>
+#include <QMutex>
+#include <QString>
+
+#include "latencyhistogram.h"
+#include "sensor.h"
+
+/**
+ * @brief Hardware interlocks evaluated on every fresh input value, independent of the state machine tick.
+ *
+ * Rules are checked on the I/O thread of the bus as soon as a scan read delivers their input pin. A
+ * tripped rule forces its outputs off at safety priority through RelayImage::inhibit() and holds them
+ * off until the input is back within the limit by the hysteresis. The reaction time, from the reply
+ * carrying the value until the relay write is acknowledged, is recorded for every trip.
+ */
+class InterlockEngine
+{
+public:
+    static constexpr qint64 REACTION_LIMIT_US = 100000;
+
+    struct Rule {
+        enum Condition {
+            Above, Below
+        };
+
+        int id = 0;
+        QString alias;
+        ushort pinId = 0;
+        Condition condition = Above;
+        double limit = 0;
+        double hysteresis = 0;
+        QList<ushort> outputs; // Output pins forced off while tripped
+
+        bool tripped = false;
+        quint64 trips = 0;
+
+        bool exceeds(double value) const { return condition == Above ? value > limit : value < limit; }
+        bool clears(double value) const { return condition == Above ? value <= limit - hysteresis : value >= limit + hysteresis; }
+    };
+
+    InterlockEngine(const InterlockEngine&) = delete;
+    InterlockEngine& operator=(const InterlockEngine &) = delete;
+
+    void setRules(const QList<Rule> &newRules);
+
+    /**
+     * @brief Checks the rules on the \p pins of \p frame that were just read. Safe to call from any thread.
+     */
+    void evaluate(const SensorFrame &frame, quint32 pins);
+
+    QList<Rule> rules() const;
+    LatencyHistogram reactionTime() const;
+    quint64 slowReactions() const;
+
+    static InterlockEngine &instance();
+
+private:
+    InterlockEngine() = default;
+
+    mutable QMutex mutex; // Evaluated from the I/O thread of every bus
+    QList<Rule> ruleList;
+    LatencyHistogram reaction;
+    quint64 slowReactionCount = 0;
+
+    void reacted(const QString &alias, qint64 detectedAtNs, bool ok);
+    void updateError();
+};
+
+#endif // INTERLOCKENGINE_H
@@ -0,0 +1,81 @@
+#include "latencyhistogram.h"
+
+#include <bit>
+
+int LatencyHistogram::bucketIndex(quint64 value)
+{
+    if (value < SUB_BUCKETS)
+        return static_cast<int>(value);
+
+    const int magnitude = qMin(static_cast<int>(std::bit_width(value)) - 1, MAX_MAGNITUDE);
+    const int shift = magnitude - SUB_BUCKET_BITS;
+    const int subBucket = static_cast<int>((value >> shift) & (SUB_BUCKETS - 1));
+
+    return SUB_BUCKETS + shift * SUB_BUCKETS + subBucket;
+}
+
+qint64 LatencyHistogram::bucketUpperBound(int index)
+{
+    if (index < SUB_BUCKETS)
+        return index;
+
+    const int shift = (index - SUB_BUCKETS) / SUB_BUCKETS;
+    const int subBucket = (index - SUB_BUCKETS) % SUB_BUCKETS;
+
+    return ((static_cast<qint64>(SUB_BUCKETS + subBucket) + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(qint64 valueUs)
+{
+    const quint64 value = static_cast<quint64>(qMax<qint64>(0, valueUs));
+
+    buckets[bucketIndex(value)]++;
+
+    if (total == 0 || static_cast<qint64>(value) < minValue)
+        minValue = static_cast<qint64>(value);
+    maxValue = qMax(maxValue, static_cast<qint64>(value));
+
+    sum += static_cast<qint64>(value);
+    total++;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other)
+{
+    if (other.total == 0)
+        return;
+
+    for (int i = 0; i < BUCKET_COUNT; i++) {
+        buckets[i] += other.buckets[i];
+    }
+
+    minValue = total ? qMin(minValue, other.minValue) : other.minValue;
+    maxValue = qMax(maxValue, other.maxValue);
+    sum += other.sum;
+    total += other.total;
+}
+
+void LatencyHistogram::reset()
+{
+    buckets.fill(0);
+    total = 0;
+    sum = 0;
+    minValue = 0;
+    maxValue = 0;
+}
+
+qint64 LatencyHistogram::valueAtPercentile(double percentile) const
+{
+    if (total == 0)
+        return 0;
+
+    const auto target = static_cast<quint64>(qBound(0.0, percentile, 100.0) / 100.0 * total + 0.5);
+    quint64 seen = 0;
+
+    for (int i = 0; i < BUCKET_COUNT; i++) {
+        seen += buckets[i];
+        if (seen >= qMax<quint64>(target, 1))
+            return qMin(bucketUpperBound(i), maxValue);
+    }
+
+    return maxValue;
+}
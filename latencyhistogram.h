@@ -0,0 +1,46 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <QtGlobal>
+#include <array>
+
+/**
+ * @brief Fixed size log-linear histogram of durations in microseconds (HDR histogram style).
+ *
+ * Values below 16 us are stored exactly, larger values in 16 sub-buckets per power of two, which
+ * keeps the relative error under 1/16 over the whole range. Recording never allocates.
+ */
+class LatencyHistogram
+{
+public:
+    void record(qint64 valueUs);
+    void merge(const LatencyHistogram &other);
+    void reset();
+
+    quint64 count() const { return total; }
+    qint64 min() const { return total ? minValue : 0; }
+    qint64 max() const { return maxValue; }
+    double mean() const { return total ? static_cast<double>(sum) / total : 0; }
+
+    /**
+     * @brief Highest value of the bucket containing the given percentile (0-100).
+     */
+    qint64 valueAtPercentile(double percentile) const;
+
+private:
+    static constexpr int SUB_BUCKET_BITS = 4;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static constexpr int MAX_MAGNITUDE = 40; // ~12 days in microseconds
+    static constexpr int BUCKET_COUNT = SUB_BUCKETS + (MAX_MAGNITUDE - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    std::array<quint64, BUCKET_COUNT> buckets{};
+    quint64 total = 0;
+    qint64 sum = 0;
+    qint64 minValue = 0;
+    qint64 maxValue = 0;
+
+    static int bucketIndex(quint64 value);
+    static qint64 bucketUpperBound(int index);
+};
+
+#endif // LATENCYHISTOGRAM_H
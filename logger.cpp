@@ -1,5 +1,7 @@
 #include "logger.h"
 
+#include <QMutex>
+
 Q_LOGGING_CATEGORY(logDebug,    "Debug")
 Q_LOGGING_CATEGORY(logInfo,     "Info")
 Q_LOGGING_CATEGORY(logWarning,  "Warning")
@@ -24,6 +26,10 @@ void Logger::messageHandler(QtMsgType type, const QMessageLogContext &context, c
 
     QTextStream out(m_logFile.get()); */
 
+    // Messages arrive from the main, Modbus I/O and gRPC threads
+    static QMutex mutex;
+    QMutexLocker locker(&mutex);
+
     QTextStream out(stdout);
     // Write the date of recording
     out << QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss.zzz ");
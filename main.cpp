@@ -1,6 +1,8 @@
 #include <QCoreApplication>
+#include <QCommandLineParser>
 
 #include "logger.h"
+#include "globals.h"
 #include "master.h"
 #include "grpcserver.h"
 
@@ -10,6 +12,23 @@ int main(int argc, char *argv[])
 
     qInstallMessageHandler(Logger::messageHandler);
 
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addOptions({
+        {"serial-port", "Modbus RTU serial port of the first bus, e.g. the pty created by AutoklavSimulator.", "name"},
+        {"database", "Directory containing db.sqlite.", "dir"},
+        {"capture", "Record the Modbus traffic to a file, one file per bus if there are several.", "file"},
+        {"replay", "Answer Modbus requests from a capture instead of the real buses.", "file"},
+        {"replay-fast", "Replay as fast as possible instead of at the recorded speed."},
+    });
+    parser.process(a);
+
+    Globals::serialPortName = parser.value("serial-port");
+    Globals::databaseDir = parser.value("database");
+    Globals::captureFile = parser.value("capture");
+    Globals::replayFile = parser.value("replay");
+    Globals::replayFast = parser.isSet("replay-fast");
+
     Master::instance();
 
     GRpcServer grpcServer;
@@ -1,26 +1,67 @@
 #include "master.h"
+
+#include <QCoreApplication>
+
 #include "logger.h"
 #include "dbmanager.h"
 #include "statemachine.h"
-#include "modbusrtu.h"
+#include "modbusbuses.h"
+#include "relayimage.h"
+#include "interlockengine.h"
+#include "filterengine.h"
+#include "calibrationengine.h"
+#include "changenotifier.h"
+#include "sensor.h"
+#include "scadaserver.h"
+#include "globals.h"
 
 Master::Master(QObject *parent)
     : QObject{parent}
 {
     auto &db = DbManager::instance();
+    db.upgradeSchema();
     db.loadGlobals();
     db.loadInputPins();
     db.loadOutputPins();
+    CalibrationEngine::instance().setCalibrations(db.loadCalibrations());
+    ChangeNotifier::instance().setDeadbands(db.loadDeadbands());
+
+    // Evaluated on the bus threads as soon as the values arrive
+    InterlockEngine::instance().setRules(db.loadInterlocks());
+    FilterEngine::instance().setStages(db.loadInputFilters());
+
+    // Initialize Modbus RTU and TCP buses, each runs on its own thread which has to be stopped before exit
+    auto &buses = ModbusBuses::instance();
+    const auto channels = db.loadInputChannels();
+    buses.setScanProfiles(db.loadScanProfiles());
+    buses.load(db.loadModbusBuses(), channels);
+    buses.connectAll();
 
-    //Modbus &modbusApp = Modbus::instance();
+    // SCADA reads are answered from the sensor and relay image, never from the buses
+    auto &scada = ScadaServer::instance();
+    scada.start(Globals::scadaPort, channels);
+    connect(&buses, &ModbusBuses::channelsChanged, this, [&scada](const QVector<ScanChannel> &channels) {
+        scada.setChannels(channels);
+    });
 
-    //modbusApp.connectToServer("172.16.0.2", 502);
+    connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this, [&buses, &scada]() {
+        scada.shutdown();
+        buses.shutdown();
+    });
 
-    // Initialize Modbus RTU
-    ModbusRTU &rtu = ModbusRTU::instance();
-    rtu.connectToDevice();
+    // Relays are read back periodically and rewritten if they don't match the requested state
+    QMap<ushort, bool> requestedRelays;
+    Sensor::outputPins.forEach([&requestedRelays](const Sensor &pin) {
+        requestedRelays.insert(pin.id, pin.value != 0);
+    });
+    RelayImage::instance().startReconciliation(requestedRelays);
 
-    StateMachine::instance();
+    // Poll periods follow the process, e.g. fast temperatures while sterilizing
+    auto &stateMachine = StateMachine::instance();
+    buses.applyScanProfile(stateMachine.getState());
+    connect(&stateMachine, &StateMachine::stateChanged, &buses, [&buses](StateMachine::State state) {
+        buses.applyScanProfile(state);
+    });
 
     Logger::info("Program started");
 }
@@ -0,0 +1,290 @@
+#include "modbusbuses.h"
+#include "modbusrtu.h"
+#include "modbustcp.h"
+#include "modbusreplay.h"
+#ifdef AUTOKLAV_NATIVE_RTU
+#include "modbusnativertu.h"
+#endif
+
+#include <QCoreApplication>
+#include <QFileInfo>
+
+#include "calibrationengine.h"
+#include "constants.h"
+#include "dbmanager.h"
+#include "globals.h"
+#include "globalerrors.h"
+#include "logger.h"
+
+ModbusBuses::ModbusBuses(QObject *parent)
+    : QObject{parent}
+{
+
+}
+
+ModbusBuses &ModbusBuses::instance()
+{
+    static ModbusBuses _instance;
+    return _instance;
+}
+
+void ModbusBuses::load(QList<ModbusMaster::BusConfig> configs, const QVector<ScanChannel> &channels)
+{
+    this->channels = channels;
+
+    if (configs.isEmpty()) {
+        ModbusMaster::BusConfig config;
+        config.id = 1;
+        config.name = "default";
+        config.portName = "COM7";
+        config.serialSettings = SerialSettings::fromGlobals();
+        config.turnaroundUs = Globals::modbusTurnaroundUs;
+
+        config.slaves.append(CONSTANTS::CWT_SLAVE_ID);
+        for (const auto &channel : channels) {
+            if (!config.slaves.contains(channel.slaveAddress)) {
+                config.slaves.append(channel.slaveAddress);
+            }
+        }
+
+        Logger::info("No Modbus buses configured, using a single bus for all slaves");
+        configs.append(config);
+    }
+
+    // The command line port is meant for running against a single simulator or adapter
+    if (!Globals::serialPortName.isEmpty()) {
+        Logger::info(QString("Bus '%1' port overridden from the command line: %2").arg(configs.first().name, Globals::serialPortName));
+        configs.first().portName = Globals::serialPortName;
+    }
+
+    // Each bus is replayed from its own capture, named like the files --capture writes
+    if (!Globals::replayFile.isEmpty()) {
+        for (auto &config : configs) {
+            config.type = ModbusMaster::BusConfig::Replay;
+            config.portName = busFileName(Globals::replayFile, config, configs.size());
+        }
+    }
+
+    for (const auto &config : configs) {
+        std::unique_ptr<ModbusMaster> bus;
+        if (config.type == ModbusMaster::BusConfig::Replay) {
+            auto replay = std::make_unique<ModbusReplay>(config, Globals::replayFast);
+            connect(replay.get(), &ModbusReplay::finished, this, &ModbusBuses::replayFinished);
+            runningReplays++;
+            bus = std::move(replay);
+        } else if (config.type == ModbusMaster::BusConfig::Tcp) {
+            bus = std::make_unique<ModbusTCP>(config);
+#ifdef AUTOKLAV_NATIVE_RTU
+        } else if (config.type == ModbusMaster::BusConfig::NativeRtu) {
+            bus = std::make_unique<ModbusNativeRTU>(config);
+#endif
+        } else {
+            if (config.type == ModbusMaster::BusConfig::NativeRtu) {
+                Logger::warn(QString("Bus '%1': built without AUTOKLAV_NATIVE_RTU, using the Qt RTU master").arg(config.name));
+            }
+            bus = std::make_unique<ModbusRTU>(config);
+        }
+
+        if (!Globals::captureFile.isEmpty() && config.type != ModbusMaster::BusConfig::Replay) {
+            bus->startCapture(busFileName(Globals::captureFile, config, configs.size()));
+        }
+
+        bus->setChannels(profileChannels());
+
+        for (const auto slaveAddress : config.slaves) {
+            if (slaveBus.contains(slaveAddress)) {
+                Logger::crit(QString("Slave %1 assigned to buses '%2' and '%3', using the first")
+                                 .arg(slaveAddress)
+                                 .arg(slaveBus[slaveAddress]->busConfig().name, config.name));
+                continue;
+            }
+            slaveBus.insert(slaveAddress, bus.get());
+        }
+
+        const int busId = config.id;
+        connect(bus.get(), &ModbusMaster::connectedChanged, this, [this]() {
+            updateConnectionError();
+        });
+        connect(bus.get(), &ModbusMaster::staleSlavesChanged, this, [this, busId](const QList<quint8> &slaves) {
+            staleSlaves[busId] = slaves;
+            updateStaleError();
+        });
+
+        Logger::info(QString("Modbus bus '%1' on %2 with %3 slaves").arg(config.name, config.portName).arg(config.slaves.size()));
+        busList.push_back(std::move(bus));
+    }
+
+    updateConnectionError();
+}
+
+bool ModbusBuses::updateChannel(const ScanChannel &channel)
+{
+    if (!Sensor::inputPins.contains(channel.pinId) || !channel.isValid()) {
+        Logger::crit(QString("Invalid channel for input pin %1").arg(channel.pinId));
+        return false;
+    }
+
+    auto &db = DbManager::instance();
+    if (!db.updateInputChannel(channel))
+        return false;
+
+    channels = db.loadInputChannels();
+    CalibrationEngine::instance().setCalibrations(db.loadCalibrations()); // The scale may have changed
+
+    if (!busForSlave(channel.slaveAddress)) {
+        Logger::warn(QString("Input pin %1 polls slave %2 which is on no bus").arg(channel.pinId).arg(channel.slaveAddress));
+    }
+
+    // Every bus recompiles, the channel may have moved to a slave on another bus
+    updateScanPlans();
+    emit channelsChanged(channels);
+    return true;
+}
+
+void ModbusBuses::applyScanProfile(int state)
+{
+    if (state == profileState)
+        return;
+
+    profileState = state;
+    Logger::info(QString("Applying scan profile of state %1").arg(state));
+    updateScanPlans();
+}
+
+QVector<ScanChannel> ModbusBuses::profileChannels() const
+{
+    QList<ScanProfile> profile;
+    for (const auto &entry : scanProfiles) {
+        if (entry.state == profileState) {
+            profile.append(entry);
+        }
+    }
+
+    return ScanPlan::applyProfile(channels, profile);
+}
+
+void ModbusBuses::updateScanPlans()
+{
+    const auto busChannels = profileChannels();
+    for (const auto &bus : busList) {
+        bus->setChannels(busChannels);
+    }
+}
+
+QString ModbusBuses::busFileName(const QString &fileName, const ModbusMaster::BusConfig &config, qsizetype busCount)
+{
+    if (busCount == 1) {
+        return fileName;
+    }
+
+    // capture.akcap -> capture-<bus>.akcap
+    const QFileInfo info(fileName);
+    const QString suffix = info.suffix().isEmpty() ? QString() : "." + info.suffix();
+    return info.path() + "/" + info.completeBaseName() + "-" + config.name + suffix;
+}
+
+void ModbusBuses::replayFinished(bool ok)
+{
+    replayFailed = replayFailed || !ok;
+
+    // The program ends with the last bus, non zero if a capture couldn't be replayed
+    if (--runningReplays == 0) {
+        QCoreApplication::exit(replayFailed ? 1 : 0);
+    }
+}
+
+void ModbusBuses::connectAll()
+{
+    for (const auto &bus : busList) {
+        bus->connectToDevice();
+    }
+}
+
+void ModbusBuses::shutdown()
+{
+    for (const auto &bus : busList) {
+        bus->shutdown();
+    }
+}
+
+QList<ModbusMaster *> ModbusBuses::buses() const
+{
+    QList<ModbusMaster *> list;
+    for (const auto &bus : busList) {
+        list.append(bus.get());
+    }
+    return list;
+}
+
+ModbusMaster *ModbusBuses::routeWrite(quint8 slaveAddress)
+{
+    auto bus = busForSlave(slaveAddress);
+    if (!bus) {
+        Logger::crit(QString("No Modbus bus configured for slave %1").arg(slaveAddress));
+        GlobalErrors::setError(GlobalErrors::ModbusWriteCoilError);
+    }
+    return bus;
+}
+
+void ModbusBuses::writeMultipleCoils(quint8 slaveAddress, quint16 startAddress, const QList<quint16> &values, const QString &description,
+                                     BusScheduler::Priority priority, std::function<void(bool)> done)
+{
+    if (auto bus = routeWrite(slaveAddress)) {
+        bus->writeMultipleCoils(slaveAddress, startAddress, values, description, priority, done);
+    } else if (done) {
+        done(false);
+    }
+}
+
+void ModbusBuses::readCoils(quint8 slaveAddress, quint16 startAddress, quint16 count,
+                            std::function<void(bool, const QList<quint16> &)> done)
+{
+    if (auto bus = busForSlave(slaveAddress)) {
+        bus->readCoils(slaveAddress, startAddress, count, done);
+    } else {
+        done(false, {});
+    }
+}
+
+void ModbusBuses::emergencyStop(quint8 slaveAddress, quint16 startAddress, const QList<quint16> &values,
+                                std::function<void(bool, const QList<quint16> &, qint64)> done)
+{
+    if (auto bus = routeWrite(slaveAddress)) {
+        bus->emergencyStop(slaveAddress, startAddress, values, done);
+    } else {
+        done(false, {}, 0);
+    }
+}
+
+void ModbusBuses::runAfter(quint8 slaveAddress, int delayMs, std::function<void()> f)
+{
+    if (auto bus = busForSlave(slaveAddress)) {
+        bus->runAfter(delayMs, f);
+    } else {
+        QTimer::singleShot(delayMs, Qt::PreciseTimer, this, f);
+    }
+}
+
+void ModbusBuses::updateConnectionError()
+{
+    for (const auto &bus : busList) {
+        if (!bus->isConnected()) {
+            GlobalErrors::setError(GlobalErrors::ModbusError);
+            return;
+        }
+    }
+
+    GlobalErrors::removeError(GlobalErrors::ModbusError);
+}
+
+void ModbusBuses::updateStaleError()
+{
+    for (const auto &slaves : staleSlaves) {
+        if (!slaves.isEmpty()) {
+            GlobalErrors::setError(GlobalErrors::SensorStaleError);
+            return;
+        }
+    }
+
+    GlobalErrors::removeError(GlobalErrors::SensorStaleError);
+}
@@ -0,0 +1,86 @@
+#ifndef MODBUSBUSES_H
+#define MODBUSBUSES_H
+
+#include <QObject>
+#include <QHash>
+#include <memory>
+#include <vector>
+
+#include "modbusmaster.h"
+
+/**
+ * @brief Registry of the Modbus buses, routes every request to the bus its slave is wired to.
+ *
+ * Each bus, RTU or TCP, has its own connection, scheduler and I/O thread, so scans on different buses run
+ * concurrently and the acquisition time is set by the slowest bus.
+ */
+class ModbusBuses : public QObject
+{
+    Q_OBJECT
+public:
+    static ModbusBuses &instance();
+
+    /**
+     * @brief Creates one master per configured bus, each polling the \p channels of its slaves.
+     * Without configuration a single bus is created from the serial settings in Globals, serving every slave.
+     */
+    void load(QList<ModbusMaster::BusConfig> configs, const QVector<ScanChannel> &channels);
+
+    /**
+     * @brief Stores the channel of an input pin and recompiles the scan plans, called on the main thread.
+     */
+    bool updateChannel(const ScanChannel &channel);
+
+    /**
+     * @brief Poll periods and priorities per state machine state, applied by applyScanProfile().
+     */
+    void setScanProfiles(const QList<ScanProfile> &profiles) { scanProfiles = profiles; }
+
+    /**
+     * @brief Recompiles the scan plans with the profile of \p state, channels without a profile
+     * entry keep the settings of their InputPin row.
+     */
+    void applyScanProfile(int state);
+    void connectAll();
+    void shutdown();
+
+    ModbusMaster *busForSlave(quint8 slaveAddress) const { return slaveBus.value(slaveAddress); }
+    QList<ModbusMaster *> buses() const;
+
+    void writeMultipleCoils(quint8 slaveAddress, quint16 startAddress, const QList<quint16> &values, const QString &description = "",
+                            BusScheduler::Priority priority = BusScheduler::Control, std::function<void(bool)> done = nullptr);
+    void readCoils(quint8 slaveAddress, quint16 startAddress, quint16 count,
+                   std::function<void(bool ok, const QList<quint16> &values)> done);
+    void emergencyStop(quint8 slaveAddress, quint16 startAddress, const QList<quint16> &values,
+                       std::function<void(bool written, const QList<quint16> &readBack, qint64 latencyUs)> done);
+
+    /**
+     * @brief Calls \p f after \p delayMs on the I/O thread of the bus of \p slaveAddress, see ModbusMaster::runAfter().
+     */
+    void runAfter(quint8 slaveAddress, int delayMs, std::function<void()> f);
+
+signals:
+    void channelsChanged(const QVector<ScanChannel> &channels);
+
+private:
+    explicit ModbusBuses(QObject *parent = nullptr);
+
+    std::vector<std::unique_ptr<ModbusMaster>> busList;
+    QHash<quint8, ModbusMaster *> slaveBus;
+    QHash<int, QList<quint8>> staleSlaves; // By bus id
+    QVector<ScanChannel> channels;
+    QList<ScanProfile> scanProfiles;
+    int profileState = -1; // No profile applied yet
+    int runningReplays = 0;
+    bool replayFailed = false;
+
+    ModbusMaster *routeWrite(quint8 slaveAddress);
+    QVector<ScanChannel> profileChannels() const;
+    void updateScanPlans();
+    void replayFinished(bool ok);
+    static QString busFileName(const QString &fileName, const ModbusMaster::BusConfig &config, qsizetype busCount);
+    void updateConnectionError();
+    void updateStaleError();
+};
+
+#endif // MODBUSBUSES_H
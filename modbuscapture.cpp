@@ -0,0 +1,108 @@
+#include "modbuscapture.h"
+
+#include <limits>
+
+#include "logger.h"
+
+ModbusCapture::~ModbusCapture()
+{
+    close();
+}
+
+bool ModbusCapture::open(const QString &fileName, const Header &header)
+{
+    file.setFileName(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        Logger::crit(QString("Unable to open capture file %1: %2").arg(fileName, file.errorString()));
+        return false;
+    }
+
+    stream.setDevice(&file);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream << MAGIC << VERSION << header.busId << header.scanIntervalMs << header.startMs;
+
+    clock.start();
+    lastRecordUs = 0;
+    lastFlushUs = 0;
+    records = 0;
+
+    Logger::info(QString("Capturing Modbus traffic of bus %1 to %2").arg(header.busId).arg(fileName));
+    return true;
+}
+
+void ModbusCapture::close()
+{
+    if (!file.isOpen())
+        return;
+
+    file.close();
+    Logger::info(QString("Capture %1 closed, %2 frames").arg(file.fileName()).arg(records));
+}
+
+void ModbusCapture::record(Direction direction, quint8 slaveAddress, const QByteArray &pdu)
+{
+    if (!file.isOpen())
+        return;
+
+    const qint64 nowUs = clock.nsecsElapsed() / 1000;
+    const auto deltaUs = static_cast<quint32>(qMin<qint64>(nowUs - lastRecordUs, std::numeric_limits<quint32>::max()));
+    lastRecordUs = nowUs;
+
+    const auto length = static_cast<quint8>(qMin<qsizetype>(pdu.size(), 255));
+
+    stream << deltaUs << static_cast<quint8>(direction) << slaveAddress << length;
+    stream.writeRawData(pdu.constData(), length);
+    records++;
+
+    // Keep what was captured so far on disk in case the process dies during an incident
+    if (nowUs - lastFlushUs >= FLUSH_INTERVAL_US) {
+        file.flush();
+        lastFlushUs = nowUs;
+    }
+}
+
+bool ModbusCapture::load(const QString &fileName, Header &header, QList<Record> &records)
+{
+    QFile input(fileName);
+    if (!input.open(QIODevice::ReadOnly)) {
+        Logger::crit(QString("Unable to open capture file %1: %2").arg(fileName, input.errorString()));
+        return false;
+    }
+
+    QDataStream in(&input);
+    in.setByteOrder(QDataStream::LittleEndian);
+
+    quint32 magic = 0;
+    quint16 version = 0;
+    in >> magic >> version;
+
+    if (magic != MAGIC) {
+        Logger::crit(QString("%1 is not a Modbus capture").arg(fileName));
+        return false;
+    }
+
+    if (version != VERSION) {
+        Logger::crit(QString("Capture %1 has version %2, expected %3").arg(fileName).arg(version).arg(VERSION));
+        return false;
+    }
+
+    in >> header.busId >> header.scanIntervalMs >> header.startMs;
+
+    qint64 timeUs = 0;
+    while (!in.atEnd()) {
+        quint32 deltaUs;
+        quint8 direction, slaveAddress, length;
+        in >> deltaUs >> direction >> slaveAddress >> length;
+
+        QByteArray pdu(length, Qt::Uninitialized);
+        if (in.readRawData(pdu.data(), length) != length || in.status() != QDataStream::Ok) {
+            Logger::warn(QString("Capture %1 truncated after %2 frames").arg(fileName).arg(records.size()));
+            break;
+        }
+
+        timeUs += deltaUs;
+        records.append({timeUs, static_cast<Direction>(direction), slaveAddress, pdu});
+    }
+
+    return true;
+}
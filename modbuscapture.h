@@ -0,0 +1,65 @@
+#ifndef MODBUSCAPTURE_H
+#define MODBUSCAPTURE_H
+
+#include <QFile>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QList>
+
+/**
+ * @brief Compact binary recording of the Modbus traffic of one bus.
+ *
+ * File layout, little endian:
+ *   header: "AKMC", quint16 version, quint16 bus id, quint32 scan interval (ms), qint64 start (ms since epoch)
+ *   record: quint32 time since the previous record (us), quint8 direction, quint8 slave, quint8 length, PDU
+ *
+ * Times come from a monotonic clock. The PDU starts with the function code, a response without a
+ * valid PDU (timeout, CRC error) is recorded with length 0.
+ */
+class ModbusCapture
+{
+public:
+    enum Direction : quint8 {
+        Request, Response
+    };
+
+    struct Header {
+        quint16 busId = 0;
+        quint32 scanIntervalMs = 0;
+        qint64 startMs = 0;
+    };
+
+    struct Record {
+        qint64 timeUs;  // Since the start of the capture
+        Direction direction;
+        quint8 slaveAddress;
+        QByteArray pdu;
+
+        quint8 functionCode() const { return pdu.isEmpty() ? 0 : static_cast<quint8>(pdu[0]); }
+    };
+
+    ~ModbusCapture();
+
+    bool open(const QString &fileName, const Header &header);
+    void close();
+    bool isOpen() const { return file.isOpen(); }
+
+    void record(Direction direction, quint8 slaveAddress, const QByteArray &pdu);
+    quint64 recordCount() const { return records; }
+
+    static bool load(const QString &fileName, Header &header, QList<Record> &records);
+
+private:
+    QFile file;
+    QDataStream stream;
+    QElapsedTimer clock;
+    qint64 lastRecordUs = 0;
+    qint64 lastFlushUs = 0;
+    quint64 records = 0;
+
+    static constexpr quint32 MAGIC = 0x434D4B41; // "AKMC" read as little endian
+    static constexpr quint16 VERSION = 1;
+    static constexpr qint64 FLUSH_INTERVAL_US = 1000000;
+};
+
+#endif // MODBUSCAPTURE_H
@@ -0,0 +1,50 @@
+#ifndef MODBUSCRC_H
+#define MODBUSCRC_H
+
+#include <QtGlobal>
+#include <array>
+
+/**
+ * @brief Table driven CRC-16/MODBUS (polynomial 0xA001 reflected, initial value 0xFFFF).
+ *
+ * The CRC is appended to RTU frames low byte first.
+ */
+namespace ModbusCrc {
+    constexpr std::array<quint16, 256> makeTable()
+    {
+        std::array<quint16, 256> table{};
+        for (int i = 0; i < 256; i++) {
+            quint16 crc = static_cast<quint16>(i);
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc & 1) ? static_cast<quint16>((crc >> 1) ^ 0xA001) : static_cast<quint16>(crc >> 1);
+            }
+            table[i] = crc;
+        }
+        return table;
+    }
+
+    inline constexpr std::array<quint16, 256> TABLE = makeTable();
+
+    constexpr quint16 compute(const quint8 *data, qsizetype size)
+    {
+        quint16 crc = 0xFFFF;
+        for (qsizetype i = 0; i < size; i++) {
+            crc = static_cast<quint16>((crc >> 8) ^ TABLE[(crc ^ data[i]) & 0xFF]);
+        }
+        return crc;
+    }
+
+    /**
+     * @brief Checks the trailing two CRC bytes of a complete RTU frame.
+     */
+    constexpr bool isValid(const quint8 *frame, qsizetype size)
+    {
+        if (size < 4)
+            return false;
+
+        const quint16 expected = static_cast<quint16>(frame[size - 2] | (frame[size - 1] << 8));
+        return compute(frame, size - 2) == expected;
+    }
+}
+
+#endif // MODBUSCRC_H
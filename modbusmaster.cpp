@@ -0,0 +1,625 @@
+#include "modbusmaster.h"
+#include <QStringList>
+#include <QCoreApplication>
+#include <QDateTime>
+#include "constants.h"
+#include "logger.h"
+#include "globalerrors.h"
+#include "globals.h"
+#include "calibrationengine.h"
+#include "interlockengine.h"
+
+static QString coilValuesString(const QList<quint16> &values)
+{
+    QStringList states;
+    for (const auto value : values) {
+        states.append(value ? "ON" : "OFF");
+    }
+    return states.join(",");
+}
+
+ModbusMaster::ModbusMaster(const BusConfig &config, const QString &transportName, QObject *parent)
+    : QObject{parent}, config(config), transportName(transportName)
+{
+    // Set up periodic reading with sequential processing
+    readTimer.setInterval(config.scanIntervalMs);
+    readTimer.setTimerType(Qt::PreciseTimer);
+    connect(&readTimer, &QTimer::timeout, this, &ModbusMaster::startSequentialReading);
+
+    // Periodic dump of the request statistics
+    statsTimer.setInterval(Globals::modbusStatsDumpTick);
+    connect(&statsTimer, &QTimer::timeout, this, &ModbusMaster::dumpStats);
+    statsTimer.start();
+    dumpTimer.start();
+}
+
+ModbusMaster::~ModbusMaster()
+{
+    ioThread.quit();
+    ioThread.wait();
+}
+
+void ModbusMaster::startIoThread()
+{
+    // All bus traffic runs on a dedicated thread so a busy main event loop can never delay polling.
+    // The connection is opened by connectToDevice() once the thread is running.
+    ioThread.setObjectName(QString("Modbus%1 %2").arg(transportName, config.name));
+    moveToThread(&ioThread);
+    ioThread.start(QThread::HighPriority);
+}
+
+void ModbusMaster::shutdown()
+{
+    if (!ioThread.isRunning())
+        return;
+
+    // Close the connection from its own thread, then hand the object back so it is destroyed on the main thread
+    QMetaObject::invokeMethod(this, [this]() {
+        disconnectDevice();
+        statsTimer.stop();
+        capture.reset();
+        moveToThread(QCoreApplication::instance()->thread());
+    }, Qt::BlockingQueuedConnection);
+
+    ioThread.quit();
+    ioThread.wait();
+
+    Logger::info(QString("Modbus %1 bus '%2' I/O thread stopped").arg(transportName, config.name));
+}
+
+void ModbusMaster::startCapture(const QString &fileName)
+{
+    if (postToIoThread([=, this]() { startCapture(fileName); })) {
+        return;
+    }
+
+    ModbusCapture::Header header;
+    header.busId = static_cast<quint16>(config.id);
+    header.scanIntervalMs = static_cast<quint32>(config.scanIntervalMs);
+    header.startMs = QDateTime::currentMSecsSinceEpoch();
+
+    auto newCapture = std::make_unique<ModbusCapture>();
+    if (newCapture->open(fileName, header)) {
+        capture = std::move(newCapture);
+    }
+}
+
+bool ModbusMaster::queueRequest(BusScheduler::Priority priority, ModbusRequest request)
+{
+    const auto slaveAddress = request.slaveAddress;
+    const auto registerType = request.registerType;
+
+    const auto errorCallback = request.errorCallback;
+
+    ModbusRequest evicted;
+    switch (scheduler.enqueue(priority, std::move(request), BusScheduler::nowNs(), &evicted)) {
+    case BusScheduler::Rejected:
+        Logger::info(QString("Request queue '%1' full of writes - discarding request").arg(BusScheduler::priorityName(priority)));
+        modbusStats.recordDrop(slaveAddress, registerType);
+        if (errorCallback) {
+            errorCallback(QModbusDevice::ReplyAbortedError, slaveAddress);
+        }
+        return false;
+    case BusScheduler::Evicted:
+        Logger::debug(QString("Request queue '%1' full - evicted %2 to slave %3")
+                          .arg(BusScheduler::priorityName(priority), evicted.description)
+                          .arg(evicted.slaveAddress));
+        modbusStats.recordDrop(evicted.slaveAddress, evicted.registerType);
+        abandonRequest(evicted);
+        break;
+    case BusScheduler::Queued:
+    case BusScheduler::Coalesced:
+        break;
+    }
+
+    dispatch();
+    return true;
+}
+
+void ModbusMaster::completeRequest(const ModbusRequest &request, BusScheduler::Priority priority, QModbusDevice::Error error,
+                                   const QModbusDataUnit &result, const QString &errorString)
+{
+    updateHealth(request, error);
+    transactions++;
+
+    if (error == QModbusDevice::NoError) {
+        modbusStats.recordReply(request.slaveAddress, request.registerType,
+                                request.enqueuedAtNs, request.sentAtNs, BusScheduler::nowNs());
+
+        if (request.operation == ModbusRequest::Write) {
+            Logger::info(QString("Successfully wrote coil - Slave:%1 Coil:%2 Value:%3")
+                             .arg(request.slaveAddress)
+                             .arg(request.startAddress)
+                             .arg(coilValuesString(request.values)));
+        } else if (request.scanBlock >= 0) {
+            applyScanBlock(scanPlan.block(request.scanBlock), result);
+        }
+
+        if (request.callback) {
+            request.callback(result, request.slaveAddress);
+        }
+    } else if (request.operation == ModbusRequest::Write) {
+        modbusStats.recordError(request.slaveAddress, request.registerType, error);
+        Logger::crit(QString("Write coil error - Slave:%1 Coil:%2 Value:%3 - %4")
+                         .arg(request.slaveAddress)
+                         .arg(request.startAddress)
+                         .arg(coilValuesString(request.values))
+                         .arg(errorString));
+
+        // Outputs must not silently stay in the wrong state, retry the write. Unless an emergency
+        // stop of the slave was issued since, the retry could switch an output back on.
+        const bool superseded = priority != BusScheduler::Safety
+                                && request.enqueuedAtNs < emergencyStopAtNs.value(request.slaveAddress, 0);
+
+        if (request.attempts < MAX_RETRIES && !superseded) {
+            modbusStats.recordRetry(request.slaveAddress, request.registerType);
+            queueRequest(priority, request);
+        } else {
+            GlobalErrors::setError(GlobalErrors::ModbusWriteCoilError);
+            if (request.errorCallback) {
+                request.errorCallback(error, request.slaveAddress);
+            }
+        }
+    } else {
+        modbusStats.recordError(request.slaveAddress, request.registerType, error);
+        // Logger::info(QString("Request failed: %1 - Error: %2")
+        //                     .arg(request.description)
+        //                     .arg(errorString));
+
+        if (request.errorCallback) {
+            request.errorCallback(error, request.slaveAddress);
+        }
+    }
+
+    finishScanRead(request);
+}
+
+void ModbusMaster::abandonRequest(const ModbusRequest &request)
+{
+    // Only scan reads probe an open breaker, see startSequentialReading()
+    if (request.scanBlock >= 0) {
+        health.probeAborted(request.slaveAddress);
+    }
+
+    if (request.errorCallback) {
+        request.errorCallback(QModbusDevice::ReplyAbortedError, request.slaveAddress);
+    }
+
+    finishScanRead(request);
+}
+
+void ModbusMaster::finishScanRead(const ModbusRequest &request)
+{
+    if (request.scanBlock < 0 || scanBlocksPending == 0 || --scanBlocksPending > 0) {
+        return;
+    }
+
+    lastScanCycleUs = scanCycleTimer.nsecsElapsed() / 1000;
+    publishFrame();
+
+    Logger::debug(QString("Scan cycle finished: %1 reads in %2 ms")
+                      .arg(scanPlan.size())
+                      .arg(lastScanCycleUs / 1000.0, 0, 'f', 1));
+
+    scanCycleFinished();
+}
+
+void ModbusMaster::setConnected(bool isNowConnected)
+{
+    if (connected.exchange(isNowConnected) != isNowConnected) {
+        emit connectedChanged(isNowConnected);
+    }
+}
+
+void ModbusMaster::resetRequests()
+{
+    // Whoever waits for a queued request is told it will never be sent
+    for (const auto &request : scheduler.takeAll()) {
+        abandonRequest(request);
+    }
+
+    // Nothing is in flight any more, a probe the transport lost on the way must not keep a slave half-open
+    health.abortProbes();
+    scanBlocksPending = 0;
+}
+
+void ModbusMaster::updateHealth(const ModbusRequest &request, QModbusDevice::Error error)
+{
+    // Broadcasts are never answered
+    if (request.slaveAddress == 0) {
+        return;
+    }
+
+    const auto now = BusScheduler::nowNs();
+    const auto previousState = health.state(request.slaveAddress);
+
+    // An exception response still proves the slave is alive
+    if (error == QModbusDevice::NoError || error == QModbusDevice::ProtocolError) {
+        health.recordSuccess(request.slaveAddress, (now - request.sentAtNs) / 1000, now);
+    } else {
+        health.recordFailure(request.slaveAddress, now);
+    }
+
+    const auto &slave = health.slaves()[request.slaveAddress];
+    if (slave.state == previousState) {
+        return;
+    }
+
+    if (slave.state == SlaveHealth::Closed) {
+        Logger::info(QString("Slave %1 responding again, resuming normal polling").arg(request.slaveAddress));
+    } else if (slave.state == SlaveHealth::Open) {
+        Logger::crit(QString("Slave %1 not responding, next probe in %2 ms")
+                         .arg(request.slaveAddress)
+                         .arg((slave.probeAtNs - now) / 1000000));
+    }
+}
+
+void ModbusMaster::updateStaleness(qint64 nowNs)
+{
+    QList<quint8> stale;
+
+    for (const auto &block : scanPlan.blocks()) {
+        // Slow blocks are allowed to be as old as two of their poll periods
+        const qint64 maxAgeMs = qMax<qint64>(Globals::serialDataOldTime, 2LL * block.everyCycles * scanPlan.tickMs());
+        const qint64 maxAgeNs = maxAgeMs * 1000000;
+
+        if (!stale.contains(block.slaveAddress) && health.isStale(block.slaveAddress, nowNs, maxAgeNs)) {
+            stale.append(block.slaveAddress);
+        }
+    }
+
+    if (stale == staleSlaves) {
+        return;
+    }
+
+    staleSlaves = stale;
+
+    if (!staleSlaves.isEmpty()) {
+        QStringList addresses;
+        for (const auto slaveAddress : staleSlaves) {
+            addresses.append(QString::number(slaveAddress));
+        }
+
+        Logger::crit(QString("Stale data from slaves: %1").arg(addresses.join(",")));
+    }
+
+    // The error flag is shared by all buses, ModbusBuses combines them
+    emit staleSlavesChanged(staleSlaves);
+}
+
+ModbusMaster::StatsSnapshot ModbusMaster::statsSnapshot() const
+{
+    if (QThread::currentThread() != thread()) {
+        StatsSnapshot snapshot;
+        QMetaObject::invokeMethod(const_cast<ModbusMaster *>(this), [this]() {
+            return statsSnapshot();
+        }, Qt::BlockingQueuedConnection, &snapshot);
+        return snapshot;
+    }
+
+    StatsSnapshot snapshot{modbusStats, health, {}, lastScanCycleUs, scanOverruns, framesPerSecond, scanJitter};
+    for (int i = 0; i < BusScheduler::PriorityCount; i++) {
+        snapshot.scheduler[i] = scheduler.stats(static_cast<BusScheduler::Priority>(i));
+    }
+    return snapshot;
+}
+
+void ModbusMaster::dumpStats()
+{
+    const auto wireTimeUs = scanWireTimeUs();
+
+    const auto elapsedMs = dumpTimer.restart();
+    framesPerSecond = elapsedMs > 0 ? (transactions - transactionsAtDump) * 1000.0 / elapsedMs : 0;
+    transactionsAtDump = transactions;
+
+    Logger::info(QString("Modbus %1 bus '%2' stats: scan cycle %3 ms%4, %5 overruns, %6 frames/s, scan start jitter p50/p99/max=%7/%8/%9us")
+                     .arg(transportName, config.name)
+                     .arg(lastScanCycleUs / 1000.0, 0, 'f', 1)
+                     .arg(wireTimeUs ? QString(" (wire time %1 ms)").arg(wireTimeUs / 1000.0, 0, 'f', 1) : QString())
+                     .arg(scanOverruns)
+                     .arg(framesPerSecond, 0, 'f', 1)
+                     .arg(scanJitter.valueAtPercentile(50))
+                     .arg(scanJitter.valueAtPercentile(99))
+                     .arg(scanJitter.max()));
+
+    for (int i = 0; i < BusScheduler::PriorityCount; i++) {
+        const auto priority = static_cast<BusScheduler::Priority>(i);
+        const auto classStats = scheduler.stats(priority);
+        Logger::info(QString("Queue %1: depth=%2/%3 dispatched=%4 dropped=%5 coalesced=%6 promoted=%7 wait avg/max=%8/%9us")
+                         .arg(BusScheduler::priorityName(priority))
+                         .arg(classStats.depth)
+                         .arg(classStats.capacity)
+                         .arg(classStats.dispatched)
+                         .arg(classStats.dropped)
+                         .arg(classStats.coalesced)
+                         .arg(classStats.promoted)
+                         .arg(classStats.averageWaitNs() / 1000)
+                         .arg(classStats.maxWaitNs / 1000));
+    }
+
+    for (const auto &line : modbusStats.summary()) {
+        Logger::info(line);
+    }
+
+    for (auto it = health.slaves().cbegin(); it != health.slaves().cend(); ++it) {
+        Logger::info(QString("Slave:%1 breaker=%2 timeout=%3ms ok=%4 failed=%5")
+                         .arg(it.key())
+                         .arg(SlaveHealth::stateName(it->state))
+                         .arg(health.timeoutMs(it.key()))
+                         .arg(it->successes)
+                         .arg(it->failures));
+    }
+}
+
+void ModbusMaster::setChannels(const QVector<ScanChannel> &channels)
+{
+    if (postToIoThread([this, channels]() { setChannels(channels); })) {
+        return;
+    }
+
+    QVector<ScanChannel> busChannels;
+    for (const auto &channel : channels) {
+        if (servesSlave(channel.slaveAddress)) {
+            busChannels.append(channel);
+        }
+    }
+
+    ScanPlan plan;
+    plan.compile(busChannels, config.scanIntervalMs);
+
+    Logger::info(QString("Modbus %1 bus '%2' scan plan compiled: %3 channels in %4 reads, scan cycle %5 ms")
+                     .arg(transportName, config.name)
+                     .arg(busChannels.size())
+                     .arg(plan.size())
+                     .arg(plan.tickMs()));
+
+    // Outstanding scan reads refer to blocks of the current plan
+    if (scanBlocksPending > 0) {
+        nextPlan = std::move(plan);
+        return;
+    }
+
+    installPlan(std::move(plan));
+    nextPlan.reset();
+}
+
+void ModbusMaster::installPlan(ScanPlan plan)
+{
+    scanPlan = std::move(plan);
+    scanCycle = 0;
+
+    if (readTimer.interval() != scanPlan.tickMs()) {
+        readTimer.setInterval(scanPlan.tickMs());
+    }
+}
+
+void ModbusMaster::startSequentialReading()
+{
+    // Don't start a scan if we're not connected
+    if (!isConnected()) {
+        lastScanStartNs = 0;
+        return;
+    }
+
+    const auto startNs = BusScheduler::nowNs();
+    if (lastScanStartNs > 0) {
+        scanJitter.record(qAbs((startNs - lastScanStartNs) / 1000 - readTimer.interval() * 1000LL));
+    }
+    lastScanStartNs = startNs;
+
+    // Previous cycle has not finished yet, the bus is saturated
+    if (scanBlocksPending > 0) {
+        scanOverruns++;
+        Logger::debug(QString("Scan cycle overrun (%1 total)").arg(scanOverruns));
+        return;
+    }
+
+    if (nextPlan) {
+        installPlan(std::move(*nextPlan));
+        nextPlan.reset();
+    }
+
+    scanCycleTimer.start();
+
+    const auto now = BusScheduler::nowNs();
+    updateStaleness(now);
+
+    for (int i = 0; i < scanPlan.size(); i++) {
+        const ScanBlock &block = scanPlan.block(i);
+
+        // Failing slaves are skipped until their next probe so they don't eat the cycle of the others
+        health.track(block.slaveAddress, now);
+
+        // Slow blocks are staggered so they don't all land on the same cycle
+        if ((scanCycle + i) % block.everyCycles != 0) {
+            continue;
+        }
+
+        if (!health.allowRequest(block.slaveAddress, now)) {
+            continue;
+        }
+
+        ModbusRequest request{block.slaveAddress, block.registerType, block.startAddress, block.count, {}, {}};
+        request.scanBlock = i;
+
+        // Counted before queueing, a pipelined transport may already send it from queueRequest()
+        scanBlocksPending++;
+        if (!queueRequest(block.priority, std::move(request))) {
+            scanBlocksPending--;
+            health.probeAborted(block.slaveAddress);
+        }
+    }
+
+    scanCycle++;
+}
+
+void ModbusMaster::applyScanBlock(const ScanBlock &block, const QModbusDataUnit &unit)
+{
+    quint32 pins = 0;
+
+    for (int i = block.firstChannel; i < block.firstChannel + block.channelCount; i++) {
+        const ScanChannel &channel = scanPlan.channel(i);
+        const int offset = channel.address - unit.startAddress();
+
+        if (offset < 0 || offset + channel.count > unit.valueCount()) {
+            continue;
+        }
+
+        if (!Sensor::inputPins.contains(channel.pinId)) {
+            Logger::info(QString("Sensor not found for %1 (pin %2)").arg(channel.description).arg(channel.pinId));
+            continue;
+        }
+
+        quint16 pinValue;
+        const double raw = channel.decode(unit, offset, pinValue);
+        storeValue(channel.pinId, pinValue, raw);
+
+        if (channel.pinId < SensorFrame::PIN_COUNT) {
+            pins |= 1u << channel.pinId;
+        }
+    }
+
+    // Interlocks react to the fresh values right away, not at the end of the scan cycle
+    if (pins) {
+        CalibrationEngine::instance().apply(frame, pins);
+        InterlockEngine::instance().evaluate(frame, pins);
+    }
+}
+
+void ModbusMaster::storeValue(ushort pinId, quint16 pinValue, double raw)
+{
+    if (pinId >= SensorFrame::PIN_COUNT) {
+        return;
+    }
+
+    // Calibrated for the whole block in applyScanBlock()
+    frame.pinValue[pinId] = pinValue;
+    frame.raw[pinId] = raw;
+    frame.timestampMs = QDateTime::currentMSecsSinceEpoch();
+    updatedPins |= 1u << pinId;
+}
+
+void ModbusMaster::publishFrame()
+{
+    if (!updatedPins) {
+        return;
+    }
+
+    // Only the pins read on this bus, the others belong to other buses
+    Sensor::publishFrame(frame, updatedPins);
+    updatedPins = 0;
+}
+
+void ModbusMaster::writeMultipleCoils(quint8 slaveAddress, quint16 startAddress, const QList<quint16> &values, const QString &description,
+                                      BusScheduler::Priority priority, std::function<void(bool)> done)
+{
+    if (postToIoThread([=, this]() { writeMultipleCoils(slaveAddress, startAddress, values, description, priority, done); })) {
+        return;
+    }
+
+    if (!isConnected()) {
+        Logger::crit(QString("Modbus %1 bus '%2' not connected. Cannot write to coils.").arg(transportName, config.name));
+        if (done) {
+            done(false);
+        }
+        return;
+    }
+
+    if (values.isEmpty()) {
+        return;
+    }
+
+    // A single value goes out as FC05, more as FC15
+    ModbusRequest request{slaveAddress, QModbusDataUnit::Coils, startAddress, static_cast<quint16>(values.size()), {},
+                          description.isEmpty() ? "Write Coils" : description};
+    request.operation = ModbusRequest::Write;
+    request.values = values;
+
+    if (done) {
+        request.callback = [done](const QModbusDataUnit &, quint8) { done(true); };
+        request.errorCallback = [done](QModbusDevice::Error, quint8) { done(false); };
+    }
+
+    queueRequest(priority, std::move(request));
+}
+
+void ModbusMaster::emergencyStop(quint8 slaveAddress, quint16 startAddress, const QList<quint16> &values,
+                                 std::function<void(bool, const QList<quint16> &, qint64)> done, qint64 requestedAtNs)
+{
+    if (postToIoThread([=, this]() { emergencyStop(slaveAddress, startAddress, values, done, requestedAtNs); })) {
+        return;
+    }
+
+    const auto latencyUs = [requestedAtNs]() {
+        return (BusScheduler::nowNs() - requestedAtNs) / 1000;
+    };
+
+    emergencyStopAtNs[slaveAddress] = BusScheduler::nowNs();
+
+    // Reads only delay the stop and older writes to the slave could undo it
+    const auto dropped = scheduler.takeIf([slaveAddress](const ModbusRequest &request) {
+        return request.operation == ModbusRequest::Read || request.slaveAddress == slaveAddress;
+    });
+
+    Logger::warn(QString("Modbus %1 bus '%2' emergency stop of slave %3, %4 pending requests dropped")
+                     .arg(transportName, config.name)
+                     .arg(slaveAddress)
+                     .arg(dropped.size()));
+
+    for (const auto &request : dropped) {
+        abandonRequest(request);
+    }
+
+    if (!isConnected() || values.isEmpty()) {
+        done(false, {}, latencyUs());
+        return;
+    }
+
+    const auto count = static_cast<quint16>(values.size());
+
+    ModbusRequest request{slaveAddress, QModbusDataUnit::Coils, startAddress, count, {}, "Emergency stop"};
+    request.operation = ModbusRequest::Write;
+    request.values = values;
+
+    request.callback = [=, this](const QModbusDataUnit &, quint8) {
+        readCoils(slaveAddress, startAddress, count, [done, latencyUs](bool ok, const QList<quint16> &readBack) {
+            done(true, ok ? readBack : QList<quint16>(), latencyUs());
+        }, BusScheduler::Safety);
+    };
+    request.errorCallback = [done, latencyUs](QModbusDevice::Error, quint8) {
+        done(false, {}, latencyUs());
+    };
+
+    queueRequest(BusScheduler::Safety, std::move(request));
+}
+
+void ModbusMaster::runAfter(int delayMs, std::function<void()> f, qint64 requestedAtNs)
+{
+    if (postToIoThread([=, this]() { runAfter(delayMs, f, requestedAtNs); })) {
+        return;
+    }
+
+    // The hand over to the I/O thread is not part of the delay
+    const auto elapsedMs = (BusScheduler::nowNs() - requestedAtNs) / 1000000;
+    QTimer::singleShot(qMax<qint64>(0, delayMs - elapsedMs), Qt::PreciseTimer, this, f);
+}
+
+void ModbusMaster::readCoils(quint8 slaveAddress, quint16 startAddress, quint16 count,
+                             std::function<void(bool, const QList<quint16> &)> done, BusScheduler::Priority priority)
+{
+    if (postToIoThread([=, this]() { readCoils(slaveAddress, startAddress, count, done, priority); })) {
+        return;
+    }
+
+    if (!isConnected()) {
+        done(false, {});
+        return;
+    }
+
+    ModbusRequest request{slaveAddress, QModbusDataUnit::Coils, startAddress, count,
+                          [done](const QModbusDataUnit &unit, quint8) { done(true, unit.values()); },
+                          "Read Coils"};
+    request.errorCallback = [done](QModbusDevice::Error, quint8) { done(false, {}); };
+
+    queueRequest(priority, std::move(request));
+}
@@ -0,0 +1,240 @@
+#ifndef MODBUSMASTER_H
+#define MODBUSMASTER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QThread>
+#include <atomic>
+#include <memory>
+#include <optional>
+
+#include "scanplan.h"
+#include "busscheduler.h"
+#include "modbusstats.h"
+#include "slavehealth.h"
+#include "serialsettings.h"
+#include "sensor.h"
+#include "modbuscapture.h"
+
+/**
+ * @brief Transport independent part of a Modbus master of one bus, running on its own I/O thread.
+ *
+ * Owns the scan plan, the request scheduler, the statistics and the slave health, and turns read
+ * replies into SensorFrame updates. Transports only send what the scheduler hands out and report
+ * every finished request through completeRequest().
+ *
+ * Public methods may be called from any thread, requests are handed over to the I/O thread.
+ * Instances are created and owned by ModbusBuses, one per configured bus.
+ */
+class ModbusMaster : public QObject
+{
+    Q_OBJECT
+public:
+    struct BusConfig {
+        enum Type {
+            Rtu, NativeRtu, Tcp, Replay
+        };
+
+        int id = 0;
+        Type type = Rtu;
+        QString name;
+        QString portName;                     // Serial port, host:port for TCP, capture file for replay
+        SerialSettings serialSettings;
+        int turnaroundUs = 0;
+        int scanIntervalMs = 1000;
+        int maxInFlight = 1;                  // Outstanding transactions, TCP only
+        QList<quint8> slaves;                 // Slave addresses wired to this bus
+        QHash<quint8, int> slaveTurnaroundUs; // Per slave turnaround, overrides turnaroundUs
+    };
+
+    struct StatsSnapshot {
+        ModbusStats requests;
+        SlaveHealth health;
+        std::array<BusScheduler::ClassStats, BusScheduler::PriorityCount> scheduler;
+        qint64 scanCycleTimeUs;
+        quint64 scanOverruns;
+        double framesPerSecond = 0;   // Completed transactions over the last stats interval
+        LatencyHistogram scanJitter;  // Deviation of the scan cycle starts from the scan tick
+    };
+
+    ~ModbusMaster() override;
+
+    virtual void connectToDevice() = 0;
+    virtual void disconnectDevice() = 0;
+
+    /**
+     * @brief Closes the connection and stops the I/O thread, called before the application exits.
+     */
+    void shutdown();
+
+    /**
+     * @brief Records every frame of this bus to \p fileName, see ModbusCapture.
+     */
+    void startCapture(const QString &fileName);
+
+    /**
+     * @brief Compiles a new scan plan from the channels of this bus' slaves. It replaces the current
+     * plan between two scan cycles, never while the reads of a cycle are outstanding, and sets the
+     * scan cycle to the shortest poll period.
+     */
+    void setChannels(const QVector<ScanChannel> &channels);
+
+    void writeMultipleCoils(quint8 slaveAddress, quint16 startAddress, const QList<quint16> &values, const QString &description = "",
+                            BusScheduler::Priority priority = BusScheduler::Control, std::function<void(bool)> done = nullptr);
+
+    /**
+     * @brief Reads coils with FC01, \p done is called on the I/O thread with the result or ok = false.
+     */
+    void readCoils(quint8 slaveAddress, quint16 startAddress, quint16 count,
+                   std::function<void(bool ok, const QList<quint16> &values)> done,
+                   BusScheduler::Priority priority = BusScheduler::Periodic);
+
+    /**
+     * @brief Emergency stop of the outputs of \p slaveAddress with bounded latency.
+     *
+     * Drops every pending read and every pending write to the slave, writes \p values in one FC15
+     * frame at safety priority and reads the coils back. The worst case is the request already on the
+     * line plus the write and the read back. \p done is called on the I/O thread with the write result,
+     * the coils read back (empty if the read failed) and the time since the call in microseconds.
+     */
+    void emergencyStop(quint8 slaveAddress, quint16 startAddress, const QList<quint16> &values,
+                       std::function<void(bool written, const QList<quint16> &readBack, qint64 latencyUs)> done,
+                       qint64 requestedAtNs = BusScheduler::nowNs());
+
+    /**
+     * @brief Calls \p f on the I/O thread \p delayMs after the call, with a precise timer so the
+     * requests it queues keep millisecond timing. Used for timed outputs, see OutputProgram.
+     */
+    void runAfter(int delayMs, std::function<void()> f, qint64 requestedAtNs = BusScheduler::nowNs());
+
+    bool isConnected() const { return connected.load(); }
+
+    qint64 scanCycleTimeUs() const { return lastScanCycleUs; }
+    BusScheduler::ClassStats schedulerStats(BusScheduler::Priority priority) const { return scheduler.stats(priority); }
+    StatsSnapshot statsSnapshot() const;
+
+    const BusConfig &busConfig() const { return config; }
+    const QString &transport() const { return transportName; }
+    bool servesSlave(quint8 slaveAddress) const { return config.slaves.contains(slaveAddress); }
+
+signals:
+    void connectedChanged(bool connected);
+    void staleSlavesChanged(const QList<quint8> &slaves);
+
+protected:
+    explicit ModbusMaster(const BusConfig &config, const QString &transportName, QObject *parent = nullptr);
+
+    const BusConfig config;
+    const QString transportName;
+
+    // Parented so they follow the object to the I/O thread
+    QTimer readTimer{this};
+    QTimer statsTimer{this};
+
+    BusScheduler scheduler;
+    ScanPlan scanPlan;
+    ModbusStats modbusStats;
+    SlaveHealth health;
+
+    static constexpr int MAX_RETRIES = 5;
+
+    /**
+     * @brief Moves the master to its I/O thread and starts it, called last by the transport constructor.
+     */
+    void startIoThread();
+
+    /**
+     * @brief Called on the I/O thread whenever a request was queued, the transport sends it when it can.
+     */
+    virtual void dispatch() = 0;
+
+    /**
+     * @brief Estimated time the scan cycle occupies the line, 0 if unknown.
+     */
+    virtual qint64 scanWireTimeUs() const { return 0; }
+
+    /**
+     * @brief Called when the last read of a scan cycle finished.
+     */
+    virtual void scanCycleFinished() {}
+
+    bool queueRequest(BusScheduler::Priority priority, ModbusRequest request);
+
+    /**
+     * @brief Shared reply path: statistics, slave health, sensor values, callbacks and write retries.
+     */
+    void completeRequest(const ModbusRequest &request, BusScheduler::Priority priority, QModbusDevice::Error error,
+                         const QModbusDataUnit &result, const QString &errorString);
+
+    /**
+     * @brief Drops a request that will never get a reply, its error callback is told so.
+     */
+    void abandonRequest(const ModbusRequest &request);
+
+    void setConnected(bool isNowConnected);
+    void resetRequests();
+
+    void captureFrame(ModbusCapture::Direction direction, quint8 slaveAddress, const QByteArray &pdu)
+    {
+        if (capture) {
+            capture->record(direction, slaveAddress, pdu);
+        }
+    }
+
+    void storeValue(ushort pinId, quint16 pinValue, double raw);
+    void publishFrame();
+
+    /**
+     * @brief Queues \p f on the I/O thread when called from another thread, returns false if already on it.
+     */
+    template <typename F>
+    bool postToIoThread(F &&f)
+    {
+        if (QThread::currentThread() == thread())
+            return false;
+
+        QMetaObject::invokeMethod(this, std::forward<F>(f), Qt::QueuedConnection);
+        return true;
+    }
+
+protected slots:
+    void startSequentialReading();
+    void dumpStats();
+
+private:
+    QThread ioThread;
+    std::atomic<bool> connected{false};
+
+    int scanBlocksPending = 0; // Reads of the current scan cycle not finished yet
+    quint64 scanCycle = 0;
+    std::optional<ScanPlan> nextPlan; // Compiled while a cycle was running
+    QElapsedTimer scanCycleTimer;
+    qint64 lastScanCycleUs = 0;
+    quint64 scanOverruns = 0;
+    qint64 lastScanStartNs = 0; // 0 after a (re)start of the scan timer
+    LatencyHistogram scanJitter;
+
+    quint64 transactions = 0;
+    quint64 transactionsAtDump = 0;
+    QElapsedTimer dumpTimer;
+    double framesPerSecond = 0;
+
+    QList<quint8> staleSlaves;
+    std::unique_ptr<ModbusCapture> capture;
+
+    // Writes queued before the last emergency stop of their slave are not retried
+    QHash<quint8, qint64> emergencyStopAtNs;
+
+    SensorFrame frame{}; // Values of the scan cycle in progress, published when it completes
+    quint32 updatedPins = 0;
+
+    void installPlan(ScanPlan plan);
+    void finishScanRead(const ModbusRequest &request);
+    void updateHealth(const ModbusRequest &request, QModbusDevice::Error error);
+    void updateStaleness(qint64 nowNs);
+    void applyScanBlock(const ScanBlock &block, const QModbusDataUnit &unit);
+};
+
+#endif // MODBUSMASTER_H
@@ -0,0 +1,453 @@
+#include "modbusnativertu.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/serial.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "logger.h"
+#include "modbuscrc.h"
+#include "modbuspdu.h"
+
+static speed_t baudConstant(int baudRate)
+{
+    switch (baudRate) {
+    case 1200:   return B1200;
+    case 2400:   return B2400;
+    case 4800:   return B4800;
+    case 9600:   return B9600;
+    case 19200:  return B19200;
+    case 38400:  return B38400;
+    case 57600:  return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
+    default:     return B0;
+    }
+}
+
+static QString errnoString()
+{
+    return QString::fromLocal8Bit(std::strerror(errno));
+}
+
+ModbusNativeRTU::ModbusNativeRTU(const BusConfig &config, QObject *parent)
+    : ModbusMaster{config, "NativeRTU", parent}, serialSettings(config.serialSettings),
+      slaveTurnaroundUs(config.slaveTurnaroundUs)
+{
+    txFrame.reserve(MAX_FRAME_BYTES);
+
+    retryTimer.setInterval(WAIT_TIME_MS);
+    connect(&retryTimer, &QTimer::timeout, this, &ModbusNativeRTU::attemptReconnect);
+
+    startIoThread();
+}
+
+ModbusNativeRTU::~ModbusNativeRTU()
+{
+    closePort();
+}
+
+void ModbusNativeRTU::connectToDevice()
+{
+    if (postToIoThread([this]() { connectToDevice(); })) {
+        return;
+    }
+
+    attemptReconnect();
+}
+
+void ModbusNativeRTU::disconnectDevice()
+{
+    if (postToIoThread([this]() { disconnectDevice(); })) {
+        return;
+    }
+
+    readTimer.stop();
+    retryTimer.stop();
+
+    if (lineState == Response) {
+        abandonRequest(currentRequest);
+    }
+    lineState = Idle;
+    resetRequests();
+
+    closePort();
+    setConnected(false);
+}
+
+void ModbusNativeRTU::attemptReconnect()
+{
+    if (isConnected()) return;
+
+    // Exponential backoff
+    int backoffDelay = qMin(WAIT_TIME_MS * (1 << qMin(retryCount, 5)), 30000);
+    retryTimer.setInterval(backoffDelay);
+    retryCount++;
+
+    Logger::info(QString("Attempting native Modbus RTU connection on %1 (attempt %2, delay %3ms)...")
+                     .arg(config.portName).arg(retryCount).arg(backoffDelay));
+
+    closePort();
+
+    QString error;
+    if (!openPort(error)) {
+        Logger::crit(QString("Reconnect failed: %1").arg(error));
+        closePort();
+        retryTimer.start();
+        return;
+    }
+
+    retryCount = 0;
+    retryTimer.stop();
+    lineState = Idle;
+    lineFreeAtNs = 0;
+    setConnected(true);
+
+    Logger::info(QString("Modbus native RTU bus '%1' connected on %2 (%3 baud, inter-frame gap %4 us)")
+                     .arg(config.name, config.portName)
+                     .arg(serialSettings.baudRate)
+                     .arg(serialSettings.interFrameDelayUs()));
+
+    readTimer.start();
+    dispatch();
+}
+
+bool ModbusNativeRTU::openPort(QString &error)
+{
+    const speed_t speed = baudConstant(serialSettings.baudRate);
+    if (speed == B0) {
+        error = QString("Unsupported baud rate %1").arg(serialSettings.baudRate);
+        return false;
+    }
+
+    portFd = ::open(config.portName.toLocal8Bit().constData(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (portFd < 0) {
+        error = QString("%1: %2").arg(config.portName, errnoString());
+        return false;
+    }
+
+    termios tio{};
+    if (tcgetattr(portFd, &tio) != 0) {
+        error = QString("%1 is not a serial port: %2").arg(config.portName, errnoString());
+        return false;
+    }
+
+    // Raw 8 bit I/O, reads return whatever has arrived without waiting
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+
+    tio.c_cflag &= ~(CSIZE | PARENB | PARODD | CSTOPB | CRTSCTS);
+    tio.c_cflag |= CLOCAL | CREAD;
+
+    switch (serialSettings.dataBits) {
+    case QSerialPort::Data5: tio.c_cflag |= CS5; break;
+    case QSerialPort::Data6: tio.c_cflag |= CS6; break;
+    case QSerialPort::Data7: tio.c_cflag |= CS7; break;
+    default:                 tio.c_cflag |= CS8; break;
+    }
+
+    if (serialSettings.parity == QSerialPort::EvenParity) {
+        tio.c_cflag |= PARENB;
+    } else if (serialSettings.parity == QSerialPort::OddParity) {
+        tio.c_cflag |= PARENB | PARODD;
+    }
+
+    if (serialSettings.stopBits == QSerialPort::TwoStop) {
+        tio.c_cflag |= CSTOPB;
+    }
+
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+
+    if (tcsetattr(portFd, TCSANOW, &tio) != 0) {
+        error = QString("Unable to configure %1: %2").arg(config.portName, errnoString());
+        return false;
+    }
+    tcflush(portFd, TCIOFLUSH);
+
+    // Received bytes are handed over at once instead of after the UART FIFO timeout. Not every
+    // driver supports it, e.g. USB adapters have their own latency timer.
+    serial_struct serial{};
+    if (ioctl(portFd, TIOCGSERIAL, &serial) == 0) {
+        serial.flags |= ASYNC_LOW_LATENCY;
+        ioctl(portFd, TIOCSSERIAL, &serial);
+    }
+
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (timerFd < 0 || epollFd < 0) {
+        error = QString("Unable to create the event descriptors: %1").arg(errnoString());
+        return false;
+    }
+
+    for (const int fd : {portFd, timerFd}) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            error = QString("Unable to watch %1: %2").arg(config.portName, errnoString());
+            return false;
+        }
+    }
+
+    notifier = new QSocketNotifier(epollFd, QSocketNotifier::Read, this);
+    connect(notifier, &QSocketNotifier::activated, this, &ModbusNativeRTU::onActivated);
+
+    return true;
+}
+
+void ModbusNativeRTU::closePort()
+{
+    delete notifier;
+    notifier = nullptr;
+
+    for (int *fd : {&epollFd, &timerFd, &portFd}) {
+        if (*fd >= 0) {
+            ::close(*fd);
+            *fd = -1;
+        }
+    }
+}
+
+void ModbusNativeRTU::armTimer(qint64 atNs)
+{
+    // An all zero time would disarm the timer
+    atNs = qMax<qint64>(atNs, 1);
+
+    itimerspec spec{};
+    spec.it_value.tv_sec = atNs / 1000000000;
+    spec.it_value.tv_nsec = atNs % 1000000000;
+
+    // BusScheduler::nowNs() is the steady clock, CLOCK_MONOTONIC on Linux
+    timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+void ModbusNativeRTU::onActivated()
+{
+    epoll_event events[2];
+    const int count = epoll_wait(epollFd, events, 2, 0);
+
+    for (int i = 0; i < count; i++) {
+        if (events[i].data.fd == portFd) {
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                lineFailed("Serial port closed");
+                return;
+            }
+            readPort();
+        } else if (events[i].data.fd == timerFd) {
+            // Nothing to read if the timer was re-armed after it expired
+            quint64 expirations;
+            if (::read(timerFd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+                continue;
+            }
+
+            if (lineState == Gap) {
+                sendNext();
+            } else if (lineState == Response) {
+                responseTimedOut();
+            }
+        }
+
+        // The port may have been closed while handling the event
+        if (portFd < 0) {
+            return;
+        }
+    }
+}
+
+void ModbusNativeRTU::dispatch()
+{
+    if (lineState == Idle) {
+        sendNext();
+    }
+}
+
+void ModbusNativeRTU::sendNext()
+{
+    while (isConnected() && lineState != Response) {
+        const auto now = BusScheduler::nowNs();
+        if (now < lineFreeAtNs) {
+            lineState = Gap;
+            armTimer(lineFreeAtNs);
+            return;
+        }
+
+        lineState = Idle;
+        if (!scheduler.dequeue(currentRequest, now, &currentPriority)) {
+            return;
+        }
+
+        txFrame.resize(0);
+        txFrame.append(static_cast<char>(currentRequest.slaveAddress));
+
+        const int pduSize = ModbusPdu::appendRequest(txFrame, currentRequest);
+        if (pduSize == 0) {
+            Logger::crit(QString("Unsupported request: %1 - Slave:%2 Addr:%3")
+                             .arg(currentRequest.description)
+                             .arg(currentRequest.slaveAddress)
+                             .arg(currentRequest.startAddress));
+            abandonRequest(currentRequest);
+            continue;
+        }
+
+        const quint16 crc = ModbusCrc::compute(reinterpret_cast<const quint8 *>(txFrame.constData()), txFrame.size());
+        txFrame.append(static_cast<char>(crc & 0xFF));
+        txFrame.append(static_cast<char>(crc >> 8));
+
+        // A late reply to the previous request must not be taken for this one
+        tcflush(portFd, TCIFLUSH);
+        rxSize = 0;
+        expectedSize = expectedResponseSize();
+
+        currentRequest.attempts++;
+        currentRequest.sentAtNs = now;
+
+        if (::write(portFd, txFrame.constData(), txFrame.size()) != txFrame.size()) {
+            lineState = Response;
+            lineFailed(QString("Serial write failed: %1").arg(errnoString()));
+            return;
+        }
+
+        captureFrame(ModbusCapture::Request, currentRequest.slaveAddress, QByteArray::fromRawData(txFrame.constData() + 1, pduSize));
+
+        const qint64 sendTimeNs = txFrame.size() * serialSettings.characterTimeUs() * 1000;
+
+        // Broadcasts are never answered, the line is free once the frame is out
+        if (currentRequest.slaveAddress == 0) {
+            lineFreeAtNs = now + sendTimeNs + gapUs(0) * 1000;
+            completeRequest(currentRequest, currentPriority, QModbusDevice::NoError,
+                            QModbusDataUnit(currentRequest.registerType, currentRequest.startAddress, currentRequest.values), QString());
+            continue;
+        }
+
+        lineState = Response;
+        armTimer(now + sendTimeNs + static_cast<qint64>(health.timeoutMs(currentRequest.slaveAddress)) * 1000000);
+    }
+}
+
+void ModbusNativeRTU::readPort()
+{
+    while (true) {
+        const auto received = ::read(portFd, rxFrame.data() + rxSize, MAX_FRAME_BYTES - rxSize);
+        if (received <= 0) {
+            return;
+        }
+
+        // Noise or a late reply between requests
+        if (lineState != Response) {
+            rxSize = 0;
+            continue;
+        }
+
+        rxSize += static_cast<int>(received);
+
+        // Exception responses are address, function | 0x80, exception code and CRC
+        if (rxSize >= 2 && (rxFrame[1] & 0x80)) {
+            expectedSize = 5;
+        }
+
+        if (rxSize < expectedSize && rxSize < MAX_FRAME_BYTES) {
+            continue;
+        }
+
+        const quint8 slaveAddress = currentRequest.slaveAddress;
+
+        if (rxSize < expectedSize || !ModbusCrc::isValid(rxFrame.data(), expectedSize)) {
+            // Counted as CRC error and, by completeRequest(), as other error
+            modbusStats.recordCrcError(slaveAddress, currentRequest.registerType);
+            captureFrame(ModbusCapture::Response, slaveAddress, {});
+            finishResponse(QModbusDevice::ReplyAbortedError, {}, "CRC error");
+            return;
+        }
+
+        if (rxFrame[0] != slaveAddress) {
+            captureFrame(ModbusCapture::Response, slaveAddress, {});
+            finishResponse(QModbusDevice::ReplyAbortedError, {}, QString("Reply from slave %1").arg(rxFrame[0]));
+            return;
+        }
+
+        const auto pdu = QByteArray::fromRawData(reinterpret_cast<const char *>(rxFrame.data()) + 1, expectedSize - 3);
+        captureFrame(ModbusCapture::Response, slaveAddress, pdu);
+
+        QModbusDataUnit result;
+        QString errorString;
+        const auto error = ModbusPdu::decodeResponse(currentRequest, pdu, result, errorString);
+
+        finishResponse(error, result, errorString);
+        return;
+    }
+}
+
+void ModbusNativeRTU::responseTimedOut()
+{
+    captureFrame(ModbusCapture::Response, currentRequest.slaveAddress, {});
+
+    if (rxSize > 0) {
+        finishResponse(QModbusDevice::ReplyAbortedError, {}, QString("Incomplete frame, %1 of %2 bytes").arg(rxSize).arg(expectedSize));
+    } else {
+        finishResponse(QModbusDevice::TimeoutError, {}, "Response timeout");
+    }
+}
+
+void ModbusNativeRTU::finishResponse(QModbusDevice::Error error, const QModbusDataUnit &result, const QString &errorString)
+{
+    lineState = Idle;
+    lineFreeAtNs = BusScheduler::nowNs() + gapUs(currentRequest.slaveAddress) * 1000;
+    rxSize = 0;
+
+    // May queue new requests, they wait for the gap
+    completeRequest(currentRequest, currentPriority, error, result, errorString);
+
+    sendNext();
+}
+
+void ModbusNativeRTU::lineFailed(const QString &reason)
+{
+    Logger::crit(QString("Modbus native RTU bus '%1': %2 - clearing request queue").arg(config.name, reason));
+
+    readTimer.stop();
+
+    if (lineState == Response) {
+        abandonRequest(currentRequest);
+    }
+    lineState = Idle;
+    resetRequests();
+
+    closePort();
+    setConnected(false);
+    retryTimer.start();
+}
+
+int ModbusNativeRTU::expectedResponseSize() const
+{
+    // Address, function and CRC around the data
+    switch (ModbusPdu::functionCode(currentRequest)) {
+    case 0x01:
+    case 0x02:
+        return 5 + (currentRequest.count + 7) / 8;
+    case 0x03:
+    case 0x04:
+        return 5 + currentRequest.count * 2;
+    default:
+        // Writes echo the address and quantity or value
+        return 8;
+    }
+}
+
+qint64 ModbusNativeRTU::gapUs(quint8 slaveAddress) const
+{
+    return serialSettings.interFrameDelayUs() + qMax(0, slaveTurnaroundUs.value(slaveAddress, config.turnaroundUs));
+}
+
+qint64 ModbusNativeRTU::scanWireTimeUs() const
+{
+    return scanPlan.rtuWireTimeUs(serialSettings);
+}
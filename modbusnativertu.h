@@ -0,0 +1,81 @@
+#ifndef MODBUSNATIVERTU_H
+#define MODBUSNATIVERTU_H
+
+#include <QSocketNotifier>
+#include <array>
+
+#include "modbusmaster.h"
+
+/**
+ * @brief Modbus RTU master on a raw Linux serial port, without QModbusRtuSerialClient.
+ *
+ * The port and a timerfd are watched by one epoll descriptor, the only descriptor of this bus the
+ * I/O thread's event loop polls. Frames are built and received in preallocated buffers with the table
+ * driven ModbusCrc. Character timing comes from the termios line settings: the inter-frame gap and
+ * slave turnaround are kept before each send, and a reply is finished as soon as its expected length
+ * has arrived instead of after 3.5 characters of silence. One request on the line at a time, no
+ * retries of its own; reads are repeated next cycle and writes retried in completeRequest().
+ *
+ * Only built with the AUTOKLAV_NATIVE_RTU CMake option, selected per bus with type 'rtu-native'.
+ */
+class ModbusNativeRTU : public ModbusMaster
+{
+    Q_OBJECT
+public:
+    explicit ModbusNativeRTU(const BusConfig &config, QObject *parent = nullptr);
+    ~ModbusNativeRTU() override;
+
+    void connectToDevice() override;
+    void disconnectDevice() override;
+
+protected:
+    void dispatch() override;
+    qint64 scanWireTimeUs() const override;
+
+private slots:
+    void onActivated();
+    void attemptReconnect();
+
+private:
+    enum LineState {
+        Idle,     // Next request can be sent once the line is free
+        Gap,      // Waiting for the inter-frame gap and slave turnaround
+        Response  // Request sent, waiting for the reply
+    };
+
+    static constexpr int MAX_FRAME_BYTES = 256; // Address, PDU and CRC
+    static constexpr int WAIT_TIME_MS = 2000;
+
+    int portFd = -1;
+    int epollFd = -1;
+    int timerFd = -1;
+    QSocketNotifier *notifier = nullptr;
+    QTimer retryTimer{this};
+    int retryCount = 0;
+
+    SerialSettings serialSettings;
+    QHash<quint8, int> slaveTurnaroundUs;
+
+    LineState lineState = Idle;
+    ModbusRequest currentRequest;
+    BusScheduler::Priority currentPriority = BusScheduler::Periodic;
+    qint64 lineFreeAtNs = 0; // End of the last frame plus gap and turnaround
+
+    QByteArray txFrame; // Capacity reserved once
+    std::array<quint8, MAX_FRAME_BYTES> rxFrame{};
+    int rxSize = 0;
+    int expectedSize = 0;
+
+    bool openPort(QString &error);
+    void closePort();
+    void armTimer(qint64 atNs);
+    void sendNext();
+    void readPort();
+    void responseTimedOut();
+    void finishResponse(QModbusDevice::Error error, const QModbusDataUnit &result, const QString &errorString);
+    void lineFailed(const QString &reason);
+    int expectedResponseSize() const;
+    qint64 gapUs(quint8 slaveAddress) const;
+};
+
+#endif // MODBUSNATIVERTU_H
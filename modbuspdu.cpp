@@ -0,0 +1,141 @@
+#include "modbuspdu.h"
+
+void ModbusPdu::appendWord(QByteArray &buffer, quint16 value)
+{
+    buffer.append(static_cast<char>(value >> 8));
+    buffer.append(static_cast<char>(value & 0xFF));
+}
+
+quint16 ModbusPdu::wordAt(const QByteArray &buffer, int index)
+{
+    return static_cast<quint16>(static_cast<quint8>(buffer[index]) << 8 | static_cast<quint8>(buffer[index + 1]));
+}
+
+quint8 ModbusPdu::functionCode(const ModbusRequest &request)
+{
+    const bool write = request.operation == ModbusRequest::Write;
+
+    switch (request.registerType) {
+    case QModbusDataUnit::Coils:            return write ? (request.values.size() == 1 ? 0x05 : 0x0F) : 0x01;
+    case QModbusDataUnit::DiscreteInputs:   return write ? 0 : 0x02;
+    case QModbusDataUnit::HoldingRegisters: return write ? (request.values.size() == 1 ? 0x06 : 0x10) : 0x03;
+    case QModbusDataUnit::InputRegisters:   return write ? 0 : 0x04;
+    default:                                return 0;
+    }
+}
+
+QByteArray ModbusPdu::encodeRequest(const ModbusRequest &request)
+{
+    QByteArray pdu;
+    appendRequest(pdu, request);
+    return pdu;
+}
+
+int ModbusPdu::appendRequest(QByteArray &pdu, const ModbusRequest &request)
+{
+    const quint8 function = functionCode(request);
+    if (!function) {
+        return 0;
+    }
+
+    const auto start = pdu.size();
+    pdu.append(static_cast<char>(function));
+    appendWord(pdu, request.startAddress);
+
+    switch (function) {
+    case 0x01:
+    case 0x02:
+    case 0x03:
+    case 0x04:
+        appendWord(pdu, request.count);
+        break;
+    case 0x05:
+        appendWord(pdu, request.values.first() ? 0xFF00 : 0x0000);
+        break;
+    case 0x06:
+        appendWord(pdu, request.values.first());
+        break;
+    case 0x0F: {
+        const int byteCount = (request.values.size() + 7) / 8;
+        appendWord(pdu, static_cast<quint16>(request.values.size()));
+        pdu.append(static_cast<char>(byteCount));
+
+        const auto bits = pdu.size();
+        pdu.append(byteCount, 0);
+        for (int i = 0; i < request.values.size(); i++) {
+            if (request.values[i]) {
+                pdu[bits + i / 8] = static_cast<char>(pdu[bits + i / 8] | (1 << (i % 8)));
+            }
+        }
+        break;
+    }
+    case 0x10:
+        appendWord(pdu, static_cast<quint16>(request.values.size()));
+        pdu.append(static_cast<char>(request.values.size() * 2));
+        for (const auto value : request.values) {
+            appendWord(pdu, value);
+        }
+        break;
+    }
+
+    if (pdu.size() - start > MAX_BYTES) {
+        pdu.truncate(start);
+        return 0;
+    }
+
+    return static_cast<int>(pdu.size() - start);
+}
+
+QModbusDevice::Error ModbusPdu::decodeResponse(const ModbusRequest &request, const QByteArray &pdu,
+                                               QModbusDataUnit &result, QString &errorString)
+{
+    const quint8 expected = functionCode(request);
+    const quint8 function = pdu.isEmpty() ? 0 : static_cast<quint8>(pdu[0]);
+
+    if (function == (expected | 0x80)) {
+        errorString = QString("Exception 0x%1").arg(pdu.size() > 1 ? static_cast<quint8>(pdu[1]) : 0, 2, 16, QChar('0'));
+        return QModbusDevice::ProtocolError;
+    }
+
+    if (function != expected) {
+        errorString = QString("Unexpected function code 0x%1").arg(function, 2, 16, QChar('0'));
+        return QModbusDevice::ReplyAbortedError;
+    }
+
+    result = QModbusDataUnit(request.registerType, request.startAddress, request.count);
+
+    switch (function) {
+    case 0x01:
+    case 0x02: {
+        const int byteCount = pdu.size() > 1 ? static_cast<quint8>(pdu[1]) : 0;
+        if (byteCount < (request.count + 7) / 8 || pdu.size() < 2 + byteCount) {
+            break;
+        }
+        for (int i = 0; i < request.count; i++) {
+            result.setValue(i, (static_cast<quint8>(pdu[2 + i / 8]) >> (i % 8)) & 1);
+        }
+        return QModbusDevice::NoError;
+    }
+    case 0x03:
+    case 0x04: {
+        const int byteCount = pdu.size() > 1 ? static_cast<quint8>(pdu[1]) : 0;
+        if (byteCount != request.count * 2 || pdu.size() < 2 + byteCount) {
+            break;
+        }
+        for (int i = 0; i < request.count; i++) {
+            result.setValue(i, wordAt(pdu, 2 + i * 2));
+        }
+        return QModbusDevice::NoError;
+    }
+    default:
+        // Writes echo the address and quantity or value
+        if (pdu.size() < 5 || wordAt(pdu, 1) != request.startAddress) {
+            break;
+        }
+        result.setValues(request.values);
+        return QModbusDevice::NoError;
+    }
+
+    errorString = "Malformed response";
+    return QModbusDevice::ReplyAbortedError;
+}
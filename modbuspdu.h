@@ -0,0 +1,44 @@
+#ifndef MODBUSPDU_H
+#define MODBUSPDU_H
+
+#include <QByteArray>
+#include <QModbusDevice>
+
+#include "busscheduler.h"
+
+/**
+ * @brief Protocol data unit (function code and data) of the requests issued by the masters.
+ *
+ * Shared by the transports that build frames themselves and by traffic capture and replay.
+ * Multi byte fields are big endian as on the wire.
+ */
+namespace ModbusPdu {
+    inline constexpr int MAX_BYTES = 253;
+
+    void appendWord(QByteArray &buffer, quint16 value);
+    quint16 wordAt(const QByteArray &buffer, int index);
+
+    /**
+     * @brief Function code of \p request, 0 if the register type can't be written.
+     */
+    quint8 functionCode(const ModbusRequest &request);
+
+    /**
+     * @brief Request PDU, empty if the request can't be encoded.
+     */
+    QByteArray encodeRequest(const ModbusRequest &request);
+
+    /**
+     * @brief Appends the request PDU to \p buffer without allocating when its capacity suffices.
+     * Returns the PDU size, 0 (and \p buffer unchanged) if the request can't be encoded.
+     */
+    int appendRequest(QByteArray &buffer, const ModbusRequest &request);
+
+    /**
+     * @brief Decodes the response PDU to \p request. Exception responses are reported as ProtocolError.
+     */
+    QModbusDevice::Error decodeResponse(const ModbusRequest &request, const QByteArray &pdu,
+                                        QModbusDataUnit &result, QString &errorString);
+}
+
+#endif // MODBUSPDU_H
@@ -0,0 +1,223 @@
+#include "modbusreplay.h"
+#include "modbuspdu.h"
+#include "logger.h"
+
+ModbusReplay::ModbusReplay(const BusConfig &config, bool fast, QObject *parent)
+    : ModbusMaster{config, "replay", parent}, fast(fast)
+{
+    responseTimer.setSingleShot(true);
+    responseTimer.setTimerType(Qt::PreciseTimer);
+    connect(&responseTimer, &QTimer::timeout, this, &ModbusReplay::respond);
+
+    startIoThread();
+}
+
+void ModbusReplay::connectToDevice()
+{
+    if (postToIoThread([this]() { connectToDevice(); })) {
+        return;
+    }
+
+    ModbusCapture::Header header;
+    records.clear();
+    if (!ModbusCapture::load(config.portName, header, records)) {
+        Logger::crit(QString("Bus '%1': Nothing to replay").arg(config.name));
+        emit finished(false);
+        return;
+    }
+
+    consumed = QList<bool>(records.size(), false);
+    cursor = 0;
+
+    Logger::info(QString("Replaying %1 frames of bus %2 from %3%4")
+                     .arg(records.size())
+                     .arg(header.busId)
+                     .arg(config.portName)
+                     .arg(fast ? " as fast as possible" : ""));
+
+    replayClock.start();
+    setConnected(true);
+
+    if (fast) {
+        QMetaObject::invokeMethod(this, &ModbusReplay::startSequentialReading, Qt::QueuedConnection);
+    } else {
+        if (header.scanIntervalMs > 0) {
+            readTimer.setInterval(static_cast<int>(header.scanIntervalMs));
+        }
+        readTimer.start();
+    }
+}
+
+void ModbusReplay::disconnectDevice()
+{
+    if (postToIoThread([this]() { disconnectDevice(); })) {
+        return;
+    }
+
+    readTimer.stop();
+    responseTimer.stop();
+
+    if (isProcessingRequest) {
+        isProcessingRequest = false;
+        abandonRequest(currentRequest);
+    }
+    resetRequests();
+
+    setConnected(false);
+}
+
+void ModbusReplay::dispatch()
+{
+    if (isProcessingRequest || !isConnected()) {
+        return;
+    }
+
+    if (!scheduler.dequeue(currentRequest, BusScheduler::nowNs(), &currentPriority)) {
+        return;
+    }
+
+    isProcessingRequest = true;
+    currentRequest.attempts++;
+    currentRequest.sentAtNs = BusScheduler::nowNs();
+    currentResponse.clear();
+
+    qint64 delayUs = 0;
+    const int requestIndex = findRequest(currentRequest.slaveAddress, ModbusPdu::encodeRequest(currentRequest));
+
+    if (requestIndex >= 0) {
+        consumed[requestIndex] = true;
+        matched++;
+        consecutiveUnmatched = 0;
+
+        const int responseIndex = findResponse(requestIndex);
+        if (responseIndex >= 0) {
+            consumed[responseIndex] = true;
+            currentResponse = records[responseIndex].pdu;
+            delayUs = records[responseIndex].timeUs - records[requestIndex].timeUs;
+        }
+
+        advanceCursor(requestIndex);
+    } else {
+        unmatched++;
+        consecutiveUnmatched++;
+        delayUs = static_cast<qint64>(health.timeoutMs(currentRequest.slaveAddress)) * 1000;
+
+        Logger::debug(QString("Replay: %1 to slave %2 not in capture").arg(currentRequest.description).arg(currentRequest.slaveAddress));
+    }
+
+    responseTimer.start(fast ? 0 : static_cast<int>(delayUs / 1000));
+}
+
+void ModbusReplay::respond()
+{
+    if (!isProcessingRequest) {
+        return;
+    }
+
+    // Completing may queue and start the next request
+    const ModbusRequest request = currentRequest;
+    isProcessingRequest = false;
+
+    QModbusDataUnit result;
+    QString errorString;
+    QModbusDevice::Error error = QModbusDevice::NoError;
+
+    // Broadcasts are never answered
+    if (request.slaveAddress != 0) {
+        if (currentResponse.isEmpty()) {
+            error = QModbusDevice::TimeoutError;
+            errorString = "Response timeout";
+        } else {
+            error = ModbusPdu::decodeResponse(request, currentResponse, result, errorString);
+        }
+    }
+
+    completeRequest(request, currentPriority, error, result, errorString);
+
+    if (cursor >= records.size() || consecutiveUnmatched > MATCH_WINDOW) {
+        finishReplay();
+        return;
+    }
+
+    dispatch();
+}
+
+void ModbusReplay::scanCycleFinished()
+{
+    if (fast && isConnected()) {
+        QMetaObject::invokeMethod(this, &ModbusReplay::startSequentialReading, Qt::QueuedConnection);
+    }
+}
+
+int ModbusReplay::findRequest(quint8 slaveAddress, const QByteArray &pdu) const
+{
+    int searched = 0;
+
+    for (int i = cursor; i < records.size() && searched < MATCH_WINDOW; i++) {
+        const auto &record = records[i];
+        if (consumed[i] || record.direction != ModbusCapture::Request) {
+            continue;
+        }
+
+        if (record.slaveAddress == slaveAddress && record.pdu == pdu) {
+            return i;
+        }
+
+        searched++;
+    }
+
+    return -1;
+}
+
+int ModbusReplay::findResponse(int requestIndex) const
+{
+    const quint8 slaveAddress = records[requestIndex].slaveAddress;
+
+    // Broadcasts were never answered
+    if (slaveAddress == 0) {
+        return -1;
+    }
+
+    for (int i = requestIndex + 1; i < records.size(); i++) {
+        const auto &record = records[i];
+        if (record.direction == ModbusCapture::Response && record.slaveAddress == slaveAddress && !consumed[i]) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+void ModbusReplay::advanceCursor(int matchedIndex)
+{
+    // Recorded requests far behind the last match were not issued by this run
+    while (cursor < matchedIndex - MATCH_WINDOW) {
+        if (!consumed[cursor] && records[cursor].direction == ModbusCapture::Request) {
+            skipped++;
+        }
+        cursor++;
+    }
+
+    while (cursor < records.size() && (consumed[cursor] || records[cursor].direction == ModbusCapture::Response)) {
+        cursor++;
+    }
+}
+
+void ModbusReplay::finishReplay()
+{
+    readTimer.stop();
+    setConnected(false);
+
+    const qint64 recordedMs = records.isEmpty() ? 0 : records.last().timeUs / 1000;
+    Logger::info(QString("Replay of %1 finished in %2 ms (recorded %3 ms): %4 requests matched, "
+                         "%5 not in capture, %6 recorded requests skipped")
+                     .arg(config.portName)
+                     .arg(replayClock.elapsed())
+                     .arg(recordedMs)
+                     .arg(matched)
+                     .arg(unmatched)
+                     .arg(skipped));
+
+    dumpStats();
+    emit finished(true);
+}
@@ -0,0 +1,64 @@
+#ifndef MODBUSREPLAY_H
+#define MODBUSREPLAY_H
+
+#include "modbusmaster.h"
+
+/**
+ * @brief Transport answering requests from a ModbusCapture file instead of a real bus.
+ *
+ * Each request is matched to the next recorded request with the same slave and PDU, and answered
+ * with the recorded response, after the recorded response time or immediately in fast mode. Scan
+ * cycles follow the recorded scan interval, in fast mode they run back to back. Requests that are
+ * not in the capture time out. finished() is emitted at the end of the capture, or with \p ok false
+ * if the capture can't be loaded.
+ */
+class ModbusReplay : public ModbusMaster
+{
+    Q_OBJECT
+public:
+    ModbusReplay(const BusConfig &config, bool fast, QObject *parent = nullptr);
+
+    void connectToDevice() override;
+    void disconnectDevice() override;
+
+signals:
+    void finished(bool ok);
+
+protected:
+    void dispatch() override;
+    void scanCycleFinished() override;
+
+private slots:
+    void respond();
+
+private:
+    const bool fast;
+
+    // Parented so it follows the object to the I/O thread
+    QTimer responseTimer{this};
+
+    QList<ModbusCapture::Record> records;
+    QList<bool> consumed;
+    int cursor = 0;
+
+    bool isProcessingRequest = false;
+    ModbusRequest currentRequest;
+    BusScheduler::Priority currentPriority = BusScheduler::Periodic;
+    QByteArray currentResponse;
+    bool currentMatched = false;
+
+    QElapsedTimer replayClock;
+    quint64 matched = 0;
+    quint64 unmatched = 0;
+    quint64 skipped = 0;
+    int consecutiveUnmatched = 0;
+
+    static constexpr int MATCH_WINDOW = 64; // Recorded requests searched ahead of the cursor
+
+    int findRequest(quint8 slaveAddress, const QByteArray &pdu) const;
+    int findResponse(int requestIndex) const;
+    void advanceCursor(int matchedIndex);
+    void finishReplay();
+};
+
+#endif // MODBUSREPLAY_H
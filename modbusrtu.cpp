@@ -1,281 +1,171 @@
 #include "modbusrtu.h"
 #include <QSerialPort>
 #include <QVariant>
-#include "constants.h"
-#include "sensor.h"
 #include "logger.h"
-#include "globalerrors.h"
+#include "modbuspdu.h"
 
-qint64 ModbusRTU::lastDataTime = 0;
-
-ModbusRTU::ModbusRTU(QObject *parent)
-    : QObject{parent}, modbusDevice(new QModbusRtuSerialClient(this))
+ModbusRTU::ModbusRTU(const BusConfig &config, QObject *parent)
+    : ModbusMaster{config, "RTU", parent}, modbusDevice(new QModbusRtuSerialClient(this)),
+      slaveTurnaroundUs(config.slaveTurnaroundUs)
 {
     connect(modbusDevice, &QModbusClient::errorOccurred, this, &ModbusRTU::onErrorOccurred);
     connect(modbusDevice, &QModbusClient::stateChanged, this, &ModbusRTU::onStateChanged);
 
     configureConnectionParameters();
 
-    // Set up periodic reading with sequential processing
-    readTimer.setInterval(READ_INTERVAL_MS);
-    connect(&readTimer, &QTimer::timeout, this, &ModbusRTU::startSequentialReading);
-
-    // Request processing timer
-    requestTimer.setInterval(REQUEST_DELAY_MS);
+    // Request processing timer, restarted after every reply with the slave turnaround time
+    requestTimer.setSingleShot(true);
+    requestTimer.setTimerType(Qt::PreciseTimer);
     connect(&requestTimer, &QTimer::timeout, this, &ModbusRTU::processNextRequest);
 
     // Initialize retry timer
     retryTimer.setInterval(WAIT_TIME_MS);
     connect(&retryTimer, &QTimer::timeout, this, &ModbusRTU::attemptReconnect);
 
-    // Start initial connection
-    attemptReconnect();
+    startIoThread();
 }
 
 void ModbusRTU::configureConnectionParameters()
 {
+    serialSettings = config.serialSettings;
+
     modbusDevice->setConnectionParameter(
         QModbusDevice::SerialPortNameParameter,
-        QVariant(QStringLiteral("COM7"))
+        QVariant(config.portName)
         );
 
     modbusDevice->setConnectionParameter(
         QModbusDevice::SerialBaudRateParameter,
-        QVariant(static_cast<int>(QSerialPort::Baud9600))
+        QVariant(serialSettings.baudRate)
         );
 
     modbusDevice->setConnectionParameter(
         QModbusDevice::SerialParityParameter,
-        QVariant(static_cast<int>(QSerialPort::OddParity))
+        QVariant(static_cast<int>(serialSettings.parity))
         );
 
     modbusDevice->setConnectionParameter(
         QModbusDevice::SerialDataBitsParameter,
-        QVariant(static_cast<int>(QSerialPort::Data8))
+        QVariant(static_cast<int>(serialSettings.dataBits))
         );
 
     modbusDevice->setConnectionParameter(
         QModbusDevice::SerialStopBitsParameter,
-        QVariant(static_cast<int>(QSerialPort::OneStop))
+        QVariant(static_cast<int>(serialSettings.stopBits))
         );
 
-    // Set timeout and number of retries
-    modbusDevice->setTimeout(1000);
-    modbusDevice->setNumberOfRetries(3);
-}
+    // 3.5 character times of silence between frames, enforced by the client before each send
+    modbusDevice->setInterFrameDelay(static_cast<int>(serialSettings.interFrameDelayUs()));
 
-ModbusRTU &ModbusRTU::instance()
-{
-    static ModbusRTU _instance;
-    return _instance;
+    // The timeout is adapted per slave before each request. No client retries, they would multiply
+    // the bus time lost on a dead slave; reads are repeated next cycle and writes retried in completeRequest().
+    modbusDevice->setTimeout(SlaveHealth::MAX_TIMEOUT_MS);
+    modbusDevice->setNumberOfRetries(0);
 }
 
-void ModbusRTU::queueRequest(const ModbusRequest &request)
+void ModbusRTU::dispatch()
 {
-     // Safety check - prevent unlimited queue growth
-    if (requestQueue.size() >= MAX_QUEUE_SIZE) {
-        Logger::info("Request queue full - discarding request");
-        return;
-    }
-    
-    requestQueue.enqueue(request);
     if (!requestTimer.isActive() && !isProcessingRequest) {
-        requestTimer.start();
+        requestTimer.start(0);
     }
 }
 
 void ModbusRTU::processNextRequest()
 {
-    if (isProcessingRequest || requestQueue.isEmpty() || !isConnected()) {
-        if (requestQueue.isEmpty()) {
-            requestTimer.stop();
-        }
+    if (isProcessingRequest || !isConnected()) {
+        return;
+    }
+
+    if (!scheduler.dequeue(currentRequest, BusScheduler::nowNs(), &currentPriority)) {
         return;
     }
 
     isProcessingRequest = true;
-    ModbusRequest request = requestQueue.dequeue();
-
-    QModbusDataUnit unit(request.registerType, request.startAddress, request.count);
-
-    if (auto *reply = modbusDevice->sendReadRequest(unit, request.slaveAddress)) {
-        // Logger::debug(QString("Sent request: %1 - Slave: %2, Addr: %3")
-        //                   .arg(request.description)
-        //                   .arg(request.slaveAddress)
-        //                   .arg(request.startAddress));
-
-        connect(reply, &QModbusReply::finished, this, [this, request, reply]() {
-            if (reply->error() == QModbusDevice::NoError) {
-                request.callback(reply->result(), request.slaveAddress);
-            } else {
-                // Logger::info(QString("Request failed: %1 - Error: %2")
-                //                     .arg(request.description)
-                //                     .arg(reply->errorString()));
-
-                // Optional: Re-queue failed request (be careful with this)
-                // if (retryCount < MAX_RETRIES) {
-                //     queueRequest(request);
-                // }
-            }
-            reply->deleteLater();
-            isProcessingRequest = false;
-
-            // Process next request after a short delay
-            QTimer::singleShot(REQUEST_DELAY_MS, this, &ModbusRTU::processNextRequest);
-        });
+    currentRequest.attempts++;
+    currentRequest.sentAtNs = BusScheduler::nowNs();
+
+    modbusDevice->setTimeout(health.timeoutMs(currentRequest.slaveAddress));
+
+    if (currentRequest.operation == ModbusRequest::Write) {
+        const QModbusDataUnit unit(currentRequest.registerType, currentRequest.startAddress, currentRequest.values);
+        currentReply = modbusDevice->sendWriteRequest(unit, currentRequest.slaveAddress);
+    } else if (currentRequest.scanBlock >= 0) {
+        currentReply = modbusDevice->sendReadRequest(scanPlan.block(currentRequest.scanBlock).unit, currentRequest.slaveAddress);
     } else {
-        Logger::info(QString("Failed to send request: %1").arg(request.description));
-        isProcessingRequest = false;
-        QTimer::singleShot(REQUEST_DELAY_MS, this, &ModbusRTU::processNextRequest);
+        const QModbusDataUnit unit(currentRequest.registerType, currentRequest.startAddress, currentRequest.count);
+        currentReply = modbusDevice->sendReadRequest(unit, currentRequest.slaveAddress);
     }
-}
 
-void ModbusRTU::startSequentialReading()
-{
-    // Don't queue new requests if we're not connected
-    if (!isConnected()) {
+    if (!currentReply) {
+        Logger::crit(QString("Failed to send request: %1 - Slave:%2 Addr:%3 - %4")
+                         .arg(currentRequest.description)
+                         .arg(currentRequest.slaveAddress)
+                         .arg(currentRequest.startAddress)
+                         .arg(modbusDevice->errorString()));
+        abandonRequest(currentRequest);
+        finishRequest();
         return;
     }
-    
-    // Also check if queue is already too large (safety measure)
-    if (requestQueue.size() > MAX_QUEUE_SIZE) {
-        Logger::info("Request queue too large - clearing stale requests");
-        requestQueue.clear();
-    }
-    
-    if (!requestQueue.isEmpty()) {
-        return; // Skip if still processing previous requests
-    }
 
-    // Queue all sensor reads sequentially
-    queueRequest({CONSTANTS::TEMP, QModbusDataUnit::HoldingRegisters, 1, 1,
-                  [this](const QModbusDataUnit& unit, quint8 slaveAddr) {
-                      handleTemperatureReading(unit, slaveAddr);
-                  }, "Temperature"});
-
-    queueRequest({CONSTANTS::TEMP_K, QModbusDataUnit::HoldingRegisters, 1, 1,
-                  [this](const QModbusDataUnit& unit, quint8 slaveAddr) {
-                      handleTemperatureReading(unit, slaveAddr);
-                  }, "Temperature Kelvin"});
-
-    queueRequest({CONSTANTS::EXPANSION_TEMP, QModbusDataUnit::HoldingRegisters, 1, 1,
-                  [this](const QModbusDataUnit& unit, quint8 slaveAddr) {
-                      handleTemperatureReading(unit, slaveAddr);
-                  }, "Expansion Temperature"});
-
-    queueRequest({CONSTANTS::TANK_WATER_LEVEL, QModbusDataUnit::HoldingRegisters, 1, 1,
-                  [this](const QModbusDataUnit& unit, quint8 slaveAddr) {
-                      handleLevelReading(unit, slaveAddr);
-                  }, "Tank Water Level"});
-
-    queueRequest({CONSTANTS::PRESSURE, QModbusDataUnit::HoldingRegisters, 1, 1,
-                  [this](const QModbusDataUnit& unit, quint8 slaveAddr) {
-                      handlePressureReading(unit, slaveAddr);
-                  }, "Pressure"});
-
-    // Digital inputs (uncomment when needed)
-    /*
-    queueRequest({CONSTANTS::CWT_SLAVE_ID, QModbusDataUnit::DiscreteInputs, CONSTANTS::DOOR_CLOSED, 1,
-        [this](const QModbusDataUnit& unit, quint8 slaveAddr) {
-            handleDigitalInputReading(unit, slaveAddr, CONSTANTS::DOOR_CLOSED);
-        }, "Door Status"});
-    */
-}
+    captureFrame(ModbusCapture::Request, currentRequest.slaveAddress, ModbusPdu::encodeRequest(currentRequest));
 
-void ModbusRTU::readHoldingRegisters(quint8 slaveAddress, quint16 startAddr, quint16 count, const QString &description)
-{
-    queueRequest({slaveAddress, QModbusDataUnit::HoldingRegisters, startAddr, count,
-                  [this](const QModbusDataUnit& unit, quint8 slaveAddr) {
-                      // Use the new handler system instead of onReadReady
-                      // For holding registers, we can use the start address from the unit
-                      handleTemperatureReading(unit, slaveAddr);
-                  }, description.isEmpty() ? "Holding Register Read" : description});
+    // Broadcast replies are finished immediately and never emit finished()
+    if (currentReply->isFinished()) {
+        handleReply(currentReply);
+    } else {
+        connect(currentReply, &QModbusReply::finished, this, &ModbusRTU::onReplyFinished);
+    }
 }
 
-void ModbusRTU::readDiscreteRegisters(quint8 slaveAddress, quint16 startAddr, quint16 count, const QString &description)
+void ModbusRTU::onReplyFinished()
 {
-    // Capture startAddr by value in the lambda
-    queueRequest({slaveAddress, QModbusDataUnit::DiscreteInputs, startAddr, count,
-                  [this, startAddr](const QModbusDataUnit& unit, quint8 slaveAddr) {
-                      // Use the new handler system instead of onDigitalInputReady
-                      handleDigitalInputReading(unit, slaveAddr, startAddr);
-                  }, description.isEmpty() ? "Discrete Input Read" : description});
+    auto reply = qobject_cast<QModbusReply *>(sender());
+    if (!reply) return;
+
+    handleReply(reply);
 }
 
-void ModbusRTU::handleTemperatureReading(const QModbusDataUnit &unit, quint8 slaveAddress)
+void ModbusRTU::handleReply(QModbusReply *reply)
 {
-    if (unit.valueCount() >= 1) {
-        quint16 rawValue = unit.value(0);
-        uint scaledValue = static_cast<uint>(rawValue);
-
-        if (Sensor::mapInputPin.contains(slaveAddress)) {
-            // Logger::info(QString("Temperature - Slave:%1 Address:%2 Value:%3")
-            //                  .arg(slaveAddress)
-            //                  .arg(unit.startAddress())
-            //                  .arg(scaledValue));
-
-            Sensor::mapInputPin[slaveAddress]->setValue(scaledValue);
-            lastDataTime = QDateTime::currentMSecsSinceEpoch();
-        } else {
-            Logger::info(QString("Sensor not found for slave:%1").arg(slaveAddress));
+    reply->deleteLater();
+
+    // Request was aborted by a disconnect while the reply was pending
+    if (reply != currentReply) return;
+
+    // Broadcasts have no response frame
+    if (currentRequest.slaveAddress != 0) {
+        const auto response = reply->rawResult();
+        QByteArray pdu;
+        if (response.isValid()) {
+            pdu.append(static_cast<char>(response.functionCode() | (response.isException() ? QModbusPdu::ExceptionByte : 0)));
+            pdu.append(response.data());
         }
+        captureFrame(ModbusCapture::Response, currentRequest.slaveAddress, pdu);
     }
+
+    completeRequest(currentRequest, currentPriority, reply->error(), reply->result(), reply->errorString());
+
+    finishRequest();
 }
 
-void ModbusRTU::handlePressureReading(const QModbusDataUnit &unit, quint8 slaveAddress)
+void ModbusRTU::finishRequest()
 {
-    if (unit.valueCount() >= 1) {
-        quint16 rawValue = unit.value(0);
-        uint scaledValue = static_cast<uint>(rawValue)/10;
-
-        if (Sensor::mapInputPin.contains(slaveAddress)) {
-            // Logger::info(QString("Pressure - Slave:%1 Address:%2 Value:%3")
-            //                  .arg(slaveAddress)
-            //                  .arg(unit.startAddress())
-            //                  .arg(scaledValue));
-
-            Sensor::mapInputPin[slaveAddress]->setValue(scaledValue);
-            lastDataTime = QDateTime::currentMSecsSinceEpoch();
-        }
-    }
+    currentReply = nullptr;
+    isProcessingRequest = false;
+
+    // The inter-frame gap itself is kept by the client, only the slave turnaround is added here
+    requestTimer.start(turnaroundMs(currentRequest.slaveAddress));
 }
 
-void ModbusRTU::handleLevelReading(const QModbusDataUnit &unit, quint8 slaveAddress)
+int ModbusRTU::turnaroundMs(quint8 slaveAddress) const
 {
-    if (unit.valueCount() >= 1) {
-        quint16 rawValue = unit.value(0);
-        uint scaledValue = static_cast<uint>(rawValue);
-
-        if (Sensor::mapInputPin.contains(slaveAddress)) {
-            // Logger::info(QString("Level - Slave:%1 Address:%2 Value:%3")
-            //                  .arg(slaveAddress)
-            //                  .arg(unit.startAddress())
-            //                  .arg(scaledValue));
-
-            Sensor::mapInputPin[slaveAddress]->setValue(scaledValue);
-            lastDataTime = QDateTime::currentMSecsSinceEpoch();
-        }
-    }
+    const int turnaroundUs = slaveTurnaroundUs.value(slaveAddress, config.turnaroundUs);
+    return (qMax(0, turnaroundUs) + 999) / 1000;
 }
 
-void ModbusRTU::handleDigitalInputReading(const QModbusDataUnit &unit, quint8 slaveAddress, quint16 startAddress)
+qint64 ModbusRTU::scanWireTimeUs() const
 {
-    if (unit.valueCount() >= 1) {
-        quint16 rawValue = unit.value(0);
-        uint scaledValue = static_cast<uint>(rawValue);
-
-        const auto shiftedAddress = startAddress + CONSTANTS::DIGITAL_INPUT_SHIFT;
-
-        if (Sensor::mapInputPin.contains(shiftedAddress)) {
-            // Logger::info(QString("Digital Input - Slave:%1 Address:%2 Value:%3")
-            //                  .arg(slaveAddress)
-            //                  .arg(startAddress)
-            //                  .arg(scaledValue));
-
-            Sensor::mapInputPin[shiftedAddress]->setValue(scaledValue);
-            lastDataTime = QDateTime::currentMSecsSinceEpoch();
-        }
-    }
+    return scanPlan.rtuWireTimeUs(serialSettings);
 }
 
 void ModbusRTU::attemptReconnect()
@@ -311,126 +201,20 @@ void ModbusRTU::attemptReconnect()
 
 void ModbusRTU::disconnectDevice()
 {
+    if (postToIoThread([this]() { disconnectDevice(); })) {
+        return;
+    }
+
     readTimer.stop();
     retryTimer.stop();
     requestTimer.stop();
-    requestQueue.clear();
+    resetRequests();
 
     if (modbusDevice) {
         modbusDevice->disconnectDevice();
     }
 }
 
-void ModbusRTU::writeSingleCoil(quint8 slaveAddress, quint16 coilAddress, bool value, const QString &description)
-{
-    if (!isConnected()) {
-        Logger::crit("Modbus RTU device not connected. Cannot write to coil.");
-        return;
-    }
-
-    QModbusDataUnit writeUnit(QModbusDataUnit::Coils, coilAddress, 1);
-    writeUnit.setValue(0, value ? static_cast<quint16>(CONSTANTS::MODBUS_COIL_ON) : static_cast<quint16>(CONSTANTS::MODBUS_COIL_OFF));
-    
-    if (auto *reply = modbusDevice->sendWriteRequest(writeUnit, slaveAddress)) {
-        connect(reply, &QModbusReply::finished, this, [this, reply, slaveAddress, coilAddress, value]() {
-            if (reply->error() != QModbusDevice::NoError) {
-                Logger::crit(QString("Write coil error - Slave:%1 Coil:%2 Value:%3 - %4")
-                                 .arg(slaveAddress)
-                                 .arg(coilAddress)
-                                 .arg(value ? "ON" : "OFF")
-                                 .arg(reply->errorString()));
-                GlobalErrors::setError(GlobalErrors::ModbusWriteCoilError);
-            } else {
-                Logger::info(QString("Successfully wrote coil - Slave:%1 Coil:%2 Value:%3")
-                                 .arg(slaveAddress)
-                                 .arg(coilAddress)
-                                 .arg(value ? "ON" : "OFF"));
-            }
-            reply->deleteLater();
-        });
-    } else {
-        Logger::crit(QString("Write coil request failed - Slave:%1 Coil:%2 Value:%3 - %4")
-                         .arg(slaveAddress)
-                         .arg(coilAddress)
-                         .arg(value ? "ON" : "OFF")
-                         .arg(modbusDevice->errorString()));
-    }
-}
-
-void ModbusRTU::onReadReady()
-{
-    auto reply = qobject_cast<QModbusReply *>(sender());
-    if (!reply) return;
-
-    if (reply->error() == QModbusDevice::NoError) {
-        const QModbusDataUnit unit = reply->result();
-        const quint8 slaveAddress = reply->serverAddress();
-        const quint16 startAddress = unit.startAddress();
-
-        if (unit.valueCount() >= 1) {
-            quint16 rawValue = unit.value(0);
-            uint scaledValue = static_cast<uint>(rawValue);
-
-            if (Sensor::mapInputPin.contains(slaveAddress)) {
-                Logger::info(QString("Read slave:%1 address:%2 value:%3")
-                                 .arg(slaveAddress)
-                                 .arg(startAddress)
-                                 .arg(scaledValue));
-
-                Sensor::mapInputPin[slaveAddress]->setValue(scaledValue);
-            } else {
-                Logger::crit(QString("Sensor not found for slave:%1 address:%2")
-                                 .arg(slaveAddress)
-                                 .arg(startAddress));
-                GlobalErrors::setError(GlobalErrors::DbError);
-            }
-
-            lastDataTime = QDateTime::currentMSecsSinceEpoch();
-        }
-    } else {
-        qDebug() << "Read error:" << reply->errorString();
-    }
-    reply->deleteLater();
-}
-
-void ModbusRTU::onDigitalInputReady()
-{
-    auto reply = qobject_cast<QModbusReply *>(sender());
-    if (!reply) return;
-
-    if (reply->error() == QModbusDevice::NoError) {
-        const QModbusDataUnit unit = reply->result();
-        const quint8 slaveAddress = reply->serverAddress();
-        const quint16 startAddress = unit.startAddress();
-
-        if (unit.valueCount() >= 1) {
-            quint16 rawValue = unit.value(0);
-            uint scaledValue = static_cast<uint>(rawValue);
-
-            const auto shiftedAddress = startAddress + CONSTANTS::DIGITAL_INPUT_SHIFT;
-
-            if (Sensor::mapInputPin.contains(shiftedAddress)) {
-                Logger::info(QString("Read slave:%1 address:%2 value:%3")
-                                 .arg(slaveAddress)
-                                 .arg(startAddress)
-                                 .arg(scaledValue));
-
-                Sensor::mapInputPin[shiftedAddress]->setValue(scaledValue);
-            } else {
-                Logger::crit(QString("Sensor not found for slave:%1 address:%2")
-                                 .arg(slaveAddress)
-                                 .arg(startAddress));
-                GlobalErrors::setError(GlobalErrors::DbError);
-            }
-
-            lastDataTime = QDateTime::currentMSecsSinceEpoch();
-        }
-    } else {
-        qDebug() << "Read error:" << reply->errorString();
-    }
-    reply->deleteLater();
-}
-
 void ModbusRTU::onErrorOccurred(QModbusDevice::Error error)
 {
     if (error != QModbusDevice::NoError) {
@@ -443,21 +227,28 @@ void ModbusRTU::onErrorOccurred(QModbusDevice::Error error)
 
 void ModbusRTU::onStateChanged(QModbusDevice::State state)
 {
-    Logger::info(QString("Modbus RTU state changed to: %1").arg(state));
+    Logger::info(QString("Modbus RTU bus '%1' state changed to: %2").arg(config.name).arg(state));
+
+    setConnected(state == QModbusDevice::ConnectedState);
 
     if (state == QModbusDevice::ConnectedState) {
-        Logger::info("Modbus RTU successfully connected");
-        GlobalErrors::removeError(GlobalErrors::ModbusError);
+        Logger::info(QString("Modbus RTU bus '%1' connected on %2 (%3 baud, inter-frame gap %4 us)")
+                         .arg(config.name, config.portName)
+                         .arg(serialSettings.baudRate)
+                         .arg(serialSettings.interFrameDelayUs()));
         retryTimer.stop();
         readTimer.start();  // Restart reading
     }
     else if (state == QModbusDevice::UnconnectedState) {
-        Logger::info("Modbus RTU disconnected - clearing request queue");
-        GlobalErrors::setError(GlobalErrors::ModbusError);
+        Logger::info(QString("Modbus RTU bus '%1' disconnected - clearing request queue").arg(config.name));
         readTimer.stop();  // Stop trying to read while disconnected
         
         // CLEAR THE QUEUE when disconnected
-        requestQueue.clear();
+        if (isProcessingRequest && currentReply) {
+            abandonRequest(currentRequest);
+        }
+        resetRequests();
+        currentReply = nullptr;
         isProcessingRequest = false;
         
         retryTimer.start();
@@ -466,5 +257,9 @@ void ModbusRTU::onStateChanged(QModbusDevice::State state)
 
 void ModbusRTU::connectToDevice()
 {
+    if (postToIoThread([this]() { connectToDevice(); })) {
+        return;
+    }
+
     attemptReconnect();
 }
\ No newline at end of file
@@ -1,73 +1,59 @@
 #ifndef MODBUSRTU_H
 #define MODBUSRTU_H
 
-#include <QObject>
 #include <QtSerialBus/qmodbusrtuserialclient.h>
-#include <QTimer>
-#include <QQueue>
 #include <QDebug>
-#include <functional>
 
-struct ModbusRequest {
-    quint8 slaveAddress;
-    QModbusDataUnit::RegisterType registerType;
-    quint16 startAddress;
-    quint16 count;
-    std::function<void(const QModbusDataUnit&, quint8)> callback;
-    QString description; // For debugging
-};
+#include "modbusmaster.h"
 
-class ModbusRTU : public QObject
+/**
+ * @brief Modbus RTU master of one serial bus, one request on the line at a time.
+ *
+ * Input values are published once per scan cycle as a SensorFrame, see Sensor::frame().
+ */
+class ModbusRTU : public ModbusMaster
 {
     Q_OBJECT
 public:
-    explicit ModbusRTU(QObject *parent = nullptr);
-    static ModbusRTU &instance();
-    static qint64 lastDataTime;
+    explicit ModbusRTU(const BusConfig &config, QObject *parent = nullptr);
 
-    void connectToDevice();
-    void disconnectDevice();
+    void connectToDevice() override;
+    void disconnectDevice() override;
 
-    // Public API - these now queue requests
-    void readHoldingRegisters(quint8 slaveAddress, quint16 startAddr, quint16 count, const QString &description = "");
-    void readDiscreteRegisters(quint8 slaveAddress, quint16 startAddr, quint16 count, const QString &description = "");
-    void writeSingleCoil(quint8 slaveAddress, quint16 coilAddress, bool value, const QString &description = "");
+    const SerialSettings &settings() const { return serialSettings; }
 
-    bool isConnected() const { return modbusDevice && modbusDevice->state() == QModbusDevice::ConnectedState; }
+protected:
+    void dispatch() override;
+    qint64 scanWireTimeUs() const override;
 
 private slots:
-    void onReadReady();
-    void onDigitalInputReady();
     void onErrorOccurred(QModbusDevice::Error error);
     void onStateChanged(QModbusDevice::State state);
     void processNextRequest();
+    void onReplyFinished();
 
 private:
+    // Parented so they follow the object to the I/O thread
     QModbusRtuSerialClient *modbusDevice;
-    QTimer readTimer;
-    QTimer retryTimer;
-    QTimer requestTimer;
+    QTimer retryTimer{this};
+    QTimer requestTimer{this};
+
+    SerialSettings serialSettings;
+    QHash<quint8, int> slaveTurnaroundUs; // From BusConfig, fixed for the lifetime of the bus
 
-    QQueue<ModbusRequest> requestQueue;
+    ModbusRequest currentRequest;
+    BusScheduler::Priority currentPriority = BusScheduler::Periodic;
+    QModbusReply *currentReply = nullptr;
     bool isProcessingRequest = false;
     int retryCount = 0;
 
     static constexpr int WAIT_TIME_MS = 2000;
-    static constexpr int READ_INTERVAL_MS = 1000;
-    static constexpr int REQUEST_DELAY_MS = 50; // Delay between requests
-    static constexpr int MAX_RETRIES = 5;
-    static constexpr int MAX_QUEUE_SIZE = 10; // Reasonable limit
 
     void attemptReconnect();
     void configureConnectionParameters();
-    void queueRequest(const ModbusRequest &request);
-    void startSequentialReading();
-
-    // Helper methods for specific sensor types
-    void handleTemperatureReading(const QModbusDataUnit &unit, quint8 slaveAddress);
-    void handlePressureReading(const QModbusDataUnit &unit, quint8 slaveAddress);
-    void handleLevelReading(const QModbusDataUnit &unit, quint8 slaveAddress);
-    void handleDigitalInputReading(const QModbusDataUnit &unit, quint8 slaveAddress, quint16 startAddress);
+    void handleReply(QModbusReply *reply);
+    void finishRequest();
+    int turnaroundMs(quint8 slaveAddress) const;
 };
 
-#endif // MODBUSRTU_H
\ No newline at end of file
+#endif // MODBUSRTU_H
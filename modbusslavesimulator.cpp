@@ -0,0 +1,277 @@
+#include "modbusslavesimulator.h"
+
+#include <QtMath>
+
+#include "constants.h"
+#include "modbuscrc.h"
+
+namespace {
+    enum FunctionCode : quint8 {
+        ReadCoils = 0x01,
+        ReadDiscreteInputs = 0x02,
+        ReadHoldingRegisters = 0x03,
+        ReadInputRegisters = 0x04,
+        WriteSingleCoil = 0x05,
+        WriteMultipleCoils = 0x0F,
+        WriteMultipleRegisters = 0x10,
+    };
+
+    enum ExceptionCode : quint8 {
+        IllegalFunction = 0x01,
+        IllegalDataAddress = 0x02,
+        IllegalDataValue = 0x03,
+    };
+
+    quint16 word(const QByteArray &data, int index)
+    {
+        return static_cast<quint16>((static_cast<quint8>(data.at(index)) << 8) | static_cast<quint8>(data.at(index + 1)));
+    }
+
+    void appendWord(QByteArray &data, quint16 value)
+    {
+        data.append(static_cast<char>(value >> 8));
+        data.append(static_cast<char>(value & 0xFF));
+    }
+
+    quint16 toRegister(double value, double factor)
+    {
+        return static_cast<quint16>(qBound(0.0, qRound(value * factor) * 1.0, 65535.0));
+    }
+}
+
+ModbusSlaveSimulator::ModbusSlaveSimulator(AutoklavPlant &plant)
+    : plant{plant}
+{
+
+}
+
+qsizetype ModbusSlaveSimulator::expectedRequestLength(const QByteArray &buffer)
+{
+    if (buffer.size() < 2)
+        return -1;
+
+    switch (static_cast<quint8>(buffer.at(1))) {
+    case ReadCoils:
+    case ReadDiscreteInputs:
+    case ReadHoldingRegisters:
+    case ReadInputRegisters:
+    case WriteSingleCoil:
+        return 8;
+    case WriteMultipleCoils:
+    case WriteMultipleRegisters:
+        if (buffer.size() < 7)
+            return -1;
+        return 9 + static_cast<quint8>(buffer.at(6));
+    default:
+        return 0;
+    }
+}
+
+QByteArray ModbusSlaveSimulator::processFrame(const QByteArray &request)
+{
+    const auto *bytes = reinterpret_cast<const quint8 *>(request.constData());
+
+    if (!ModbusCrc::isValid(bytes, request.size())) {
+        badCrc++;
+        return {};
+    }
+
+    const quint8 slave = bytes[0];
+    const quint8 functionCode = bytes[1];
+    const QByteArray pdu = request.mid(1, request.size() - 3);
+
+    const bool broadcast = slave == 0;
+    if (!broadcast && slave != CONSTANTS::CWT_SLAVE_ID && !isAnalogSlave(slave))
+        return {};
+
+    QByteArray response;
+    switch (functionCode) {
+    case ReadCoils:
+    case ReadDiscreteInputs:
+        response = readBits(slave, functionCode, pdu);
+        break;
+    case ReadHoldingRegisters:
+    case ReadInputRegisters:
+        response = readRegisters(slave, functionCode, pdu);
+        break;
+    case WriteSingleCoil:
+        response = writeSingleCoil(slave, pdu);
+        break;
+    case WriteMultipleCoils:
+        response = writeMultipleCoils(slave, pdu);
+        break;
+    default:
+        response = exception(functionCode, IllegalFunction);
+        break;
+    }
+
+    if (broadcast)
+        return {};
+
+    served++;
+    return frame(slave, response);
+}
+
+bool ModbusSlaveSimulator::isAnalogSlave(quint8 slave) const
+{
+    return slave >= CONSTANTS::TEMP && slave <= CONSTANTS::PRESSURE;
+}
+
+bool ModbusSlaveSimulator::readRegister(quint8 slave, quint16 address, quint16 &value) const
+{
+    if (!isAnalogSlave(slave) || address != ANALOG_REGISTER)
+        return false;
+
+    // Raw values are scaled so ModbusRTU reproduces the process values
+    const auto &v = plant.values();
+    switch (slave) {
+    case CONSTANTS::TEMP:             value = toRegister(v.temp, 10); break;
+    case CONSTANTS::TEMP_K:           value = toRegister(v.tempK, 10); break;
+    case CONSTANTS::EXPANSION_TEMP:   value = toRegister(v.expansionTemp, 10); break;
+    case CONSTANTS::HEATER_TEMP:      value = toRegister(v.heaterTemp, 10); break;
+    case CONSTANTS::TANK_TEMP:        value = toRegister(v.tankTemp, 10); break;
+    case CONSTANTS::TANK_WATER_LEVEL: value = toRegister(v.tankWaterLevel, 10); break;
+    case CONSTANTS::STEAM_PRESSURE:   value = toRegister(v.steamPressure, 100); break;
+    case CONSTANTS::PRESSURE:         value = toRegister(v.pressure, 100); break;
+    default:                          return false;
+    }
+
+    return true;
+}
+
+bool ModbusSlaveSimulator::readDiscreteInput(quint8 slave, quint16 address, bool &value) const
+{
+    if (slave != CONSTANTS::CWT_SLAVE_ID)
+        return false;
+
+    const auto &v = plant.values();
+    switch (address) {
+    case CONSTANTS::DOOR_CLOSED:    value = v.doorClosed; break;
+    case CONSTANTS::BURNER_FAULT:   value = v.burnerFault; break;
+    case CONSTANTS::WATER_SHORTAGE: value = v.waterShortage; break;
+    default:                        return false;
+    }
+
+    return true;
+}
+
+QByteArray ModbusSlaveSimulator::readBits(quint8 slave, quint8 functionCode, const QByteArray &pdu)
+{
+    if (pdu.size() != 5)
+        return exception(functionCode, IllegalDataValue);
+
+    const quint16 start = word(pdu, 1);
+    const quint16 count = word(pdu, 3);
+    if (count == 0 || count > 2000)
+        return exception(functionCode, IllegalDataValue);
+
+    QByteArray bits((count + 7) / 8, '\0');
+    for (quint16 i = 0; i < count; i++) {
+        bool value = false;
+
+        if (functionCode == ReadCoils) {
+            if (slave != CONSTANTS::CWT_SLAVE_ID || start + i >= AutoklavPlant::COIL_COUNT)
+                return exception(functionCode, IllegalDataAddress);
+            value = plant.coil(start + i);
+        } else if (!readDiscreteInput(slave, start + i, value)) {
+            return exception(functionCode, IllegalDataAddress);
+        }
+
+        if (value)
+            bits[i / 8] = static_cast<char>(bits.at(i / 8) | (1 << (i % 8)));
+    }
+
+    QByteArray response;
+    response.append(static_cast<char>(functionCode));
+    response.append(static_cast<char>(bits.size()));
+    response.append(bits);
+    return response;
+}
+
+QByteArray ModbusSlaveSimulator::readRegisters(quint8 slave, quint8 functionCode, const QByteArray &pdu)
+{
+    if (pdu.size() != 5)
+        return exception(functionCode, IllegalDataValue);
+
+    const quint16 start = word(pdu, 1);
+    const quint16 count = word(pdu, 3);
+    if (count == 0 || count > 125)
+        return exception(functionCode, IllegalDataValue);
+
+    QByteArray response;
+    response.append(static_cast<char>(functionCode));
+    response.append(static_cast<char>(count * 2));
+
+    for (quint16 i = 0; i < count; i++) {
+        quint16 value = 0;
+        if (!readRegister(slave, start + i, value))
+            return exception(functionCode, IllegalDataAddress);
+        appendWord(response, value);
+    }
+
+    return response;
+}
+
+QByteArray ModbusSlaveSimulator::writeSingleCoil(quint8 slave, const QByteArray &pdu)
+{
+    if (pdu.size() != 5)
+        return exception(WriteSingleCoil, IllegalDataValue);
+
+    const quint16 address = word(pdu, 1);
+    const quint16 value = word(pdu, 3);
+
+    if (value != CONSTANTS::MODBUS_COIL_ON && value != CONSTANTS::MODBUS_COIL_OFF)
+        return exception(WriteSingleCoil, IllegalDataValue);
+
+    if ((slave != CONSTANTS::CWT_SLAVE_ID && slave != 0) || address >= AutoklavPlant::COIL_COUNT)
+        return exception(WriteSingleCoil, IllegalDataAddress);
+
+    plant.setCoil(address, value == CONSTANTS::MODBUS_COIL_ON);
+
+    // Response echoes the request
+    return pdu;
+}
+
+QByteArray ModbusSlaveSimulator::writeMultipleCoils(quint8 slave, const QByteArray &pdu)
+{
+    if (pdu.size() < 6)
+        return exception(WriteMultipleCoils, IllegalDataValue);
+
+    const quint16 start = word(pdu, 1);
+    const quint16 count = word(pdu, 3);
+    const int byteCount = static_cast<quint8>(pdu.at(5));
+
+    if (count == 0 || count > 1968 || byteCount != (count + 7) / 8 || pdu.size() != 6 + byteCount)
+        return exception(WriteMultipleCoils, IllegalDataValue);
+
+    if ((slave != CONSTANTS::CWT_SLAVE_ID && slave != 0) || start + count > AutoklavPlant::COIL_COUNT)
+        return exception(WriteMultipleCoils, IllegalDataAddress);
+
+    for (quint16 i = 0; i < count; i++) {
+        const bool value = static_cast<quint8>(pdu.at(6 + i / 8)) & (1 << (i % 8));
+        plant.setCoil(start + i, value);
+    }
+
+    return pdu.left(5);
+}
+
+QByteArray ModbusSlaveSimulator::exception(quint8 functionCode, quint8 code)
+{
+    QByteArray response;
+    response.append(static_cast<char>(functionCode | 0x80));
+    response.append(static_cast<char>(code));
+    return response;
+}
+
+QByteArray ModbusSlaveSimulator::frame(quint8 slave, const QByteArray &pdu)
+{
+    QByteArray adu;
+    adu.reserve(pdu.size() + 3);
+    adu.append(static_cast<char>(slave));
+    adu.append(pdu);
+
+    const quint16 crc = ModbusCrc::compute(reinterpret_cast<const quint8 *>(adu.constData()), adu.size());
+    adu.append(static_cast<char>(crc & 0xFF));
+    adu.append(static_cast<char>(crc >> 8));
+    return adu;
+}
@@ -0,0 +1,60 @@
+#ifndef MODBUSSLAVESIMULATOR_H
+#define MODBUSSLAVESIMULATOR_H
+
+#include <QByteArray>
+
+#include "autoklavplant.h"
+
+/**
+ * @brief Answers Modbus RTU frames for every slave of the autoklav line from an AutoklavPlant.
+ *
+ * The simulator works on complete RTU frames (address, PDU and CRC) so it can sit behind a serial
+ * port, a pty or be called directly in-process. Supported function codes are FC01, FC02, FC03,
+ * FC04, FC05 and FC15, with the same register layout as the real slaves:
+ *  - CWT slave: coils for the relay outputs, discrete inputs for door, burner and water shortage
+ *  - analog transmitters: one slave per sensor, value in holding (and input) register 1
+ */
+class ModbusSlaveSimulator
+{
+public:
+    explicit ModbusSlaveSimulator(AutoklavPlant &plant);
+
+    /**
+     * @brief Processes one request frame and returns the response frame.
+     *
+     * An empty array is returned when the slave must stay silent (CRC error, unknown slave or
+     * broadcast).
+     */
+    QByteArray processFrame(const QByteArray &request);
+
+    /**
+     * @brief Length of the request frame at the start of \p buffer.
+     *
+     * Returns -1 when more bytes are needed to tell and 0 when the function code is not supported.
+     */
+    static qsizetype expectedRequestLength(const QByteArray &buffer);
+
+    quint64 framesServed() const { return served; }
+    quint64 crcErrors() const { return badCrc; }
+
+private:
+    static constexpr quint16 ANALOG_REGISTER = 1;
+
+    AutoklavPlant &plant;
+    quint64 served = 0;
+    quint64 badCrc = 0;
+
+    bool isAnalogSlave(quint8 slave) const;
+    bool readRegister(quint8 slave, quint16 address, quint16 &value) const;
+    bool readDiscreteInput(quint8 slave, quint16 address, bool &value) const;
+
+    QByteArray readBits(quint8 slave, quint8 functionCode, const QByteArray &pdu);
+    QByteArray readRegisters(quint8 slave, quint8 functionCode, const QByteArray &pdu);
+    QByteArray writeSingleCoil(quint8 slave, const QByteArray &pdu);
+    QByteArray writeMultipleCoils(quint8 slave, const QByteArray &pdu);
+
+    static QByteArray exception(quint8 functionCode, quint8 code);
+    static QByteArray frame(quint8 slave, const QByteArray &pdu);
+};
+
+#endif // MODBUSSLAVESIMULATOR_H
@@ -0,0 +1,102 @@
+#include "modbusstats.h"
+
+ModbusStats::Entry &ModbusStats::entry(quint8 slaveAddress, QModbusDataUnit::RegisterType registerType)
+{
+    const quint16 key = static_cast<quint16>(slaveAddress << 8 | registerType);
+
+    auto it = stats.find(key);
+    if (it == stats.end()) {
+        it = stats.insert(key, Entry());
+        it->slaveAddress = slaveAddress;
+        it->registerType = registerType;
+    }
+
+    return *it;
+}
+
+void ModbusStats::recordReply(quint8 slaveAddress, QModbusDataUnit::RegisterType registerType,
+                              qint64 enqueuedAtNs, qint64 sentAtNs, qint64 finishedAtNs)
+{
+    auto &e = entry(slaveAddress, registerType);
+    e.queueWait.record((sentAtNs - enqueuedAtNs) / 1000);
+    e.response.record((finishedAtNs - sentAtNs) / 1000);
+    e.endToEnd.record((finishedAtNs - enqueuedAtNs) / 1000);
+}
+
+void ModbusStats::recordError(quint8 slaveAddress, QModbusDataUnit::RegisterType registerType, QModbusDevice::Error error)
+{
+    auto &e = entry(slaveAddress, registerType);
+
+    switch (error) {
+    case QModbusDevice::NoError:
+        break;
+    case QModbusDevice::TimeoutError:
+        e.timeouts++;
+        break;
+    case QModbusDevice::ProtocolError:
+        e.exceptions++;
+        break;
+    default:
+        e.otherErrors++;
+        break;
+    }
+}
+
+void ModbusStats::recordCrcError(quint8 slaveAddress, QModbusDataUnit::RegisterType registerType)
+{
+    entry(slaveAddress, registerType).crcErrors++;
+}
+
+void ModbusStats::recordDrop(quint8 slaveAddress, QModbusDataUnit::RegisterType registerType)
+{
+    entry(slaveAddress, registerType).drops++;
+}
+
+void ModbusStats::recordRetry(quint8 slaveAddress, QModbusDataUnit::RegisterType registerType)
+{
+    entry(slaveAddress, registerType).retries++;
+}
+
+void ModbusStats::reset()
+{
+    stats.clear();
+}
+
+QStringList ModbusStats::summary() const
+{
+    QStringList lines;
+
+    for (const auto &e : stats) {
+        lines.append(QString("Slave:%1 %2 n=%3 wait p50/p99/max=%4/%5/%6us "
+                             "response p50/p99/max=%7/%8/%9us")
+                         .arg(e.slaveAddress)
+                         .arg(registerTypeName(e.registerType))
+                         .arg(e.endToEnd.count())
+                         .arg(e.queueWait.valueAtPercentile(50))
+                         .arg(e.queueWait.valueAtPercentile(99))
+                         .arg(e.queueWait.max())
+                         .arg(e.response.valueAtPercentile(50))
+                         .arg(e.response.valueAtPercentile(99))
+                         .arg(e.response.max())
+                     + QString(" timeouts=%1 crc=%2 exceptions=%3 errors=%4 drops=%5 retries=%6")
+                           .arg(e.timeouts)
+                           .arg(e.crcErrors)
+                           .arg(e.exceptions)
+                           .arg(e.otherErrors)
+                           .arg(e.drops)
+                           .arg(e.retries));
+    }
+
+    return lines;
+}
+
+QString ModbusStats::registerTypeName(QModbusDataUnit::RegisterType registerType)
+{
+    switch (registerType) {
+    case QModbusDataUnit::DiscreteInputs:   return "DiscreteInputs";
+    case QModbusDataUnit::Coils:            return "Coils";
+    case QModbusDataUnit::InputRegisters:   return "InputRegisters";
+    case QModbusDataUnit::HoldingRegisters: return "HoldingRegisters";
+    default:                                return "Invalid";
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef MODBUSSTATS_H
+#define MODBUSSTATS_H
+
+#include <QMap>
+#include <QStringList>
+#include <QModbusDevice>
+#include <QModbusDataUnit>
+
+#include "latencyhistogram.h"
+
+/**
+ * @brief Latency histograms and error counters of the Modbus request pipeline.
+ *
+ * Everything is kept per slave and register type. Three durations are recorded for every
+ * completed request: enqueue to send (time spent in the scheduler), send to reply (slave
+ * response time including the line) and enqueue to reply (end to end).
+ */
+class ModbusStats
+{
+public:
+    struct Entry {
+        quint8 slaveAddress = 0;
+        QModbusDataUnit::RegisterType registerType = QModbusDataUnit::Invalid;
+
+        LatencyHistogram queueWait;
+        LatencyHistogram response;
+        LatencyHistogram endToEnd;
+
+        quint64 timeouts = 0;
+        quint64 crcErrors = 0;
+        quint64 exceptions = 0; // Exception responses, reported by Qt as ProtocolError
+        quint64 otherErrors = 0;
+        quint64 drops = 0;
+        quint64 retries = 0;
+    };
+
+    void recordReply(quint8 slaveAddress, QModbusDataUnit::RegisterType registerType,
+                     qint64 enqueuedAtNs, qint64 sentAtNs, qint64 finishedAtNs);
+    void recordError(quint8 slaveAddress, QModbusDataUnit::RegisterType registerType, QModbusDevice::Error error);
+    void recordCrcError(quint8 slaveAddress, QModbusDataUnit::RegisterType registerType);
+    void recordDrop(quint8 slaveAddress, QModbusDataUnit::RegisterType registerType);
+    void recordRetry(quint8 slaveAddress, QModbusDataUnit::RegisterType registerType);
+    void reset();
+
+    const QMap<quint16, Entry> &entries() const { return stats; }
+    QStringList summary() const;
+
+    static QString registerTypeName(QModbusDataUnit::RegisterType registerType);
+
+private:
+    QMap<quint16, Entry> stats;
+
+    Entry &entry(quint8 slaveAddress, QModbusDataUnit::RegisterType registerType);
+};
+
+#endif // MODBUSSTATS_H
@@ -0,0 +1,311 @@
+#include "modbustcp.h"
+#include "modbuspdu.h"
+#include "logger.h"
+
+using ModbusPdu::wordAt;
+
+ModbusTCP::ModbusTCP(const BusConfig &config, QObject *parent)
+    : ModbusMaster{config, "TCP", parent}, socket(new QTcpSocket(this))
+{
+    // Port name is host[:port]
+    const int separator = config.portName.lastIndexOf(':');
+    host = separator < 0 ? config.portName : config.portName.left(separator);
+    if (separator >= 0) {
+        port = static_cast<quint16>(config.portName.mid(separator + 1).toUInt());
+    }
+
+    connect(socket, &QTcpSocket::connected, this, &ModbusTCP::onConnected);
+    connect(socket, &QTcpSocket::disconnected, this, &ModbusTCP::onDisconnected);
+    connect(socket, &QTcpSocket::errorOccurred, this, &ModbusTCP::onErrorOccurred);
+    connect(socket, &QTcpSocket::readyRead, this, &ModbusTCP::onReadyRead);
+
+    // Only runs while transactions are outstanding
+    timeoutTimer.setInterval(TIMEOUT_CHECK_MS);
+    timeoutTimer.setTimerType(Qt::PreciseTimer);
+    connect(&timeoutTimer, &QTimer::timeout, this, &ModbusTCP::checkTimeouts);
+
+    // Also bounds a connection attempt that hangs, the next attempt aborts it
+    retryTimer.setInterval(WAIT_TIME_MS);
+    connect(&retryTimer, &QTimer::timeout, this, &ModbusTCP::attemptReconnect);
+
+    startIoThread();
+}
+
+void ModbusTCP::connectToDevice()
+{
+    if (postToIoThread([this]() { connectToDevice(); })) {
+        return;
+    }
+
+    attemptReconnect();
+}
+
+void ModbusTCP::disconnectDevice()
+{
+    if (postToIoThread([this]() { disconnectDevice(); })) {
+        return;
+    }
+
+    readTimer.stop();
+    retryTimer.stop();
+    timeoutTimer.stop();
+    abandonInFlight();
+    resetRequests();
+
+    socket->disconnectFromHost();
+}
+
+void ModbusTCP::attemptReconnect()
+{
+    if (isConnected()) return;
+
+    // Exponential backoff
+    int backoffDelay = qMin(WAIT_TIME_MS * (1 << qMin(retryCount, 5)), 30000);
+    retryTimer.setInterval(backoffDelay);
+    retryCount++;
+
+    Logger::info(QString("Attempting Modbus TCP connection to %1:%2 (attempt %3, delay %4ms)...")
+                     .arg(host).arg(port).arg(retryCount).arg(backoffDelay));
+
+    socket->abort();
+    receiveBuffer.clear();
+    socket->connectToHost(host, port);
+    retryTimer.start();
+}
+
+void ModbusTCP::onConnected()
+{
+    // Requests are small and latency bound, never hold them back waiting for more data
+    socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    socket->setSocketOption(QAbstractSocket::KeepAliveOption, 1);
+
+    retryCount = 0;
+    retryTimer.stop();
+    setConnected(true);
+
+    Logger::info(QString("Modbus TCP bus '%1' connected to %2:%3 (%4 transactions in flight, scan every %5 ms)")
+                     .arg(config.name, host)
+                     .arg(port)
+                     .arg(qMax(1, config.maxInFlight))
+                     .arg(readTimer.interval()));
+
+    readTimer.start();
+    dispatch();
+}
+
+void ModbusTCP::onDisconnected()
+{
+    Logger::info(QString("Modbus TCP bus '%1' disconnected - clearing request queue").arg(config.name));
+
+    setConnected(false);
+    readTimer.stop();
+    timeoutTimer.stop();
+    abandonInFlight();
+    resetRequests();
+
+    retryTimer.start();
+}
+
+void ModbusTCP::onErrorOccurred(QAbstractSocket::SocketError error)
+{
+    Q_UNUSED(error);
+
+    Logger::crit(QString("Modbus TCP error: %1").arg(socket->errorString()));
+
+    // A failed connection attempt never emits disconnected()
+    if (socket->state() == QAbstractSocket::UnconnectedState && !isConnected()) {
+        retryTimer.start();
+    }
+}
+
+void ModbusTCP::abandonInFlight()
+{
+    const auto transactions = inFlight.values();
+    inFlight.clear();
+
+    for (const auto &transaction : transactions) {
+        abandonRequest(transaction.request);
+    }
+}
+
+quint16 ModbusTCP::allocateTransactionId()
+{
+    // With at most a few transactions outstanding the 16 bit id space is never exhausted
+    while (inFlight.contains(nextTransactionId)) {
+        nextTransactionId++;
+    }
+    return nextTransactionId++;
+}
+
+void ModbusTCP::dispatch()
+{
+    // Everything queued in the same event loop pass, e.g. a whole scan cycle, goes out in one write
+    if (!sendPending) {
+        sendPending = true;
+        QMetaObject::invokeMethod(this, &ModbusTCP::sendRequests, Qt::QueuedConnection);
+    }
+}
+
+void ModbusTCP::sendRequests()
+{
+    sendPending = false;
+
+    if (!isConnected()) {
+        return;
+    }
+
+    const int window = qMax(1, config.maxInFlight);
+    QByteArray batch;
+
+    while (inFlight.size() < window) {
+        ModbusRequest request;
+        BusScheduler::Priority priority;
+        if (!scheduler.dequeue(request, BusScheduler::nowNs(), &priority)) {
+            break;
+        }
+
+        const quint16 transactionId = allocateTransactionId();
+        const QByteArray adu = encodeAdu(request, transactionId);
+
+        request.attempts++;
+        request.sentAtNs = BusScheduler::nowNs();
+
+        if (adu.isEmpty()) {
+            Logger::crit(QString("Unsupported request: %1 - Slave:%2 Addr:%3")
+                             .arg(request.description)
+                             .arg(request.slaveAddress)
+                             .arg(request.startAddress));
+            abandonRequest(request);
+            continue;
+        }
+
+        batch.append(adu);
+        captureFrame(ModbusCapture::Request, request.slaveAddress, adu.mid(MBAP_HEADER_BYTES));
+
+        // Broadcasts are never answered
+        if (request.slaveAddress == 0) {
+            completeRequest(request, priority, QModbusDevice::NoError,
+                            QModbusDataUnit(request.registerType, request.startAddress, request.values), QString());
+            continue;
+        }
+
+        const qint64 timeoutNs = static_cast<qint64>(health.timeoutMs(request.slaveAddress)) * 1000000;
+        inFlight.insert(transactionId, {std::move(request), priority, BusScheduler::nowNs() + timeoutNs});
+    }
+
+    if (batch.isEmpty()) {
+        return;
+    }
+
+    if (socket->write(batch) != batch.size()) {
+        Logger::crit(QString("Modbus TCP write failed: %1").arg(socket->errorString()));
+    }
+
+    if (!inFlight.isEmpty() && !timeoutTimer.isActive()) {
+        timeoutTimer.start();
+    }
+}
+
+void ModbusTCP::onReadyRead()
+{
+    receiveBuffer.append(socket->readAll());
+
+    while (receiveBuffer.size() >= MBAP_HEADER_BYTES) {
+        const quint16 transactionId = wordAt(receiveBuffer, 0);
+        const quint16 protocolId = wordAt(receiveBuffer, 2);
+        const quint16 length = wordAt(receiveBuffer, 4); // Unit id and PDU
+
+        // Without a valid header the stream can't be resynchronized, start over on a new connection
+        if (protocolId != 0 || length < 2 || length > ModbusPdu::MAX_BYTES + 1) {
+            Logger::crit(QString("Modbus TCP bus '%1' received an invalid MBAP header, reconnecting").arg(config.name));
+            receiveBuffer.clear();
+            socket->abort();
+            return;
+        }
+
+        const int frameBytes = MBAP_HEADER_BYTES - 1 + length;
+        if (receiveBuffer.size() < frameBytes) {
+            break;
+        }
+
+        const quint8 unitId = static_cast<quint8>(receiveBuffer[6]);
+        const QByteArray pdu = receiveBuffer.mid(MBAP_HEADER_BYTES, length - 1);
+        receiveBuffer.remove(0, frameBytes);
+
+        handleResponse(transactionId, unitId, pdu);
+    }
+
+    // Refill the window freed by the replies
+    dispatch();
+}
+
+void ModbusTCP::handleResponse(quint16 transactionId, quint8 unitId, const QByteArray &pdu)
+{
+    auto it = inFlight.find(transactionId);
+
+    // Reply to a transaction that already timed out
+    if (it == inFlight.end() || it->request.slaveAddress != unitId) {
+        Logger::debug(QString("Modbus TCP discarding reply to unknown transaction %1 from unit %2").arg(transactionId).arg(unitId));
+        return;
+    }
+
+    const Transaction transaction = *it;
+    inFlight.erase(it);
+
+    captureFrame(ModbusCapture::Response, unitId, pdu);
+
+    QModbusDataUnit result;
+    QString errorString;
+    const auto error = ModbusPdu::decodeResponse(transaction.request, pdu, result, errorString);
+
+    completeRequest(transaction.request, transaction.priority, error, result, errorString);
+
+    if (inFlight.isEmpty()) {
+        timeoutTimer.stop();
+    }
+}
+
+void ModbusTCP::checkTimeouts()
+{
+    const auto now = BusScheduler::nowNs();
+    QList<Transaction> expired;
+
+    for (auto it = inFlight.begin(); it != inFlight.end();) {
+        if (it->deadlineNs <= now) {
+            expired.append(*it);
+            it = inFlight.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (const auto &transaction : expired) {
+        captureFrame(ModbusCapture::Response, transaction.request.slaveAddress, {});
+        completeRequest(transaction.request, transaction.priority, QModbusDevice::TimeoutError, {}, "Response timeout");
+    }
+
+    if (inFlight.isEmpty()) {
+        timeoutTimer.stop();
+    }
+
+    if (!expired.isEmpty()) {
+        dispatch();
+    }
+}
+
+QByteArray ModbusTCP::encodeAdu(const ModbusRequest &request, quint16 transactionId)
+{
+    const QByteArray pdu = ModbusPdu::encodeRequest(request);
+    if (pdu.isEmpty()) {
+        return {};
+    }
+
+    QByteArray adu;
+    adu.reserve(MBAP_HEADER_BYTES + pdu.size());
+    ModbusPdu::appendWord(adu, transactionId);
+    ModbusPdu::appendWord(adu, 0); // Protocol id
+    ModbusPdu::appendWord(adu, static_cast<quint16>(pdu.size() + 1));
+    adu.append(static_cast<char>(request.slaveAddress));
+    adu.append(pdu);
+    return adu;
+}
@@ -0,0 +1,70 @@
+#ifndef MODBUSTCP_H
+#define MODBUSTCP_H
+
+#include <QTcpSocket>
+#include <QByteArray>
+
+#include "modbusmaster.h"
+
+/**
+ * @brief Modbus TCP master of one gateway or device with several transactions in flight.
+ *
+ * Up to BusConfig::maxInFlight requests are outstanding at once, replies are matched to their
+ * request by the MBAP transaction id and may arrive in any order. Requests dequeued together,
+ * possibly for different unit ids, leave in a single write so they share one TCP segment.
+ */
+class ModbusTCP : public ModbusMaster
+{
+    Q_OBJECT
+public:
+    explicit ModbusTCP(const BusConfig &config, QObject *parent = nullptr);
+
+    void connectToDevice() override;
+    void disconnectDevice() override;
+
+protected:
+    void dispatch() override;
+
+private slots:
+    void onConnected();
+    void onDisconnected();
+    void onErrorOccurred(QAbstractSocket::SocketError error);
+    void onReadyRead();
+    void checkTimeouts();
+    void sendRequests();
+
+private:
+    struct Transaction {
+        ModbusRequest request;
+        BusScheduler::Priority priority;
+        qint64 deadlineNs;
+    };
+
+    // Parented so they follow the object to the I/O thread
+    QTcpSocket *socket;
+    QTimer retryTimer{this};
+    QTimer timeoutTimer{this};
+
+    QString host;
+    quint16 port = DEFAULT_PORT;
+
+    QHash<quint16, Transaction> inFlight; // By transaction id
+    quint16 nextTransactionId = 0;
+    QByteArray receiveBuffer;
+    bool sendPending = false;
+    int retryCount = 0;
+
+    static constexpr int WAIT_TIME_MS = 2000;
+    static constexpr int TIMEOUT_CHECK_MS = 10;
+    static constexpr quint16 DEFAULT_PORT = 502;
+    static constexpr int MBAP_HEADER_BYTES = 7;
+
+    void attemptReconnect();
+    void abandonInFlight();
+    quint16 allocateTransactionId();
+    void handleResponse(quint16 transactionId, quint8 unitId, const QByteArray &pdu);
+
+    static QByteArray encodeAdu(const ModbusRequest &request, quint16 transactionId);
+};
+
+#endif // MODBUSTCP_H
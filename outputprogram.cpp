@@ -0,0 +1,60 @@
+#include "outputprogram.h"
+
+#include <QStringList>
+
+bool OutputProgram::isValid() const
+{
+    if (steps.isEmpty() || delayMs < 0)
+        return false;
+
+    for (const auto &step : steps) {
+        if (step.holdMs < 0)
+            return false;
+    }
+
+    return true;
+}
+
+int OutputProgram::durationMs() const
+{
+    int duration = delayMs;
+    for (int i = 0; i + 1 < steps.size(); i++) {
+        duration += steps.at(i).holdMs;
+    }
+    return duration;
+}
+
+QString OutputProgram::toString() const
+{
+    QStringList parts;
+    if (delayMs > 0)
+        parts.append(QString("wait %1 ms").arg(delayMs));
+
+    for (int i = 0; i < steps.size(); i++) {
+        const auto &step = steps.at(i);
+        parts.append(i + 1 < steps.size() ? QString("%1 %2 ms").arg(step.value ? "ON" : "OFF").arg(step.holdMs)
+                                          : QString(step.value ? "ON" : "OFF"));
+    }
+
+    return parts.join(", ");
+}
+
+OutputProgram OutputProgram::pulse(int widthMs)
+{
+    return {0, {{true, widthMs}, {false, 0}}};
+}
+
+OutputProgram OutputProgram::blink(int onMs, int offMs, int cycles)
+{
+    OutputProgram program;
+    for (int i = 0; i < cycles; i++) {
+        program.steps.append({true, onMs});
+        program.steps.append({false, offMs});
+    }
+    return program;
+}
+
+OutputProgram OutputProgram::delayedOff(int delayMs)
+{
+    return {delayMs, {{false, 0}}};
+}
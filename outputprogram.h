@@ -0,0 +1,33 @@
+#ifndef OUTPUTPROGRAM_H
+#define OUTPUTPROGRAM_H
+
+#include <QList>
+#include <QString>
+
+/**
+ * @brief Timed sequence of states of one output, carried out by RelayImage::run() on the bus I/O thread.
+ *
+ * Each step is written and held for its time before the next one is written. Hold times start at
+ * the acknowledge of the write, so a pulse is on the board for at least its width no matter how busy
+ * the bus is. The minimum on and off times of the output still apply and may stretch a step.
+ */
+struct OutputProgram {
+    struct Step {
+        bool value;
+        int holdMs; // Before the next step, ignored on the last one
+    };
+
+    int delayMs = 0; // Before the first step, the output keeps its state meanwhile
+    QList<Step> steps;
+
+    bool isValid() const;
+    bool finalValue() const { return !steps.isEmpty() && steps.last().value; }
+    int durationMs() const;
+    QString toString() const;
+
+    static OutputProgram pulse(int widthMs);
+    static OutputProgram blink(int onMs, int offMs, int cycles);
+    static OutputProgram delayedOff(int delayMs);
+};
+
+#endif // OUTPUTPROGRAM_H
@@ -0,0 +1,203 @@
+#ifndef PINREGISTRY_H
+#define PINREGISTRY_H
+
+#include <QList>
+#include <QtAlgorithms>
+#include <array>
+
+#include "constants.h"
+
+struct SensorValues {
+    // Analog values
+    double temp;
+    double expansionTemp;
+    double heaterTemp;
+    double tankTemp;
+    double tempK;
+    double tankWaterLevel;
+    double pressure;
+    double steamPressure;
+
+    // Digital input values
+    double doorClosed;
+    double burnerFault;
+    double waterShortage;
+
+    quint64 generation = 0; // Sum of the generations of these pins, changes only when a value does
+};
+   
+struct SensorRelayValues{
+    unsigned int fillTankWithWater;
+    unsigned int cooling;
+    unsigned int tankHeating;
+    unsigned int coolingHelper;
+    unsigned int autoklavFill;
+    unsigned int waterDrain;
+    unsigned int heating;
+    unsigned int pump;
+    unsigned int electricHeating;
+    unsigned int increasePressure;
+    unsigned int extensionCooling;
+    unsigned int alarmSignal;    
+};
+
+/**
+ * @brief Pins the process code knows at compile time, the one table SensorValues and
+ * SensorRelayValues are filled from.
+ *
+ * Pin ids are dense slot indices below SLOT_COUNT, checked when compiling. Database rows may add
+ * other pins below SLOT_COUNT, they are only reachable through the bounds checked runtime lookups.
+ */
+namespace PinRegistry {
+    inline constexpr int SLOT_COUNT = 16;
+
+    struct InputPin {
+        ushort id;
+        double SensorValues::*field;
+    };
+
+    struct OutputPin {
+        ushort id;
+        unsigned int SensorRelayValues::*field;
+    };
+
+    inline constexpr std::array<InputPin, 11> INPUTS{{
+        {CONSTANTS::TEMP,                   &SensorValues::temp},
+        {CONSTANTS::TEMP_K,                 &SensorValues::tempK},
+        {CONSTANTS::EXPANSION_TEMP,         &SensorValues::expansionTemp},
+        {CONSTANTS::HEATER_TEMP,            &SensorValues::heaterTemp},
+        {CONSTANTS::TANK_TEMP,              &SensorValues::tankTemp},
+        {CONSTANTS::TANK_WATER_LEVEL,       &SensorValues::tankWaterLevel},
+        {CONSTANTS::STEAM_PRESSURE,         &SensorValues::steamPressure},
+        {CONSTANTS::PRESSURE,               &SensorValues::pressure},
+        {CONSTANTS::DOOR_CLOSED_SHIFTED,    &SensorValues::doorClosed},
+        {CONSTANTS::BURNER_FAULT_SHIFTED,   &SensorValues::burnerFault},
+        {CONSTANTS::WATER_SHORTAGE_SHIFTED, &SensorValues::waterShortage},
+    }};
+
+    inline constexpr std::array<OutputPin, 12> OUTPUTS{{
+        {CONSTANTS::FILL_TANK_WITH_WATER, &SensorRelayValues::fillTankWithWater},
+        {CONSTANTS::COOLING,              &SensorRelayValues::cooling},
+        {CONSTANTS::TANK_HEATING,         &SensorRelayValues::tankHeating},
+        {CONSTANTS::COOLING_HELPER,       &SensorRelayValues::coolingHelper},
+        {CONSTANTS::AUTOKLAV_FILL,        &SensorRelayValues::autoklavFill},
+        {CONSTANTS::WATER_DRAIN,          &SensorRelayValues::waterDrain},
+        {CONSTANTS::STEAM_HEATING,        &SensorRelayValues::heating},
+        {CONSTANTS::PUMP,                 &SensorRelayValues::pump},
+        {CONSTANTS::INCREASE_PRESSURE,    &SensorRelayValues::increasePressure},
+        {CONSTANTS::ALARM_SIGNAL,         &SensorRelayValues::alarmSignal},
+        {CONSTANTS::EXTENSION_COOLING,    &SensorRelayValues::extensionCooling},
+        {CONSTANTS::ELECTRIC_HEATING,     &SensorRelayValues::electricHeating},
+    }};
+
+    template <typename Pins>
+    constexpr bool isDense(const Pins &pins)
+    {
+        for (std::size_t i = 0; i < pins.size(); i++) {
+            if (pins[i].id >= SLOT_COUNT)
+                return false;
+
+            for (std::size_t j = 0; j < i; j++) {
+                if (pins[i].id == pins[j].id)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    static_assert(isDense(INPUTS), "Input pin ids must be unique and below SLOT_COUNT");
+    static_assert(isDense(OUTPUTS), "Output pin ids must be unique and below SLOT_COUNT");
+
+    template <typename Pins>
+    constexpr bool contains(const Pins &pins, ushort id)
+    {
+        for (const auto &pin : pins) {
+            if (pin.id == id)
+                return true;
+        }
+        return false;
+    }
+
+    constexpr bool isInput(ushort id) { return contains(INPUTS, id); }
+    constexpr bool isOutput(ushort id) { return contains(OUTPUTS, id); }
+}
+
+/**
+ * @brief Dense table of configured pins indexed by pin id, replacing map lookups on the hot path.
+ *
+ * Slots exist for every id below SLOT_COUNT, the configured mask tells which ones were loaded from
+ * the database. Elements never move, references stay valid for the lifetime of the process.
+ */
+template <typename T>
+class PinSlots
+{
+public:
+    PinSlots()
+    {
+        for (int i = 0; i < PinRegistry::SLOT_COUNT; i++)
+            slots[i].id = ushort(i);
+    }
+
+    /**
+     * @brief Configures the slot of the pin, false if the id doesn't fit in the table.
+     */
+    bool add(const T &pin)
+    {
+        if (pin.id >= PinRegistry::SLOT_COUNT)
+            return false;
+
+        slots[pin.id] = pin;
+        configured |= 1u << pin.id;
+        return true;
+    }
+
+    bool contains(ushort id) const { return id < PinRegistry::SLOT_COUNT && (configured & (1u << id)); }
+
+    T *find(ushort id) { return contains(id) ? &slots[id] : nullptr; }
+    const T *find(ushort id) const { return contains(id) ? &slots[id] : nullptr; }
+
+    /**
+     * @brief Slot of a compile time id, no bounds or configuration check at run time.
+     */
+    template <ushort Id>
+    T &at()
+    {
+        static_assert(Id < PinRegistry::SLOT_COUNT, "Pin id outside of the registry");
+        return slots[Id];
+    }
+
+    quint32 mask() const { return configured; }
+    int size() const { return qPopulationCount(configured); }
+
+    QList<ushort> ids() const
+    {
+        QList<ushort> result;
+        forEach([&result](const T &pin) { result.append(pin.id); });
+        return result;
+    }
+
+    // Configured pins in id order
+    template <typename F>
+    void forEach(F f)
+    {
+        for (int i = 0; i < PinRegistry::SLOT_COUNT; i++) {
+            if (configured & (1u << i))
+                f(slots[i]);
+        }
+    }
+
+    template <typename F>
+    void forEach(F f) const
+    {
+        for (int i = 0; i < PinRegistry::SLOT_COUNT; i++) {
+            if (configured & (1u << i))
+                f(slots[i]);
+        }
+    }
+
+private:
+    std::array<T, PinRegistry::SLOT_COUNT> slots{};
+    quint32 configured = 0;
+};
+
+#endif // PINREGISTRY_H
@@ -0,0 +1,569 @@
+#include "relayimage.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include "constants.h"
+#include "globals.h"
+#include "logger.h"
+#include "modbusbuses.h"
+
+void RelayImage::begin()
+{
+    depth++;
+}
+
+void RelayImage::commit()
+{
+    if (depth == 0)
+        return;
+
+    if (--depth == 0)
+        flush();
+}
+
+void RelayImage::stage(ushort coil, bool value)
+{
+    // Same coil toggled twice in one tick, keep both edges on the wire
+    if (staged.contains(coil) && staged.value(coil) != value)
+        flush();
+
+    staged.insert(coil, value);
+
+    if (!isStaging())
+        flush();
+}
+
+void RelayImage::flush()
+{
+    QList<Write> writes;
+    QList<QPair<ushort, int>> holds;
+
+    {
+        QMutexLocker locker(&mutex);
+        const auto nowNs = BusScheduler::nowNs();
+
+        QList<ushort> changed;
+        for (auto it = staged.cbegin(); it != staged.cend(); ++it) {
+            auto &coil = coils[it.key()];
+            const bool requestChanged = coil.requested != it.value();
+
+            // The process takes the coil over from a running program. A step it held back was to be
+            // resumed by runStep(), which now stops, so the hold is registered again for the process.
+            if (coil.programId) {
+                coil.programId = 0;
+                coil.holding = false;
+            }
+            coil.requested = it.value();
+
+            if (holdChange(it.key(), coil, nowNs, holds))
+                continue;
+
+            // A coil in an unknown or failed state is rewritten even if the request did not change
+            if (requestChanged || coil.state == Unknown || coil.state == Failed)
+                changed.append(it.key());
+        }
+        staged.clear();
+
+        writes = buildWrites(changed);
+    }
+
+    // Sent without the lock, a dropped request reports back synchronously
+    send(writes);
+    startHolds(holds);
+}
+
+int RelayImage::remainingHoldMs(const Coil &coil, bool value, qint64 nowNs)
+{
+    if (value == coil.actual || coil.changedAtNs == 0)
+        return 0;
+
+    const qint64 elapsedMs = (nowNs - coil.changedAtNs) / 1000000;
+    return static_cast<int>(qMax<qint64>(0, (coil.actual ? coil.minOnMs : coil.minOffMs) - elapsedMs));
+}
+
+bool RelayImage::holdChange(ushort id, Coil &coil, qint64 nowNs, QList<QPair<ushort, int>> &holds)
+{
+    const auto waitMs = remainingHoldMs(coil, coil.requested && coil.inhibited == 0, nowNs);
+    if (waitMs == 0) {
+        coil.holding = false;
+        return false;
+    }
+
+    // One release per hold, later requests only update the requested state
+    if (!coil.holding) {
+        coil.holding = true;
+        holds.append({id, waitMs});
+    }
+    return true;
+}
+
+void RelayImage::startHolds(const QList<QPair<ushort, int>> &holds)
+{
+    for (const auto &hold : holds) {
+        Logger::debug(QString("Relay %1 change held back %2 ms by its minimum on/off time").arg(hold.first).arg(hold.second));
+
+        const auto coil = hold.first;
+        ModbusBuses::instance().runAfter(CONSTANTS::CWT_SLAVE_ID, hold.second, [coil]() {
+            RelayImage::instance().releaseHold(coil);
+        });
+    }
+}
+
+void RelayImage::releaseHold(ushort coil)
+{
+    QList<Write> writes;
+    QList<QPair<ushort, int>> holds;
+
+    {
+        QMutexLocker locker(&mutex);
+
+        auto &c = coils[coil];
+        if (!c.holding)
+            return;
+
+        // The coil may have switched again meanwhile, e.g. by a program step
+        c.holding = false;
+        if (!holdChange(coil, c, BusScheduler::nowNs(), holds) && output(c) != c.actual)
+            writes = buildWrites({coil});
+    }
+
+    send(writes);
+    startHolds(holds);
+}
+
+QList<RelayImage::Write> RelayImage::buildWrites(const QList<ushort> &changed)
+{
+    QList<Write> writes;
+
+    // Changed coils are sorted. Unchanged coils between two changed ones are rewritten with their
+    // requested state when that keeps the range in a single frame.
+    int i = 0;
+    while (i < changed.size()) {
+        const ushort start = changed.at(i);
+        ushort end = start;
+
+        int j = i + 1;
+        while (j < changed.size()) {
+            bool gapKnown = true;
+            for (ushort coil = end + 1; coil < changed.at(j); coil++) {
+                if (!coils.contains(coil)) {
+                    gapKnown = false;
+                    break;
+                }
+            }
+
+            if (!gapKnown)
+                break;
+
+            end = changed.at(j);
+            j++;
+        }
+
+        Write write{start, {}};
+        write.values.reserve(end - start + 1);
+        for (ushort coil = start; coil <= end; coil++) {
+            auto &c = coils[coil];
+            c.pendingWrites++;
+            c.state = Pending;
+            write.values.append(output(c) ? 1 : 0);
+        }
+
+        writes.append(write);
+        i = j;
+    }
+
+    return writes;
+}
+
+void RelayImage::send(const QList<Write> &writes, BusScheduler::Priority priority, std::function<void(bool)> done)
+{
+    if (writes.isEmpty()) {
+        if (done)
+            done(true);
+        return;
+    }
+
+    // done is called once, after the last write, a dropped write reports back on the calling thread
+    struct Outstanding {
+        std::atomic<int> remaining;
+        std::atomic<bool> ok{true};
+    };
+    auto outstanding = std::make_shared<Outstanding>();
+    outstanding->remaining = writes.size();
+
+    for (const auto &write : writes) {
+        ModbusBuses::instance().writeMultipleCoils(CONSTANTS::CWT_SLAVE_ID, write.start, write.values, "", priority,
+                                                   [write, outstanding, done](bool ok) {
+            RelayImage::instance().writeFinished(write, ok);
+
+            if (!ok)
+                outstanding->ok = false;
+            if (--outstanding->remaining == 0 && done)
+                done(outstanding->ok);
+        });
+    }
+}
+
+void RelayImage::writeFinished(const Write &write, bool ok)
+{
+    QMutexLocker locker(&mutex);
+
+    for (int i = 0; i < write.values.size(); i++) {
+        auto &coil = coils[write.start + i];
+        coil.pendingWrites = qMax(0, coil.pendingWrites - 1);
+
+        if (ok && coil.actual != (write.values.at(i) != 0)) {
+            coil.actual = !coil.actual;
+            coil.changedAtNs = BusScheduler::nowNs();
+        }
+
+        // A newer write of the same coil decides its state
+        if (coil.pendingWrites > 0)
+            continue;
+
+        coil.state = ok && coil.actual == output(coil) ? Confirmed : Failed;
+    }
+
+    if (!ok) {
+        Logger::crit(QString("Relay write of coils %1-%2 failed, retried on the next reconciliation")
+                         .arg(write.start)
+                         .arg(write.start + write.values.size() - 1));
+    }
+}
+
+void RelayImage::startReconciliation(const QMap<ushort, bool> &requested)
+{
+    {
+        QMutexLocker locker(&mutex);
+        for (auto it = requested.cbegin(); it != requested.cend(); ++it) {
+            coils[it.key()].requested = it.value();
+        }
+    }
+
+    reconcileTimer.setInterval(Globals::relayReconcileTick);
+    QObject::connect(&reconcileTimer, &QTimer::timeout, [this]() { reconcile(); });
+    reconcileTimer.start();
+}
+
+void RelayImage::reconcile()
+{
+    ushort first;
+    ushort count;
+
+    {
+        QMutexLocker locker(&mutex);
+
+        if (readBackPending || coils.isEmpty())
+            return;
+
+        readBackPending = true;
+        first = coils.firstKey();
+        count = coils.lastKey() - first + 1;
+    }
+
+    // One FC01 request for the whole board
+    ModbusBuses::instance().readCoils(CONSTANTS::CWT_SLAVE_ID, first, count, [first](bool ok, const QList<quint16> &values) {
+        RelayImage::instance().readBackFinished(first, ok, values);
+    });
+}
+
+void RelayImage::readBackFinished(ushort first, bool ok, const QList<quint16> &values)
+{
+    QList<Write> writes;
+
+    {
+        QMutexLocker locker(&mutex);
+        readBackPending = false;
+
+        if (!ok) {
+            Logger::debug("Relay read back failed");
+            return;
+        }
+
+        QList<ushort> mismatched;
+        for (auto it = coils.begin(); it != coils.end(); ++it) {
+            const int offset = it.key() - first;
+            if (offset < 0 || offset >= values.size())
+                continue;
+
+            // The acknowledge of a write in flight decides the state
+            auto &coil = it.value();
+            if (coil.pendingWrites > 0)
+                continue;
+
+            if (coil.actual != (values.at(offset) != 0)) {
+                coil.actual = !coil.actual;
+                coil.changedAtNs = BusScheduler::nowNs();
+            }
+
+            if (coil.actual == output(coil)) {
+                coil.state = Confirmed;
+                continue;
+            }
+
+            Logger::warn(QString("Relay %1 reads %2 but %3 is requested, rewriting")
+                             .arg(it.key())
+                             .arg(coil.actual ? "ON" : "OFF")
+                             .arg(output(coil) ? "ON" : "OFF"));
+            coil.state = Failed;
+            mismatched.append(it.key());
+        }
+
+        writes = buildWrites(mismatched);
+    }
+
+    send(writes);
+}
+
+void RelayImage::emergencyStop(const QList<ushort> &coilsOff)
+{
+    Write write;
+
+    {
+        QMutexLocker locker(&mutex);
+
+        // Programs are stopped and minimum on times don't apply
+        for (const auto coil : coilsOff) {
+            auto &c = coils[coil];
+            c.requested = false;
+            c.holding = false;
+            c.programId = 0;
+            staged.remove(coil);
+        }
+
+        if (coils.isEmpty())
+            return;
+
+        // The whole board in one frame, coils that stay on are written with their requested state
+        write.start = coils.firstKey();
+        for (ushort coil = write.start; coil <= coils.lastKey(); coil++) {
+            auto &c = coils[coil];
+            c.pendingWrites++;
+            c.state = Pending;
+            write.values.append(output(c) ? 1 : 0);
+        }
+    }
+
+    ModbusBuses::instance().emergencyStop(CONSTANTS::CWT_SLAVE_ID, write.start, write.values,
+                                          [write](bool written, const QList<quint16> &readBack, qint64 latencyUs) {
+        RelayImage::instance().emergencyStopFinished(write, written, readBack, latencyUs);
+    });
+}
+
+void RelayImage::emergencyStopFinished(const Write &write, bool written, const QList<quint16> &readBack, qint64 latencyUs)
+{
+    writeFinished(write, written);
+
+    bool verified = written && readBack.size() >= write.values.size();
+    for (int i = 0; verified && i < write.values.size(); i++) {
+        verified = (readBack.at(i) != 0) == (write.values.at(i) != 0);
+    }
+
+    {
+        QMutexLocker locker(&mutex);
+        emergencyStopResult = {latencyUs, verified};
+    }
+
+    // Mismatching coils are rewritten right away
+    readBackFinished(write.start, !readBack.isEmpty(), readBack);
+
+    if (verified) {
+        Logger::warn(QString("Emergency stop verified in %1 ms").arg(latencyUs / 1000.0, 0, 'f', 1));
+    } else {
+        Logger::crit(QString("Emergency stop NOT verified after %1 ms (write %2)")
+                         .arg(latencyUs / 1000.0, 0, 'f', 1)
+                         .arg(written ? "acknowledged" : "failed"));
+    }
+}
+
+void RelayImage::inhibit(const QList<ushort> &coilsOff, std::function<void(bool)> done)
+{
+    QList<Write> writes;
+
+    {
+        QMutexLocker locker(&mutex);
+
+        // Written even if already off, the board may disagree with the image
+        QList<ushort> changed;
+        for (const auto coil : coilsOff) {
+            coils[coil].inhibited++;
+            if (!changed.contains(coil))
+                changed.append(coil);
+        }
+        std::sort(changed.begin(), changed.end());
+
+        writes = buildWrites(changed);
+    }
+
+    send(writes, BusScheduler::Safety, done);
+}
+
+void RelayImage::release(const QList<ushort> &coilsReleased)
+{
+    QList<Write> writes;
+    QList<QPair<ushort, int>> holds;
+
+    {
+        QMutexLocker locker(&mutex);
+        const auto nowNs = BusScheduler::nowNs();
+
+        QList<ushort> changed;
+        for (const auto coil : coilsReleased) {
+            auto &c = coils[coil];
+            c.inhibited = qMax(0, c.inhibited - 1);
+
+            // Coils the process wants on are switched back on, once their minimum off time has passed
+            if (holdChange(coil, c, nowNs, holds))
+                continue;
+
+            if (output(c) && !changed.contains(coil))
+                changed.append(coil);
+        }
+        std::sort(changed.begin(), changed.end());
+
+        writes = buildWrites(changed);
+    }
+
+    send(writes);
+    startHolds(holds);
+}
+
+bool RelayImage::run(ushort coil, const OutputProgram &program)
+{
+    if (!program.isValid()) {
+        Logger::crit(QString("Relay %1 program '%2' is not valid").arg(coil).arg(program.toString()));
+        return false;
+    }
+
+    quint64 programId;
+
+    {
+        QMutexLocker locker(&mutex);
+
+        auto &c = coils[coil];
+        staged.remove(coil);
+        c.program = program;
+        c.programId = programId = ++lastProgramId;
+    }
+
+    Logger::debug(QString("Relay %1 program: %2").arg(coil).arg(program.toString()));
+
+    if (program.delayMs > 0) {
+        ModbusBuses::instance().runAfter(CONSTANTS::CWT_SLAVE_ID, program.delayMs, [coil, programId]() {
+            RelayImage::instance().runStep(coil, programId, 0);
+        });
+    } else {
+        runStep(coil, programId, 0);
+    }
+
+    return true;
+}
+
+void RelayImage::runStep(ushort coil, quint64 programId, int step)
+{
+    QList<Write> writes;
+    int waitMs;
+    int holdMs;
+    bool last;
+
+    {
+        QMutexLocker locker(&mutex);
+
+        // Replaced by another program, taken over by the process or stopped
+        auto &c = coils[coil];
+        if (c.programId != programId)
+            return;
+
+        const auto &programStep = c.program.steps.at(step);
+        c.requested = programStep.value;
+        holdMs = programStep.holdMs;
+        last = step + 1 == c.program.steps.size();
+
+        // A step shorter than the minimum on or off time is stretched
+        waitMs = remainingHoldMs(c, c.requested && c.inhibited == 0, BusScheduler::nowNs());
+        c.holding = waitMs > 0;
+
+        if (!c.holding) {
+            if (last)
+                c.programId = 0;
+            writes = buildWrites({coil});
+        }
+    }
+
+    if (waitMs > 0) {
+        ModbusBuses::instance().runAfter(CONSTANTS::CWT_SLAVE_ID, waitMs, [coil, programId, step]() {
+            RelayImage::instance().runStep(coil, programId, step);
+        });
+        return;
+    }
+
+    if (last) {
+        send(writes);
+        return;
+    }
+
+    // The hold time starts at the acknowledge, a failed step is retried by the reconciliation
+    send(writes, BusScheduler::Control, [coil, programId, step, holdMs](bool) {
+        ModbusBuses::instance().runAfter(CONSTANTS::CWT_SLAVE_ID, holdMs, [coil, programId, step]() {
+            RelayImage::instance().runStep(coil, programId, step + 1);
+        });
+    });
+}
+
+void RelayImage::setMinimumTimes(ushort coil, int minOnMs, int minOffMs)
+{
+    QMutexLocker locker(&mutex);
+
+    auto &c = coils[coil];
+    c.minOnMs = qMax(0, minOnMs);
+    c.minOffMs = qMax(0, minOffMs);
+}
+
+RelayImage::EmergencyStopResult RelayImage::lastEmergencyStop() const
+{
+    QMutexLocker locker(&mutex);
+    return emergencyStopResult;
+}
+
+bool RelayImage::actualState(ushort coil) const
+{
+    QMutexLocker locker(&mutex);
+    return coils.value(coil).actual;
+}
+
+quint32 RelayImage::actualStates() const
+{
+    QMutexLocker locker(&mutex);
+
+    quint32 states = 0;
+    for (auto it = coils.cbegin(); it != coils.cend(); ++it) {
+        if (it.key() < 32 && it->actual)
+            states |= 1u << it.key();
+    }
+    return states;
+}
+
+RelayImage::CoilState RelayImage::state(ushort coil) const
+{
+    QMutexLocker locker(&mutex);
+    return coils.value(coil).state;
+}
+
+QString RelayImage::stateName(CoilState state)
+{
+    switch (state) {
+    case Unknown:   return "Unknown";
+    case Pending:   return "Pending";
+    case Confirmed: return "Confirmed";
+    case Failed:    return "Failed";
+    }
+    return "Unknown";
+}
+
+RelayImage &RelayImage::instance()
+{
+    static RelayImage _instance;
+    return _instance;
+}
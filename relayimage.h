@@ -0,0 +1,162 @@
+#ifndef RELAYIMAGE_H
+#define RELAYIMAGE_H
+
+#include <QMap>
+#include <QList>
+#include <QMutex>
+#include <QTimer>
+#include <functional>
+
+#include "busscheduler.h"
+#include "outputprogram.h"
+
+/**
+ * @brief Shadow image of the relay board outputs.
+ *
+ * While a transaction is open, output changes are only staged. On commit, coils that differ from
+ * the requested state are sent as one FC15 frame per contiguous range instead of one FC05 frame
+ * per output. Outside of a transaction every change is written immediately.
+ *
+ * Every coil also tracks what the board really does: writes are confirmed by their acknowledge and
+ * all coils are periodically read back with a single FC01 request. Coils whose write failed or that
+ * read back different from the requested state (e.g. after a PLC restart) are rewritten.
+ *
+ * An emergency stop bypasses the normal write path, see emergencyStop(). Interlocks inhibit coils:
+ * an inhibited coil is held off on the board whatever the process requests, and gets its requested
+ * state back once the last interlock releases it.
+ *
+ * Timed outputs (pulses, blinking, delayed off) are carried out as an OutputProgram, see run().
+ * Coils may have a minimum on and off time: a change requested earlier is held back until the time
+ * has passed, limiting relay chatter. Interlocks and the emergency stop are never held back.
+ */
+class RelayImage
+{
+public:
+    enum CoilState {
+        Unknown,   // Neither acknowledged nor read back yet
+        Pending,   // Write sent, not acknowledged yet
+        Confirmed, // Board state matches the requested state
+        Failed     // Write failed or board state differs, rewritten on the next reconciliation
+    };
+
+    /**
+     * @brief RAII helper, opens a transaction on construction and commits it on destruction.
+     */
+    class Transaction
+    {
+    public:
+        Transaction() { RelayImage::instance().begin(); }
+        ~Transaction() { RelayImage::instance().commit(); }
+
+        Transaction(const Transaction&) = delete;
+        Transaction& operator=(const Transaction &) = delete;
+    };
+
+    RelayImage(const RelayImage&) = delete;
+    RelayImage& operator=(const RelayImage &) = delete;
+
+    void begin();
+    void commit();
+    void stage(ushort coil, bool value);
+
+    bool isStaging() const { return depth > 0; }
+
+    /**
+     * @brief Registers the coils with their initial requested state and starts the periodic read back.
+     */
+    void startReconciliation(const QMap<ushort, bool> &requested);
+    void reconcile();
+
+    /**
+     * @brief Switches \p coils off at once: one FC15 frame with the whole board at safety priority,
+     * verified by a read back, see ModbusMaster::emergencyStop(). Staged changes of these coils are discarded.
+     */
+    void emergencyStop(const QList<ushort> &coilsOff);
+
+    struct EmergencyStopResult {
+        qint64 latencyUs = 0; // From the request until the read back, 0 if none yet
+        bool verified = false;
+    };
+
+    EmergencyStopResult lastEmergencyStop() const;
+
+    /**
+     * @brief Holds \p coils off and writes them at safety priority, \p done gets the write result.
+     * Safe to call from any thread.
+     */
+    void inhibit(const QList<ushort> &coilsOff, std::function<void(bool ok)> done = nullptr);
+    void release(const QList<ushort> &coilsReleased);
+
+    /**
+     * @brief Runs \p program on \p coil, timed by the bus I/O thread. It replaces a program already
+     * running on the coil and is cancelled when the process sets the coil or by an emergency stop.
+     */
+    bool run(ushort coil, const OutputProgram &program);
+
+    void setMinimumTimes(ushort coil, int minOnMs, int minOffMs);
+
+    // Safe to call from any thread
+    bool actualState(ushort coil) const;
+    quint32 actualStates() const; // Bit per coil below 32, one lock for all of them
+    CoilState state(ushort coil) const;
+
+    static QString stateName(CoilState state);
+    static RelayImage &instance();
+
+private:
+    RelayImage() = default;
+
+    struct Coil {
+        bool requested = false; // Last state set by the process
+        bool actual = false;    // Last state acknowledged or read back
+        CoilState state = Unknown;
+        int pendingWrites = 0;
+        int inhibited = 0;      // Interlocks holding the coil off
+        int minOnMs = 0;
+        int minOffMs = 0;
+        qint64 changedAtNs = 0; // Last change of the actual state, 0 if never changed
+        bool holding = false;   // Requested change held back by the minimum on or off time
+        OutputProgram program;
+        quint64 programId = 0;  // Running program, 0 if none
+    };
+
+    // State written to the board
+    static bool output(const Coil &coil)
+    {
+        if (coil.inhibited > 0)
+            return false;
+
+        return coil.holding ? coil.actual : coil.requested;
+    }
+
+    // Time left until the coil may switch to value
+    static int remainingHoldMs(const Coil &coil, bool value, qint64 nowNs);
+
+    struct Write {
+        ushort start;
+        QList<quint16> values;
+    };
+
+    mutable QMutex mutex; // Coils are updated from the bus I/O thread
+    QMap<ushort, Coil> coils;
+    QMap<ushort, bool> staged; // Changes requested in the open transaction
+    int depth = 0;
+    bool readBackPending = false;
+    QTimer reconcileTimer;
+    EmergencyStopResult emergencyStopResult;
+    quint64 lastProgramId = 0;
+
+    void flush();
+    bool holdChange(ushort id, Coil &coil, qint64 nowNs, QList<QPair<ushort, int>> &holds);
+    void startHolds(const QList<QPair<ushort, int>> &holds);
+    void releaseHold(ushort coil);
+    void runStep(ushort coil, quint64 programId, int step);
+    QList<Write> buildWrites(const QList<ushort> &changed);
+    void send(const QList<Write> &writes, BusScheduler::Priority priority = BusScheduler::Control,
+              std::function<void(bool ok)> done = nullptr);
+    void writeFinished(const Write &write, bool ok);
+    void readBackFinished(ushort first, bool ok, const QList<quint16> &values);
+    void emergencyStopFinished(const Write &write, bool written, const QList<quint16> &readBack, qint64 latencyUs);
+};
+
+#endif // RELAYIMAGE_H
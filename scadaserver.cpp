@@ -0,0 +1,171 @@
+#include "scadaserver.h"
+
+#include <QCoreApplication>
+#include <cstring>
+
+#include "logger.h"
+#include "relayimage.h"
+#include "sensor.h"
+
+ScadaServer::ScadaServer(QObject *parent)
+    : QModbusTcpServer{parent}
+{
+    setServerAddress(1);
+
+    connect(this, &QModbusDevice::errorOccurred, this, [this](QModbusDevice::Error error) {
+        if (error != QModbusDevice::NoError) {
+            Logger::crit(QString("SCADA server error: %1").arg(errorString()));
+        }
+    });
+}
+
+ScadaServer &ScadaServer::instance()
+{
+    static ScadaServer _instance;
+    return _instance;
+}
+
+void ScadaServer::start(int port, const QVector<ScanChannel> &channels)
+{
+    if (port <= 0) {
+        Logger::info("SCADA server disabled");
+        return;
+    }
+
+    setChannels(channels);
+
+    serverThread.setObjectName("SCADA server");
+    moveToThread(&serverThread);
+    serverThread.start();
+
+    QMetaObject::invokeMethod(this, [this, port]() {
+        setConnectionParameter(QModbusDevice::NetworkAddressParameter, "0.0.0.0");
+        setConnectionParameter(QModbusDevice::NetworkPortParameter, port);
+
+        if (connectDevice()) {
+            Logger::info(QString("SCADA server listening on port %1").arg(port));
+        } else {
+            Logger::crit(QString("SCADA server unable to listen on port %1: %2").arg(port).arg(errorString()));
+        }
+    }, Qt::QueuedConnection);
+}
+
+void ScadaServer::shutdown()
+{
+    if (!serverThread.isRunning())
+        return;
+
+    // Closed on its own thread, then handed back so it is destroyed on the main thread
+    QMetaObject::invokeMethod(this, [this]() {
+        disconnectDevice();
+        moveToThread(QCoreApplication::instance()->thread());
+    }, Qt::BlockingQueuedConnection);
+
+    serverThread.quit();
+    serverThread.wait();
+}
+
+void ScadaServer::setChannels(const QVector<ScanChannel> &channels)
+{
+    if (QThread::currentThread() != thread()) {
+        QMetaObject::invokeMethod(this, [this, channels]() { setChannels(channels); }, Qt::QueuedConnection);
+        return;
+    }
+
+    registers.clear();
+    discreteInputs.clear();
+    registerEnd = 0;
+    discreteInputEnd = 0;
+
+    for (const auto &channel : channels) {
+        if (channel.scadaRegister < 0 || channel.pinId >= SensorFrame::PIN_COUNT)
+            continue;
+
+        const auto address = static_cast<quint16>(channel.scadaRegister);
+        if (registers.contains(address) || registers.contains(address + 1)) {
+            Logger::crit(QString("SCADA register %1 of input pin %2 overlaps another pin, not served").arg(address).arg(channel.pinId));
+            continue;
+        }
+
+        registers.insert(address, {channel.pinId, true});
+        registers.insert(address + 1, {channel.pinId, false});
+        registerEnd = qMax<quint16>(registerEnd, address + 2);
+
+        if (channel.dataType == ScanChannel::Bool) {
+            discreteInputs.insert(address, channel.pinId);
+            discreteInputEnd = qMax<quint16>(discreteInputEnd, address + 1);
+        }
+    }
+
+    coilEnd = 0;
+    Sensor::outputPins.forEach([this](const Sensor &pin) {
+        coilEnd = qMax<quint16>(coilEnd, pin.id + 1);
+    });
+
+    Logger::info(QString("SCADA server serves %1 input pins and %2 relays").arg(registers.size() / 2).arg(Sensor::outputPins.size()));
+}
+
+bool ScadaServer::readData(QModbusDataUnit *newData) const
+{
+    const int start = newData->startAddress();
+    const int end = start + static_cast<int>(newData->valueCount());
+
+    // Addresses between mapped ones read as 0, past the last one are an illegal data address
+    switch (newData->registerType()) {
+    case QModbusDataUnit::Coils: {
+        if (end > coilEnd)
+            return false;
+
+        const quint32 relays = RelayImage::instance().actualStates() & Sensor::outputPins.mask();
+        for (int address = start; address < end; address++) {
+            newData->setValue(address - start, (relays >> address) & 1u);
+        }
+        return true;
+    }
+
+    case QModbusDataUnit::DiscreteInputs: {
+        if (end > discreteInputEnd)
+            return false;
+
+        const auto frame = Sensor::frame();
+        for (int address = start; address < end; address++) {
+            const auto it = discreteInputs.constFind(address);
+            newData->setValue(address - start, it != discreteInputs.cend() && frame.value[*it] != 0 ? 1 : 0);
+        }
+        return true;
+    }
+
+    case QModbusDataUnit::InputRegisters:
+    case QModbusDataUnit::HoldingRegisters: {
+        if (end > registerEnd)
+            return false;
+
+        // One consistent frame for the whole request, both words of a value come from the same scan
+        const auto frame = Sensor::frame();
+        for (int address = start; address < end; address++) {
+            const auto it = registers.constFind(address);
+            if (it == registers.cend()) {
+                newData->setValue(address - start, 0);
+                continue;
+            }
+
+            const float value = static_cast<float>(frame.value[it->pinId]);
+            quint32 bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            newData->setValue(address - start, static_cast<quint16>(it->highWord ? bits >> 16 : bits & 0xFFFF));
+        }
+        return true;
+    }
+
+    default:
+        return false;
+    }
+}
+
+bool ScadaServer::writeData(const QModbusDataUnit &newData)
+{
+    Q_UNUSED(newData);
+
+    // Outputs are controlled by the process only
+    return false;
+}
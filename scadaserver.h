@@ -0,0 +1,57 @@
+#ifndef SCADASERVER_H
+#define SCADASERVER_H
+
+#include <QModbusTcpServer>
+#include <QHash>
+#include <QThread>
+
+#include "scanplan.h"
+
+/**
+ * @brief Read only Modbus TCP server for the plant SCADA, answered from the in-memory image.
+ *
+ * Requests never reach the serial buses. Input pins with a scadaRegister in InputPin are served as
+ * float32 process values (high word first) at that address, with FC03 and FC04 alike. Bool pins are
+ * also served as discrete inputs at the same address, relays as coils at their output pin id with the
+ * state last acknowledged or read back from the board. Writes are answered with an exception.
+ *
+ * Runs on its own thread so any number of clients never delays the main event loop.
+ */
+class ScadaServer : public QModbusTcpServer
+{
+    Q_OBJECT
+public:
+    static ScadaServer &instance();
+
+    /**
+     * @brief Starts listening on \p port of all interfaces, 0 leaves the server off.
+     */
+    void start(int port, const QVector<ScanChannel> &channels);
+    void shutdown();
+
+    /**
+     * @brief Rebuilds the register map, safe to call from any thread.
+     */
+    void setChannels(const QVector<ScanChannel> &channels);
+
+protected:
+    bool readData(QModbusDataUnit *newData) const override;
+    bool writeData(const QModbusDataUnit &newData) override;
+
+private:
+    explicit ScadaServer(QObject *parent = nullptr);
+
+    struct RegisterMapping {
+        ushort pinId;
+        bool highWord;
+    };
+
+    QThread serverThread;
+    QHash<quint16, RegisterMapping> registers; // By register address
+    QHash<quint16, ushort> discreteInputs;     // Pin id by address
+    quint16 registerEnd = 0;                   // One past the highest mapped address
+    quint16 discreteInputEnd = 0;
+    quint16 coilEnd = 0;
+};
+
+#endif // SCADASERVER_H
@@ -0,0 +1,204 @@
+#include "scanplan.h"
+
+#include <algorithm>
+#include <cstring>
+
+bool ScanChannel::isValid() const
+{
+    const bool bits = registerType == QModbusDataUnit::Coils || registerType == QModbusDataUnit::DiscreteInputs;
+
+    if (bits != (dataType == Bool))
+        return false;
+
+    return count >= width(dataType) && count <= ScanPlan::maxCount(registerType) && pollPeriodMs >= 0;
+}
+
+int ScanChannel::functionCode() const
+{
+    switch (registerType) {
+    case QModbusDataUnit::Coils:            return 1;
+    case QModbusDataUnit::DiscreteInputs:   return 2;
+    case QModbusDataUnit::HoldingRegisters: return 3;
+    case QModbusDataUnit::InputRegisters:   return 4;
+    default:                                return 0;
+    }
+}
+
+double ScanChannel::decode(const QModbusDataUnit &unit, int offset, quint16 &pinValue) const
+{
+    const quint16 first = unit.value(offset);
+    const quint32 doubleWord = width(dataType) == 2 ? (static_cast<quint32>(first) << 16) | unit.value(offset + 1) : first;
+
+    double raw = 0;
+    switch (dataType) {
+    case UInt16: raw = first; break;
+    case Int16:  raw = static_cast<qint16>(first); break;
+    case UInt32: raw = doubleWord; break;
+    case Int32:  raw = static_cast<qint32>(doubleWord); break;
+    case Bool:   raw = first ? 1 : 0; break;
+    case Float32: {
+        float value;
+        std::memcpy(&value, &doubleWord, sizeof(value));
+        raw = value;
+        break;
+    }
+    }
+
+    pinValue = width(dataType) == 1 ? first : static_cast<quint16>(qBound(0.0, raw, 65535.0));
+    return raw;
+}
+
+int ScanChannel::width(DataType dataType)
+{
+    return dataType == UInt32 || dataType == Int32 || dataType == Float32 ? 2 : 1;
+}
+
+bool ScanChannel::registerTypeFromFunctionCode(int functionCode, QModbusDataUnit::RegisterType &registerType)
+{
+    switch (functionCode) {
+    case 1: registerType = QModbusDataUnit::Coils; return true;
+    case 2: registerType = QModbusDataUnit::DiscreteInputs; return true;
+    case 3: registerType = QModbusDataUnit::HoldingRegisters; return true;
+    case 4: registerType = QModbusDataUnit::InputRegisters; return true;
+    default: return false;
+    }
+}
+
+static const struct {
+    ScanChannel::DataType dataType;
+    const char *name;
+} dataTypeNames[] = {
+    {ScanChannel::UInt16, "uint16"},
+    {ScanChannel::Int16, "int16"},
+    {ScanChannel::UInt32, "uint32"},
+    {ScanChannel::Int32, "int32"},
+    {ScanChannel::Float32, "float32"},
+    {ScanChannel::Bool, "bool"},
+};
+
+bool ScanChannel::dataTypeFromName(const QString &name, DataType &dataType)
+{
+    for (const auto &entry : dataTypeNames) {
+        if (name.compare(entry.name, Qt::CaseInsensitive) == 0) {
+            dataType = entry.dataType;
+            return true;
+        }
+    }
+    return false;
+}
+
+QString ScanChannel::dataTypeName(DataType dataType)
+{
+    for (const auto &entry : dataTypeNames) {
+        if (entry.dataType == dataType)
+            return entry.name;
+    }
+    return "uint16";
+}
+
+void ScanPlan::compile(QVector<ScanChannel> newChannels, int defaultPeriodMs)
+{
+    tick = qMax(MIN_TICK_MS, defaultPeriodMs);
+    for (const auto &channel : newChannels) {
+        tick = qMin(tick, qMax(MIN_TICK_MS, periodMs(channel, defaultPeriodMs)));
+    }
+
+    // Never polled slower than requested
+    const auto cycles = [this, defaultPeriodMs](const ScanChannel &channel) {
+        return qMax(1, periodMs(channel, defaultPeriodMs) / tick);
+    };
+
+    std::sort(newChannels.begin(), newChannels.end(), [&cycles](const ScanChannel &a, const ScanChannel &b) {
+        if (a.slaveAddress != b.slaveAddress)
+            return a.slaveAddress < b.slaveAddress;
+        if (a.registerType != b.registerType)
+            return a.registerType < b.registerType;
+        if (a.priority != b.priority)
+            return a.priority < b.priority;
+        if (cycles(a) != cycles(b))
+            return cycles(a) < cycles(b);
+        return a.address < b.address;
+    });
+
+    channels = std::move(newChannels);
+    scanBlocks.clear();
+
+    for (int i = 0; i < channels.size(); i++) {
+        const auto &channel = channels.at(i);
+        const int everyCycles = cycles(channel);
+        const int channelEnd = channel.address + channel.count - 1;
+
+        if (!scanBlocks.isEmpty()) {
+            auto &last = scanBlocks.last();
+            const int lastAddress = last.startAddress + last.count - 1;
+
+            const bool sameRange = last.slaveAddress == channel.slaveAddress
+                                   && last.registerType == channel.registerType
+                                   && last.priority == channel.priority
+                                   && last.everyCycles == everyCycles;
+
+            // Overlapping or contiguous registers (including two channels sharing a register), extend the current block
+            if (sameRange && channel.address <= lastAddress + 1
+                && channelEnd - last.startAddress + 1 <= maxCount(channel.registerType)) {
+                last.count = qMax(lastAddress, channelEnd) - last.startAddress + 1;
+                last.channelCount++;
+                continue;
+            }
+        }
+
+        scanBlocks.append({channel.slaveAddress, channel.registerType, channel.address, channel.count, i, 1,
+                           everyCycles, channel.priority, {}});
+    }
+
+    for (auto &block : scanBlocks) {
+        block.unit = QModbusDataUnit(block.registerType, block.startAddress, block.count);
+    }
+}
+
+QVector<ScanChannel> ScanPlan::applyProfile(QVector<ScanChannel> channels, const QList<ScanProfile> &profile)
+{
+    for (auto &channel : channels) {
+        for (const auto &entry : profile) {
+            if (entry.pinId == channel.pinId) {
+                channel.pollPeriodMs = entry.pollPeriodMs;
+                channel.priority = entry.priority;
+                break;
+            }
+        }
+    }
+
+    return channels;
+}
+
+int ScanPlan::periodMs(const ScanChannel &channel, int defaultPeriodMs)
+{
+    return channel.pollPeriodMs > 0 ? channel.pollPeriodMs : defaultPeriodMs;
+}
+
+qint64 ScanPlan::rtuWireTimeUs(const SerialSettings &settings) const
+{
+    // Request: address, function, start, count, CRC. Response: address, function, byte count, data, CRC.
+    static constexpr int REQUEST_BYTES = 8;
+    static constexpr int RESPONSE_OVERHEAD_BYTES = 5;
+
+    qint64 total = 0;
+
+    for (const auto &block : scanBlocks) {
+        const bool bits = block.registerType == QModbusDataUnit::Coils
+                          || block.registerType == QModbusDataUnit::DiscreteInputs;
+        const int dataBytes = bits ? (block.count + 7) / 8 : block.count * 2;
+
+        total += (settings.frameTimeUs(REQUEST_BYTES) + settings.frameTimeUs(RESPONSE_OVERHEAD_BYTES + dataBytes))
+                 / block.everyCycles;
+    }
+
+    return total;
+}
+
+quint16 ScanPlan::maxCount(QModbusDataUnit::RegisterType registerType)
+{
+    if (registerType == QModbusDataUnit::Coils || registerType == QModbusDataUnit::DiscreteInputs)
+        return MAX_BITS_PER_READ;
+
+    return MAX_REGISTERS_PER_READ;
+}
@@ -0,0 +1,121 @@
+#ifndef SCANPLAN_H
+#define SCANPLAN_H
+
+#include <QVector>
+#include <QString>
+#include <QModbusDataUnit>
+
+#include "busscheduler.h"
+#include "serialsettings.h"
+
+/**
+ * @brief Single polled value on a slave, one InputPin row with a slave.
+ *
+ * 32 bit values span two registers, high word first.
+ */
+struct ScanChannel {
+    enum DataType {
+        UInt16, Int16, UInt32, Int32, Float32, Bool
+    };
+
+    quint8 slaveAddress = 0;
+    QModbusDataUnit::RegisterType registerType = QModbusDataUnit::HoldingRegisters;
+    quint16 address = 0;
+    quint16 count = 1;     // Registers (or bits) read for the value, at least the width of the data type
+    ushort pinId = 0;      // slot in Sensor::inputPins
+    DataType dataType = UInt16;
+    double scale = 1.0;    // Gain of the linear calibration, see CalibrationEngine
+    int pollPeriodMs = 0;  // 0 polls the channel at the scan interval of its bus
+    BusScheduler::Priority priority = BusScheduler::Periodic;
+    int scadaRegister = -1; // Address of the value on the SCADA server, -1 if not served
+    QString description;
+
+    bool isValid() const;
+    int functionCode() const;
+
+    /**
+     * @brief Decodes the register value at \p offset of \p unit, uncalibrated. \p pinValue gets it saturated to 16 bits.
+     */
+    double decode(const QModbusDataUnit &unit, int offset, quint16 &pinValue) const;
+
+    static int width(DataType dataType);
+    static bool registerTypeFromFunctionCode(int functionCode, QModbusDataUnit::RegisterType &registerType);
+    static bool dataTypeFromName(const QString &name, DataType &dataType);
+    static QString dataTypeName(DataType dataType);
+};
+
+/**
+ * @brief One Modbus read covering a contiguous range of channels on the same slave.
+ *
+ * The data unit is built once when the plan is compiled and reused for every scan cycle.
+ */
+struct ScanBlock {
+    quint8 slaveAddress;
+    QModbusDataUnit::RegisterType registerType;
+    quint16 startAddress;
+    quint16 count;
+    int firstChannel;
+    int channelCount;
+    int everyCycles; // Read on every n-th scan cycle, from the poll period of its channels
+    BusScheduler::Priority priority;
+    QModbusDataUnit unit;
+};
+
+/**
+ * @brief Poll period and priority of an input pin while the state machine is in a given state.
+ */
+struct ScanProfile {
+    int state;  // StateMachine::State
+    ushort pinId;
+    int pollPeriodMs;
+    BusScheduler::Priority priority;
+};
+
+/**
+ * @brief Precompiled list of reads executed once per scan cycle.
+ *
+ * Channels are sorted by slave, register type, priority, poll period and address, and contiguous
+ * addresses of the same slave, priority and period are merged into a single multi-register read.
+ * The scan cycle runs at the shortest poll period, slower blocks are read every n-th cycle. A plan
+ * is immutable once compiled, a changed channel map or scan profile compiles a new one.
+ */
+class ScanPlan
+{
+public:
+    static constexpr quint16 MAX_REGISTERS_PER_READ = 125; // FC03/FC04 limit
+    static constexpr quint16 MAX_BITS_PER_READ = 2000;     // FC01/FC02 limit
+    static constexpr int MIN_TICK_MS = 20;
+
+    /**
+     * @brief Compiles the plan, channels without a poll period are read every \p defaultPeriodMs.
+     */
+    void compile(QVector<ScanChannel> newChannels, int defaultPeriodMs);
+
+    /**
+     * @brief Overrides poll period and priority of the channels listed in \p profile.
+     */
+    static QVector<ScanChannel> applyProfile(QVector<ScanChannel> channels, const QList<ScanProfile> &profile);
+
+    int tickMs() const { return tick; }
+
+    const QVector<ScanBlock> &blocks() const { return scanBlocks; }
+    const ScanBlock &block(int index) const { return scanBlocks.at(index); }
+    const ScanChannel &channel(int index) const { return channels.at(index); }
+    int size() const { return scanBlocks.size(); }
+
+    /**
+     * @brief Time the reads of one scan cycle occupy an RTU line, averaged over the cycles of slow blocks.
+     */
+    qint64 rtuWireTimeUs(const SerialSettings &settings) const;
+
+    static quint16 maxCount(QModbusDataUnit::RegisterType registerType);
+
+private:
+    QVector<ScanChannel> channels;
+    QVector<ScanBlock> scanBlocks;
+    int tick = 1000;
+
+    static int periodMs(const ScanChannel &channel, int defaultPeriodMs);
+};
+
+#endif // SCANPLAN_H
@@ -2,19 +2,20 @@
 
 #include <QDateTime>
 
+#include "busscheduler.h"
+#include "calibrationengine.h"
+#include "changenotifier.h"
 #include "globalerrors.h"
 #include "globals.h"
 #include "logger.h"
 #include "dbmanager.h"
 #include "constants.h"
-#include "modbusrtu.h"
+#include "filterengine.h"
+#include "relayimage.h"
+#include "sensorhistory.h"
 
-qint64 Sensor::lastDataTime = 0;
-QList<Sensor> Sensor::inputPins = QList<Sensor>();
-QList<Sensor> Sensor::outputPins = QList<Sensor>();
-
-QMap<ushort, Sensor *> Sensor::mapInputPin = QMap<ushort, Sensor *>();
-QMap<ushort, Sensor *> Sensor::mapOutputPin = QMap<ushort, Sensor *>();
+PinSlots<Sensor> Sensor::inputPins;
+PinSlots<Sensor> Sensor::outputPins;
 
 Sensor::Sensor(ushort id, double minValue, double maxValue)
     : id{id}, minValue{minValue}, maxValue{maxValue}
@@ -31,16 +32,16 @@ Sensor::Sensor(ushort id)
 void Sensor::send(double newValue)
 {
     value = newValue; // Update the internal value
-    uint pinValue = newValue;
 
-    ModbusRTU::instance().writeSingleCoil(CONSTANTS::CWT_SLAVE_ID, id, newValue);
+    // Written immediately, or at the end of the tick when a relay transaction is open
+    RelayImage::instance().stage(id, newValue != 0);
 }
 
 bool Sensor::setRelayState(ushort id, ushort value)
 {
     // Update sensor value if sensor exists
-    if (mapOutputPin.contains(id)) {
-        Sensor::mapOutputPin[id]->send(value);
+    if (auto *pin = findOutput(id)) {
+        pin->send(value);
     } else {
         Logger::crit(QString("Sensor '%1' cannot be set to '%2' since it is not found in database.").arg(id).arg(value));
         GlobalErrors::setError(GlobalErrors::DbError);
@@ -52,34 +53,46 @@ bool Sensor::setRelayState(ushort id, ushort value)
 
 void Sensor::sendIfNew(double newValue)
 {
+    // Relays that don't match the requested state are rewritten by the relay image reconciliation
     if (newValue == value)
         return;
 
     send(newValue);
 }
 
-void Sensor::setValue(uint newPinValue)
-{    
-    pinValue = newPinValue;
+void Sensor::run(const OutputProgram &program)
+{
+    if (RelayImage::instance().run(id, program))
+        value = program.finalValue();
+}
+
+void Sensor::publishFrame(const SensorFrame &source, quint32 pins)
+{
+    QMutexLocker locker(&publishMutex);
+
+    for (int i = 0; i < SensorFrame::PIN_COUNT; i++) {
+        if (pins & (1u << i)) {
+            latestFrame.raw[i] = source.raw[i];
+            latestFrame.scaled[i] = source.scaled[i];
+            latestFrame.pinValue[i] = source.pinValue[i];
+        }
+    }
+
+    // One batch over the fresh pins, filter state is only touched under the publish lock
+    FilterEngine::instance().apply(latestFrame, pins, BusScheduler::nowNs() / 1000000);
+
+    const quint32 changed = ChangeNotifier::instance().update(latestFrame, pins);
 
-    //double scalingFactor;
+    latestFrame.timestampMs = qMax(latestFrame.timestampMs, source.timestampMs);
+    latestFrame.sequence++;
 
-    // if(id < 7){
-    //     // for 4-20mA range
-    //     scalingFactor = (newPinValue - 4000.0) / (20000.0 - 4000.0);
-    // } else if ( id == 7) {
-    //     // for 0-10v
-    //     scalingFactor = (newPinValue - 0.0) / (10000.0 - 0.0);
-    // } else {
-    //     // DI pins, should be between 0 and 1
-    //     scalingFactor = newPinValue;
-    // }
+    frames.write(latestFrame);
+    const SensorFrame published = latestFrame; // Other buses may publish once unlocked
+    locker.unlock();
 
-    //scalingFactor = (newPinValue - 0.0) / (1024.0 - 0.0);
+    SensorHistory::instance().record(published, pins);
 
-    // Calculate the new value based on the scaling factor and the min/max range
-    //value = scalingFactor * (maxValue - minValue) + minValue;
-    value = newPinValue / CONSTANTS::SENSOR_PIN_SCALING_FACTOR;
+    ChangeNotifier::instance().notify(changed, published.sequence);
 }
 
 /**
@@ -87,23 +100,16 @@ void Sensor::setValue(uint newPinValue)
  */
 SensorValues Sensor::getValues()
 {
-    checkIfDataIsOld();
+    const auto current = frame();
+    checkIfDataIsOld(current.timestampMs);
 
     SensorValues values;
-    
-    values.temp = mapInputPin[CONSTANTS::TEMP]->value;
-    values.expansionTemp = mapInputPin[CONSTANTS::EXPANSION_TEMP]->value;
-    values.heaterTemp = mapInputPin[CONSTANTS::HEATER_TEMP]->value;
-    values.tankTemp = mapInputPin[CONSTANTS::TANK_TEMP]->value;
-    values.tempK = mapInputPin[CONSTANTS::TEMP_K]->value;
-    values.tankWaterLevel = mapInputPin[CONSTANTS::TANK_WATER_LEVEL]->value;
-    values.pressure = mapInputPin[CONSTANTS::PRESSURE]->value;
-    values.steamPressure = mapInputPin[CONSTANTS::STEAM_PRESSURE]->value;
-
-    values.doorClosed = mapInputPin[CONSTANTS::DOOR_CLOSED_SHIFTED]->value;
-    values.burnerFault = mapInputPin[CONSTANTS::BURNER_FAULT_SHIFTED]->value;
-    values.waterShortage = mapInputPin[CONSTANTS::WATER_SHORTAGE_SHIFTED]->value;
-    
+
+    for (const auto &pin : PinRegistry::INPUTS) {
+        values.*pin.field = current.value[pin.id];
+        values.generation += current.generation[pin.id];
+    }
+
     return values;
 }
 
@@ -112,50 +118,34 @@ SensorValues Sensor::getValues()
  */
 SensorValues Sensor::getPinValues()
 {
-    checkIfDataIsOld();
+    const auto current = frame();
+    checkIfDataIsOld(current.timestampMs);
 
     SensorValues values;
 
-    values.temp = mapInputPin[CONSTANTS::TEMP]->pinValue;
-    values.expansionTemp = mapInputPin[CONSTANTS::EXPANSION_TEMP]->pinValue;
-    values.heaterTemp = mapInputPin[CONSTANTS::HEATER_TEMP]->pinValue;
-    values.tankTemp = mapInputPin[CONSTANTS::TANK_TEMP]->pinValue;
-    values.tempK = mapInputPin[CONSTANTS::TEMP_K]->pinValue;
-    values.tankWaterLevel = mapInputPin[CONSTANTS::TANK_WATER_LEVEL]->pinValue;
-    values.pressure = mapInputPin[CONSTANTS::PRESSURE]->pinValue;
-    values.steamPressure = mapInputPin[CONSTANTS::STEAM_PRESSURE]->pinValue;
-
-    // We are using shifted values
-    values.doorClosed = mapInputPin[CONSTANTS::DOOR_CLOSED_SHIFTED]->pinValue;
-    values.burnerFault = mapInputPin[CONSTANTS::BURNER_FAULT_SHIFTED]->pinValue;
-    values.waterShortage = mapInputPin[CONSTANTS::WATER_SHORTAGE_SHIFTED]->pinValue;
+    // Digital inputs are read at their shifted ids
+    for (const auto &pin : PinRegistry::INPUTS) {
+        values.*pin.field = current.pinValue[pin.id];
+        values.generation += current.generation[pin.id];
+    }
 
     return values;
 }
 
 /**
- * @brief Structure representing the relay values of a sensor. Check void Sensor::setValue(uint newPinValue)
-    * for more information.
+ * @brief Relay states as confirmed by the relay board, not the requested ones. See RelayImage.
  */
 SensorRelayValues Sensor::getRelayValues()
 {
-    checkIfDataIsOld();
+    checkIfDataIsOld(frame().timestampMs);
 
+    // One snapshot of the image instead of a locked lookup per relay
+    const quint32 states = RelayImage::instance().actualStates();
     SensorRelayValues relayValues;
-    
-    relayValues.fillTankWithWater = mapOutputPin[CONSTANTS::FILL_TANK_WITH_WATER]->value;
-    relayValues.cooling = mapOutputPin[CONSTANTS::COOLING]->value;
-    relayValues.tankHeating = mapOutputPin[CONSTANTS::TANK_HEATING]->value;
-    relayValues.coolingHelper = mapOutputPin[CONSTANTS::COOLING_HELPER]->value;
-    relayValues.autoklavFill = mapOutputPin[CONSTANTS::AUTOKLAV_FILL]->value;
-    relayValues.waterDrain = mapOutputPin[CONSTANTS::WATER_DRAIN]->value;
-    relayValues.heating = mapOutputPin[CONSTANTS::STEAM_HEATING]->value;
-    relayValues.pump = mapOutputPin[CONSTANTS::PUMP]->value;
-    relayValues.electricHeating = mapOutputPin[CONSTANTS::ELECTRIC_HEATING]->value;
-    relayValues.increasePressure = mapOutputPin[CONSTANTS::INCREASE_PRESSURE]->value;
-    relayValues.extensionCooling = mapOutputPin[CONSTANTS::EXTENSION_COOLING]->value;
-    relayValues.alarmSignal = mapOutputPin[CONSTANTS::ALARM_SIGNAL]->value;
-    
+
+    for (const auto &pin : PinRegistry::OUTPUTS)
+        relayValues.*pin.field = (states >> pin.id) & 1u;
+
     return relayValues;
 }
 
@@ -164,16 +154,22 @@ bool Sensor::updateInputPin(ushort id, double minValue, double maxValue)
     if (!DbManager::instance().updateInputPin(id, minValue, maxValue))
         return false;
 
-    if (mapInputPin.contains(id))
+    auto *pin = findInput(id);
+    if (!pin)
         return false;
 
-    mapInputPin[id]->minValue = minValue;
-    mapInputPin[id]->maxValue = maxValue;
+    pin->minValue = minValue;
+    pin->maxValue = maxValue;
+
+    // Used from the next read on, no restart needed
+    auto &db = DbManager::instance();
+    CalibrationEngine::instance().setCalibrations(db.loadCalibrations());
+    ChangeNotifier::instance().setDeadbands(db.loadDeadbands()); // Percentages follow the range
 
     return true;
 }
 
-void Sensor::checkIfDataIsOld()
+void Sensor::checkIfDataIsOld(qint64 lastDataTime)
 {
     if (lastDataTime && QDateTime::currentMSecsSinceEpoch() - lastDataTime > Globals::serialDataOldTime)
         GlobalErrors::setError(GlobalErrors::OldDataError);
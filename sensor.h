@@ -1,69 +1,84 @@
 #ifndef SENSOR_H
 #define SENSOR_H
 
-#include <QMap>
+#include <QMutex>
 #include <QString>
+#include <array>
 
-struct SensorValues {
-    // Analog values
-    double temp;
-    double expansionTemp;
-    double heaterTemp;
-    double tankTemp;
-    double tempK;
-    double tankWaterLevel;
-    double pressure;
-    double steamPressure;
+#include "pinregistry.h"
+#include "seqlock.h"
+#include "outputprogram.h"
 
-    // Digital input values
-    double doorClosed;
-    double burnerFault;
-    double waterShortage;
-};
-   
-struct SensorRelayValues{
-    unsigned int fillTankWithWater;
-    unsigned int cooling;
-    unsigned int tankHeating;
-    unsigned int coolingHelper;
-    unsigned int autoklavFill;
-    unsigned int waterDrain;
-    unsigned int heating;
-    unsigned int pump;
-    unsigned int electricHeating;
-    unsigned int increasePressure;
-    unsigned int extensionCooling;
-    unsigned int alarmSignal;    
+/**
+ * @brief Complete set of input values from one scan cycle, indexed by input pin id.
+ */
+struct SensorFrame {
+    static constexpr int PIN_COUNT = PinRegistry::SLOT_COUNT;
+
+    std::array<double, PIN_COUNT> value;    // Process value, after the filter chain of the pin
+    std::array<double, PIN_COUNT> scaled;   // Calibrated value before filtering
+    std::array<double, PIN_COUNT> raw;      // Decoded register value before calibration
+    std::array<quint16, PIN_COUNT> pinValue;
+    std::array<quint32, PIN_COUNT> generation; // Changes of the value beyond its deadband, see ChangeNotifier
+    qint64 timestampMs; // Time of the last successful read, 0 until the first one
+    quint64 sequence;   // Incremented on every publication
 };
 
 class Sensor
 {
 public:
+    Sensor() = default;
     Sensor(ushort id, double minValue, double maxValue);
     Sensor(ushort id);
 
     void send(double newValue);
     void sendIfNew(double newValue);
-    void setValue(uint newPinValue);
+
+    /**
+     * @brief Runs a timed program on the output, see RelayImage::run(). The value is its final state.
+     */
+    void run(const OutputProgram &program);
     
     static SensorValues getValues();
     static SensorValues getPinValues();
     static SensorRelayValues getRelayValues();
     static bool setRelayState(ushort id, ushort value);
     static void parseModbusData(QString data);
-    static void checkIfDataIsOld();
+    static void checkIfDataIsOld(qint64 lastDataTime);
+
+    // Safe to call from any thread, reading is lock free
+    static void publishFrame(const SensorFrame &source, quint32 pins);
+    static SensorFrame frame() { return frames.read(); }
     
-    ushort id; // position of the I/O port in the PLC
-    double minValue, maxValue;
-    double value;  // parsed value
-    ushort pinValue; // Raw data used for calibration
+    ushort id = 0; // position of the I/O port in the PLC
+    double minValue = 0, maxValue = 0;
+    double value = 0;  // parsed value
+    ushort pinValue = 0; // Raw data used for calibration
 
-    static qint64 lastDataTime;
-    static QList<Sensor> inputPins;
-    static QList<Sensor> outputPins;
-    static QMap<ushort, Sensor *> mapInputPin;
-    static QMap<ushort, Sensor *> mapOutputPin;
+    // Indexed by pin id, see PinRegistry
+    static PinSlots<Sensor> inputPins;
+    static PinSlots<Sensor> outputPins;
+
+    /**
+     * @brief Output pin known to the process code, checked when compiling.
+     */
+    template <ushort Id>
+    static Sensor &output()
+    {
+        static_assert(PinRegistry::isOutput(Id), "Not an output pin of the registry");
+        return outputPins.at<Id>();
+    }
+
+    static Sensor *findInput(ushort id) { return inputPins.find(id); }
+    static Sensor *findOutput(ushort id) { return outputPins.find(id); }
     static bool updateInputPin(ushort id, double minValue, double maxValue);
+
+private:
+    inline static SeqLock<SensorFrame> frames;
+
+    // Every bus publishes its own pins, merged into the latest frame under the writer lock
+    inline static QMutex publishMutex;
+    inline static SensorFrame latestFrame{};
 };
 
 #endif // SENSOR_H
@@ -0,0 +1,140 @@
+#include "sensorhistory.h"
+
+#include <QDateTime>
+#include <limits>
+
+#include "busscheduler.h"
+#include "globals.h"
+#include "logger.h"
+
+SensorHistory::Channel::Channel(int rawCapacity)
+    : samples(rawCapacity)
+{
+    for (std::size_t i = 0; i < LEVELS.size(); i++) {
+        levels[i] = RingBuffer<Bucket>(LEVELS[i].capacity);
+    }
+}
+
+void SensorHistory::record(const SensorFrame &frame, quint32 pins)
+{
+    const qint64 timeMs = monotonicMs();
+
+    QMutexLocker locker(&mutex);
+
+    for (int pin = 0; pin < SensorFrame::PIN_COUNT; pin++) {
+        if (!(pins & (1u << pin)))
+            continue;
+
+        auto &channel = channels[pin];
+        if (!channel) {
+            // Allocated once per pin, the first time it is read
+            channel = std::make_unique<Channel>(qMax(Globals::historySamples, 1));
+            Logger::debug(QString("History: pin %1 keeps %2 samples").arg(pin).arg(channel->samples.capacity()));
+        }
+
+        // Before the filter chain, the trend must show the spikes the filters hide
+        const double value = frame.scaled[pin];
+        channel->samples.push({timeMs, frame.pinValue[pin], value});
+
+        for (std::size_t i = 0; i < LEVELS.size(); i++) {
+            auto &level = channel->levels[i];
+            const qint64 startMs = timeMs - timeMs % LEVELS[i].widthMs;
+
+            if (!level.isEmpty() && level.last().startMs == startMs) {
+                auto &bucket = level.last();
+                bucket.min = qMin(bucket.min, value);
+                bucket.max = qMax(bucket.max, value);
+                bucket.sum += value;
+                bucket.count++;
+            } else {
+                level.push({startMs, value, value, value, 1});
+            }
+        }
+    }
+}
+
+SensorHistory::Series SensorHistory::query(ushort pin, qint64 fromMs, qint64 toMs, int maxPoints) const
+{
+    Series series;
+
+    if (maxPoints <= 0)
+        maxPoints = 1000;
+
+    // Epoch times of the interface to the monotonic clock of the samples
+    const qint64 nowMs = monotonicMs();
+    const qint64 epochOffsetMs = QDateTime::currentMSecsSinceEpoch() - nowMs;
+    const qint64 from = fromMs > 0 ? fromMs - epochOffsetMs : std::numeric_limits<qint64>::min();
+    const qint64 to = toMs > 0 ? toMs - epochOffsetMs : nowMs;
+
+    QMutexLocker locker(&mutex);
+
+    if (pin >= SensorFrame::PIN_COUNT || !channels[pin] || from > to)
+        return series;
+
+    const auto &channel = *channels[pin];
+
+    // A ring that never wrapped holds everything since the start, otherwise its oldest entry must be old enough
+    const auto covers = [from](const auto &ring, qint64 oldestMs) {
+        return ring.size() < ring.capacity() || oldestMs <= from;
+    };
+
+    const auto &samples = channel.samples;
+    if (!samples.isEmpty() && covers(samples, samples.at(0).timeMs)) {
+        const int first = samples.lowerBound([from](const Sample &s) { return s.timeMs < from; });
+        const int end = samples.lowerBound([to](const Sample &s) { return s.timeMs <= to; });
+
+        if (end - first <= maxPoints) {
+            for (int i = first; i < end; i++) {
+                const auto &sample = samples.at(i);
+                series.points.append({sample.timeMs + epochOffsetMs, sample.value, sample.value, sample.value, sample.raw, 1});
+            }
+            return series;
+        }
+    }
+
+    for (std::size_t level = 0; level < LEVELS.size(); level++) {
+        const auto &buckets = channel.levels[level];
+        if (buckets.isEmpty())
+            continue;
+
+        const bool coarsest = level == LEVELS.size() - 1;
+        if (!coarsest && !covers(buckets, buckets.at(0).startMs))
+            continue;
+
+        const int widthMs = LEVELS[level].widthMs;
+        const int first = buckets.lowerBound([from, widthMs](const Bucket &b) { return b.startMs + widthMs <= from; });
+        const int end = buckets.lowerBound([to](const Bucket &b) { return b.startMs <= to; });
+
+        // The coarsest level is merged further when the range still doesn't fit
+        const int merge = end - first <= maxPoints ? 1 : coarsest ? (end - first + maxPoints - 1) / maxPoints : 0;
+        if (!merge)
+            continue;
+
+        series.resolutionMs = widthMs * merge;
+        for (int i = first; i < end; i += merge) {
+            Bucket merged = buckets.at(i);
+            for (int j = i + 1; j < qMin(i + merge, end); j++) {
+                const auto &bucket = buckets.at(j);
+                merged.min = qMin(merged.min, bucket.min);
+                merged.max = qMax(merged.max, bucket.max);
+                merged.sum += bucket.sum;
+                merged.count += bucket.count;
+            }
+            series.points.append({merged.startMs + epochOffsetMs, merged.average(), merged.min, merged.max, 0, merged.count});
+        }
+        break;
+    }
+
+    return series;
+}
+
+qint64 SensorHistory::monotonicMs()
+{
+    return BusScheduler::nowNs() / 1000000;
+}
+
+SensorHistory &SensorHistory::instance()
+{
+    static SensorHistory instance;
+    return instance;
+}
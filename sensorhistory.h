@@ -0,0 +1,143 @@
+#ifndef SENSORHISTORY_H
+#define SENSORHISTORY_H
+
+#include <QList>
+#include <QMutex>
+#include <array>
+#include <memory>
+#include <vector>
+
+#include "sensor.h"
+
+/**
+ * @brief Fixed capacity ring of time ordered entries, the oldest one is overwritten when full.
+ */
+template <typename T>
+class RingBuffer
+{
+public:
+    explicit RingBuffer(int capacity = 0) : entries(qMax(capacity, 1)) {}
+
+    void push(const T &entry)
+    {
+        entries[(first + count) % capacity()] = entry;
+        if (count < capacity())
+            count++;
+        else
+            first = (first + 1) % capacity();
+    }
+
+    int size() const { return count; }
+    int capacity() const { return static_cast<int>(entries.size()); }
+    bool isEmpty() const { return count == 0; }
+
+    // 0 is the oldest entry
+    const T &at(int i) const { return entries[(first + i) % capacity()]; }
+    T &last() { return entries[(first + count - 1) % capacity()]; }
+
+    /**
+     * @brief Index of the first entry for which \p before is false, entries must be ordered by it.
+     */
+    template <typename F>
+    int lowerBound(F before) const
+    {
+        int low = 0;
+        int high = count;
+        while (low < high) {
+            const int middle = (low + high) / 2;
+            if (before(at(middle)))
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        return low;
+    }
+
+private:
+    std::vector<T> entries; // Allocated once
+    int first = 0;
+    int count = 0;
+};
+
+/**
+ * @brief In-memory history of every input pin at full scan rate, for live trends without SQLite.
+ *
+ * Each pin keeps its last samples (raw and scaled value, monotonic time) and a pyramid of min/max/avg
+ * buckets of 1 s, 10 s and 1 min covering the last 24 h. Samples are recorded when a bus publishes
+ * its frame, queries pick the finest level that covers the range in the requested number of points.
+ * Times are kept on the monotonic clock and converted to epoch milliseconds at the interface.
+ */
+class SensorHistory
+{
+public:
+    struct Sample {
+        qint64 timeMs = 0; // Monotonic
+        quint16 raw = 0;
+        double value = 0;
+    };
+
+    struct Bucket {
+        qint64 startMs = 0; // Monotonic, multiple of the level width
+        double min = 0;
+        double max = 0;
+        double sum = 0;
+        quint32 count = 0;
+
+        double average() const { return count ? sum / count : 0; }
+    };
+
+    struct Level {
+        int widthMs;
+        int capacity;
+    };
+
+    // Zoomed out levels, 1 s for the last 6 h, 10 s and 1 min for the last 24 h
+    static constexpr std::array<Level, 3> LEVELS{{{1000, 21600}, {10000, 8640}, {60000, 1440}}};
+
+    struct Point {
+        qint64 timestampMs = 0; // Epoch, start of the bucket
+        double value = 0;       // Average of the bucket
+        double min = 0;
+        double max = 0;
+        quint16 raw = 0;        // Only for full rate samples
+        quint32 count = 1;
+    };
+
+    struct Series {
+        int resolutionMs = 0; // 0 for full rate samples
+        QList<Point> points;
+    };
+
+    SensorHistory(const SensorHistory&) = delete;
+    SensorHistory& operator=(const SensorHistory &) = delete;
+
+    /**
+     * @brief Appends the \p pins of \p frame that were just read. Safe to call from any thread.
+     */
+    void record(const SensorFrame &frame, quint32 pins);
+
+    /**
+     * @brief History of \p pin between the epoch times \p fromMs and \p toMs (0 - up to now), in at
+     * most \p maxPoints points.
+     */
+    Series query(ushort pin, qint64 fromMs, qint64 toMs, int maxPoints) const;
+
+    static SensorHistory &instance();
+
+private:
+    SensorHistory() = default;
+
+    struct Channel {
+        explicit Channel(int rawCapacity);
+
+        RingBuffer<Sample> samples;
+        std::array<RingBuffer<Bucket>, LEVELS.size()> levels;
+    };
+
+    mutable QMutex mutex; // Recorded from the I/O thread of every bus
+    std::array<std::unique_ptr<Channel>, SensorFrame::PIN_COUNT> channels;
+
+    static qint64 monotonicMs();
+};
+
+#endif // SENSORHISTORY_H
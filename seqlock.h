@@ -0,0 +1,77 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <QtGlobal>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+/**
+ * @brief Single writer, multiple reader snapshot of a trivially copyable value.
+ *
+ * The writer never waits and readers never lock, they retry if a write happened while they were
+ * copying. The value is stored as relaxed atomic words so concurrent access is well defined.
+ * Concurrent writers must be serialized by the caller.
+ */
+template <typename T>
+class SeqLock
+{
+    static_assert(std::is_trivially_copyable_v<T>, "SeqLock requires a trivially copyable type");
+
+public:
+    void write(const T &value)
+    {
+        std::array<quint64, WORDS> buffer{};
+        std::memcpy(buffer.data(), &value, sizeof(T));
+
+        const auto sequence = sequenceNumber.load(std::memory_order_relaxed);
+        sequenceNumber.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (int i = 0; i < WORDS; i++) {
+            words[i].store(buffer[i], std::memory_order_relaxed);
+        }
+
+        sequenceNumber.store(sequence + 2, std::memory_order_release);
+    }
+
+    T read() const
+    {
+        std::array<quint64, WORDS> buffer;
+        quint64 before, after;
+
+        do {
+            before = sequenceNumber.load(std::memory_order_acquire);
+            if (before & 1) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            for (int i = 0; i < WORDS; i++) {
+                buffer[i] = words[i].load(std::memory_order_relaxed);
+            }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = sequenceNumber.load(std::memory_order_relaxed);
+        } while ((before & 1) || before != after);
+
+        T value;
+        std::memcpy(&value, buffer.data(), sizeof(T));
+        return value;
+    }
+
+    /**
+     * @brief Number of completed writes.
+     */
+    quint64 writes() const { return sequenceNumber.load(std::memory_order_acquire) / 2; }
+
+private:
+    static constexpr int WORDS = (sizeof(T) + sizeof(quint64) - 1) / sizeof(quint64);
+
+    std::atomic<quint64> sequenceNumber{0};
+    std::array<std::atomic<quint64>, WORDS> words{};
+};
+
+#endif // SEQLOCK_H
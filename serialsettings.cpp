@@ -0,0 +1,55 @@
+#include "serialsettings.h"
+#include "globals.h"
+
+static constexpr int FIXED_TIMING_BAUD_RATE = 19200;
+static constexpr qint64 FIXED_INTER_FRAME_DELAY_US = 1750;
+
+int SerialSettings::bitsPerCharacter() const
+{
+    const int parityBits = parity == QSerialPort::NoParity ? 0 : 1;
+    const int stop = stopBits == QSerialPort::TwoStop ? 2 : 1;
+
+    return 1 + static_cast<int>(dataBits) + parityBits + stop;
+}
+
+qint64 SerialSettings::characterTimeUs() const
+{
+    return (bitsPerCharacter() * 1000000LL + baudRate - 1) / baudRate;
+}
+
+qint64 SerialSettings::interFrameDelayUs() const
+{
+    if (baudRate > FIXED_TIMING_BAUD_RATE)
+        return FIXED_INTER_FRAME_DELAY_US;
+
+    return (characterTimeUs() * 7 + 1) / 2;
+}
+
+qint64 SerialSettings::frameTimeUs(int bytes) const
+{
+    return bytes * characterTimeUs() + interFrameDelayUs();
+}
+
+SerialSettings SerialSettings::fromValues(int baudRate, int parity, int stopBits)
+{
+    SerialSettings settings;
+
+    if (baudRate > 0)
+        settings.baudRate = baudRate;
+
+    switch (parity) {
+    case 0:  settings.parity = QSerialPort::NoParity; break;
+    case 1:  settings.parity = QSerialPort::OddParity; break;
+    case 2:  settings.parity = QSerialPort::EvenParity; break;
+    default: break;
+    }
+
+    settings.stopBits = stopBits == 2 ? QSerialPort::TwoStop : QSerialPort::OneStop;
+
+    return settings;
+}
+
+SerialSettings SerialSettings::fromGlobals()
+{
+    return fromValues(Globals::serialBaudRate, Globals::serialParity, Globals::serialStopBits);
+}
@@ -0,0 +1,35 @@
+#ifndef SERIALSETTINGS_H
+#define SERIALSETTINGS_H
+
+#include <QSerialPort>
+
+/**
+ * @brief Line settings of a Modbus RTU bus and the frame timing derived from them.
+ *
+ * One character on the wire is start bit + data bits + parity bit + stop bits. The Modbus RTU
+ * specification requires 3.5 character times of silence between frames, fixed to 1750 us for
+ * baud rates above 19200.
+ */
+struct SerialSettings {
+    int baudRate = QSerialPort::Baud9600;
+    QSerialPort::Parity parity = QSerialPort::OddParity;
+    QSerialPort::DataBits dataBits = QSerialPort::Data8;
+    QSerialPort::StopBits stopBits = QSerialPort::OneStop;
+
+    int bitsPerCharacter() const;
+    qint64 characterTimeUs() const;
+    qint64 interFrameDelayUs() const;
+
+    /**
+     * @brief Time needed to transmit a frame of the given size followed by the inter-frame gap.
+     */
+    qint64 frameTimeUs(int bytes) const;
+
+    /**
+     * @brief Settings from their database representation, parity is 0 - none, 1 - odd, 2 - even.
+     */
+    static SerialSettings fromValues(int baudRate, int parity, int stopBits);
+    static SerialSettings fromGlobals();
+};
+
+#endif // SERIALSETTINGS_H
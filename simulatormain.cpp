@@ -0,0 +1,202 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QSerialPort>
+#include <QSocketNotifier>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QFile>
+#include <functional>
+#include <memory>
+
+#include "logger.h"
+#include "autoklavplant.h"
+#include "modbusslavesimulator.h"
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Standalone Modbus RTU slave simulator for the autoklav line.
+ *
+ * Usage:
+ *   AutoklavSimulator --pty --link /tmp/autoklav
+ *   Autoklav --serial-port /tmp/autoklav --database <dir>
+ *
+ * or serve on a real serial port / one end of a socat pair with --port.
+ */
+
+static constexpr int PLANT_STEP_MS = 100;
+static constexpr int STATS_INTERVAL_MS = 10000;
+
+#ifdef Q_OS_UNIX
+static int openPty(QString &slaveName)
+{
+    const int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0)
+        return -1;
+
+    if (grantpt(fd) != 0 || unlockpt(fd) != 0) {
+        ::close(fd);
+        return -1;
+    }
+
+    termios tio;
+    tcgetattr(fd, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(fd, TCSANOW, &tio);
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    slaveName = QString::fromLocal8Bit(ptsname(fd));
+    return fd;
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("AutoklavSimulator");
+
+    qInstallMessageHandler(Logger::messageHandler);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Modbus RTU slave simulator with an autoklav plant model");
+    parser.addHelpOption();
+    parser.addOptions({
+        {"pty", "Create a pseudo terminal pair and serve on its master side."},
+        {"link", "Symlink pointing to the pty slave side.", "path"},
+        {"port", "Serve on an existing serial port.", "name"},
+        {"baud", "Baud rate for --port.", "baud", "9600"},
+        {"speed", "Plant time multiplier, 10 runs the process 10x faster.", "factor", "1"},
+        {"turnaround", "Delay before each response in milliseconds.", "ms", "5"},
+    });
+    parser.process(a);
+
+    AutoklavPlant plant;
+    ModbusSlaveSimulator simulator(plant);
+
+    const double speed = qMax(0.01, parser.value("speed").toDouble());
+    const int turnaround = qMax(0, parser.value("turnaround").toInt());
+
+    QByteArray buffer;
+    std::function<void(const QByteArray &)> writeFrame;
+
+    // Incoming bytes are split into frames by their expected length
+    auto onBytes = [&](const QByteArray &bytes) {
+        buffer.append(bytes);
+
+        while (!buffer.isEmpty()) {
+            const auto length = ModbusSlaveSimulator::expectedRequestLength(buffer);
+            if (length == 0) {
+                buffer.clear(); // Garbage or unsupported function code, resynchronise
+                return;
+            }
+            if (length < 0 || buffer.size() < length)
+                return;
+
+            const QByteArray response = simulator.processFrame(buffer.left(length));
+            buffer.remove(0, length);
+
+            if (!response.isEmpty()) {
+                QTimer::singleShot(turnaround, Qt::PreciseTimer, QCoreApplication::instance(), [&writeFrame, response]() {
+                    writeFrame(response);
+                });
+            }
+        }
+    };
+
+    QSerialPort serialPort;
+
+#ifdef Q_OS_UNIX
+    int ptyFd = -1;
+    std::unique_ptr<QSocketNotifier> ptyNotifier;
+#endif
+
+    if (parser.isSet("port")) {
+        serialPort.setPortName(parser.value("port"));
+        serialPort.setBaudRate(parser.value("baud").toInt());
+        serialPort.setParity(QSerialPort::OddParity);
+        serialPort.setDataBits(QSerialPort::Data8);
+        serialPort.setStopBits(QSerialPort::OneStop);
+
+        if (!serialPort.open(QIODevice::ReadWrite)) {
+            Logger::crit(QString("Unable to open %1: %2").arg(serialPort.portName(), serialPort.errorString()));
+            return 1;
+        }
+
+        QObject::connect(&serialPort, &QSerialPort::readyRead, [&]() {
+            onBytes(serialPort.readAll());
+        });
+        writeFrame = [&serialPort](const QByteArray &frame) {
+            serialPort.write(frame);
+        };
+
+        Logger::info(QString("Simulator serving on %1").arg(serialPort.portName()));
+    }
+#ifdef Q_OS_UNIX
+    else if (parser.isSet("pty")) {
+        QString slaveName;
+        ptyFd = openPty(slaveName);
+        if (ptyFd < 0) {
+            Logger::crit("Unable to create pty pair");
+            return 1;
+        }
+
+        if (parser.isSet("link")) {
+            const auto link = parser.value("link");
+            QFile::remove(link);
+            if (!QFile::link(slaveName, link))
+                Logger::warn(QString("Unable to create link %1").arg(link));
+        }
+
+        ptyNotifier = std::make_unique<QSocketNotifier>(ptyFd, QSocketNotifier::Read);
+        QObject::connect(ptyNotifier.get(), &QSocketNotifier::activated, [&]() {
+            char bytes[256];
+            ssize_t size;
+            while ((size = ::read(ptyFd, bytes, sizeof(bytes))) > 0) {
+                onBytes(QByteArray(bytes, size));
+            }
+        });
+        writeFrame = [&ptyFd](const QByteArray &frame) {
+            if (::write(ptyFd, frame.constData(), frame.size()) != frame.size())
+                Logger::warn("Short write on pty");
+        };
+
+        Logger::info(QString("Simulator serving on %1").arg(slaveName));
+    }
+#endif
+    else {
+        Logger::crit("Either --port or --pty has to be given");
+        parser.showHelp(1);
+    }
+
+    // Plant model runs in (optionally accelerated) simulated time
+    QElapsedTimer stepClock;
+    stepClock.start();
+
+    QTimer plantTimer;
+    plantTimer.setTimerType(Qt::PreciseTimer);
+    QObject::connect(&plantTimer, &QTimer::timeout, [&]() {
+        plant.step(stepClock.restart() / 1000.0 * speed);
+    });
+    plantTimer.start(PLANT_STEP_MS);
+
+    QTimer statsTimer;
+    QObject::connect(&statsTimer, &QTimer::timeout, [&]() {
+        const auto &v = plant.values();
+        Logger::info(QString("Simulator: frames=%1 crcErrors=%2 temp=%3 tempK=%4 pressure=%5 tankWaterLevel=%6")
+                         .arg(simulator.framesServed())
+                         .arg(simulator.crcErrors())
+                         .arg(v.temp, 0, 'f', 1)
+                         .arg(v.tempK, 0, 'f', 1)
+                         .arg(v.pressure, 0, 'f', 2)
+                         .arg(v.tankWaterLevel, 0, 'f', 1));
+    });
+    statsTimer.start(STATS_INTERVAL_MS);
+
+    return a.exec();
+}
@@ -0,0 +1,118 @@
+#include "slavehealth.h"
+
+bool SlaveHealth::allowRequest(quint8 slaveAddress, qint64 nowNs)
+{
+    auto &slave = slaveStates[slaveAddress];
+
+    switch (slave.state) {
+    case Closed:
+        return true;
+    case Open:
+        if (nowNs < slave.probeAtNs)
+            return false;
+        slave.state = HalfOpen;
+        return true;
+    case HalfOpen:
+        return false;
+    }
+
+    return true;
+}
+
+void SlaveHealth::recordSuccess(quint8 slaveAddress, qint64 responseUs, qint64 nowNs)
+{
+    auto &slave = slaveStates[slaveAddress];
+
+    slave.state = Closed;
+    slave.consecutiveFailures = 0;
+    slave.trips = 0;
+    slave.lastSuccessNs = nowNs;
+    slave.successes++;
+
+    if (slave.currentWindow.count() >= WINDOW_SIZE) {
+        slave.previousWindow = slave.currentWindow;
+        slave.currentWindow.reset();
+    }
+    slave.currentWindow.record(responseUs);
+}
+
+void SlaveHealth::recordFailure(quint8 slaveAddress, qint64 nowNs)
+{
+    auto &slave = slaveStates[slaveAddress];
+
+    slave.failures++;
+    slave.consecutiveFailures++;
+
+    if (slave.state == HalfOpen) {
+        slave.trips++;
+    } else if (slave.consecutiveFailures < FAILURE_THRESHOLD) {
+        return;
+    }
+
+    const qint64 interval = qMin(PROBE_INTERVAL_NS << qMin(slave.trips, 5), MAX_PROBE_INTERVAL_NS);
+    slave.state = Open;
+    slave.probeAtNs = nowNs + interval;
+}
+
+void SlaveHealth::probeAborted(quint8 slaveAddress)
+{
+    const auto it = slaveStates.find(slaveAddress);
+    if (it == slaveStates.end() || it->state != HalfOpen)
+        return;
+
+    // The probe time is kept, the next scan cycle probes again
+    it->state = Open;
+}
+
+void SlaveHealth::abortProbes()
+{
+    for (auto it = slaveStates.begin(); it != slaveStates.end(); ++it) {
+        if (it->state == HalfOpen)
+            it->state = Open;
+    }
+}
+
+int SlaveHealth::timeoutMs(quint8 slaveAddress) const
+{
+    const auto it = slaveStates.constFind(slaveAddress);
+    if (it == slaveStates.cend())
+        return MAX_TIMEOUT_MS;
+
+    LatencyHistogram window = it->previousWindow;
+    window.merge(it->currentWindow);
+
+    if (window.count() < MIN_SAMPLES)
+        return MAX_TIMEOUT_MS;
+
+    // Twice the 99th percentile leaves room for jitter, a single slow reply doesn't stretch it for the whole window
+    const qint64 timeoutUs = window.valueAtPercentile(99) * 2;
+    return static_cast<int>(qBound<qint64>(MIN_TIMEOUT_MS, (timeoutUs + 999) / 1000, MAX_TIMEOUT_MS));
+}
+
+bool SlaveHealth::isStale(quint8 slaveAddress, qint64 nowNs, qint64 maxAgeNs) const
+{
+    const auto it = slaveStates.constFind(slaveAddress);
+    if (it == slaveStates.cend())
+        return false;
+
+    return nowNs - it->lastSuccessNs > maxAgeNs;
+}
+
+void SlaveHealth::track(quint8 slaveAddress, qint64 nowNs)
+{
+    if (slaveStates.contains(slaveAddress))
+        return;
+
+    slaveStates[slaveAddress].lastSuccessNs = nowNs;
+}
+
+QString SlaveHealth::stateName(BreakerState state)
+{
+    switch (state) {
+    case Closed:   return "Closed";
+    case Open:     return "Open";
+    case HalfOpen: return "HalfOpen";
+    }
+
+    return "Unknown";
+}
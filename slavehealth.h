@@ -0,0 +1,85 @@
+#ifndef SLAVEHEALTH_H
+#define SLAVEHEALTH_H
+
+#include <QMap>
+#include <QString>
+
+#include "latencyhistogram.h"
+
+/**
+ * @brief Per slave response time tracking, adaptive timeouts and circuit breaker.
+ *
+ * The timeout of a slave follows the high percentiles of its recent response times, so a
+ * healthy slave answers well within it while a dead one costs as little bus time as possible.
+ * After several consecutive failures the breaker opens and the slave is skipped, except for a
+ * single probe request whose interval doubles with every failed probe.
+ */
+class SlaveHealth
+{
+public:
+    enum BreakerState {
+        Closed,   // Normal operation
+        Open,     // Failing, requests are skipped until the next probe
+        HalfOpen  // Probe in flight
+    };
+
+    struct Slave {
+        BreakerState state = Closed;
+        int consecutiveFailures = 0;
+        int trips = 0;              // Failed probes since the breaker opened, drives the backoff
+        qint64 probeAtNs = 0;
+        qint64 lastSuccessNs = 0;
+        quint64 successes = 0;
+        quint64 failures = 0;
+
+        // Two alternating windows, percentiles are taken over both so they adapt without jumping
+        LatencyHistogram currentWindow;
+        LatencyHistogram previousWindow;
+    };
+
+    static constexpr int FAILURE_THRESHOLD = 3;
+    static constexpr int WINDOW_SIZE = 200;
+    static constexpr int MIN_SAMPLES = 20;
+    static constexpr int MIN_TIMEOUT_MS = 100;
+    static constexpr int MAX_TIMEOUT_MS = 1000;
+    static constexpr qint64 PROBE_INTERVAL_NS = 1000000000LL;
+    static constexpr qint64 MAX_PROBE_INTERVAL_NS = 30000000000LL;
+
+    /**
+     * @brief Whether a request to the slave may be sent now. Moves an open breaker to half-open
+     * when the probe is due, the caller must then report the outcome of that request.
+     */
+    bool allowRequest(quint8 slaveAddress, qint64 nowNs);
+
+    void recordSuccess(quint8 slaveAddress, qint64 responseUs, qint64 nowNs);
+    void recordFailure(quint8 slaveAddress, qint64 nowNs);
+
+    /**
+     * @brief The probe let through by allowRequest() ended without an answer (dropped, evicted or not
+     * queued), the breaker goes back to open and probes again when allowed.
+     */
+    void probeAborted(quint8 slaveAddress);
+
+    /**
+     * @brief Reopens every half-open breaker, for when all requests in flight were dropped.
+     */
+    void abortProbes();
+
+    int timeoutMs(quint8 slaveAddress) const;
+    BreakerState state(quint8 slaveAddress) const { return slaveStates.value(slaveAddress).state; }
+    bool isStale(quint8 slaveAddress, qint64 nowNs, qint64 maxAgeNs) const;
+
+    /**
+     * @brief Starts the staleness clock of a slave that never answered.
+     */
+    void track(quint8 slaveAddress, qint64 nowNs);
+
+    const QMap<quint8, Slave> &slaves() const { return slaveStates; }
+
+    static QString stateName(BreakerState state);
+
+private:
+    QMap<quint8, Slave> slaveStates;
+};
+
+#endif // SLAVEHEALTH_H
@@ -7,6 +7,7 @@
 #include "globals.h"
 #include "dbmanager.h"
 #include "constants.h"
+#include "relayimage.h"
 #include "globalerrors.h"
 
 static QString stateName(StateMachine::State s)
@@ -56,8 +57,20 @@ int StateMachine::getState()
     return static_cast<int>(state);
 }
 
+void StateMachine::setState(State newState)
+{
+    if (state == newState)
+        return;
+
+    state = newState;
+    emit stateChanged(state);
+}
+
 void StateMachine::tick()
 {
+    // Outputs changed during the tick are written together once it finishes
+    RelayImage::Transaction relayTransaction;
+
     pipeControl();
     // TODO uncomment this on new version
     //tankControl();
@@ -67,18 +80,17 @@ void StateMachine::tick()
 void StateMachine::triggerAlarm()
 {
     Logger::warn("Alarm triggered!");
-    Sensor::mapOutputPin[CONSTANTS::ALARM_SIGNAL]->send(1);
-    Sensor::mapOutputPin[CONSTANTS::ALARM_SIGNAL]->send(0);
+    Sensor::output<CONSTANTS::ALARM_SIGNAL>().run(OutputProgram::pulse(Globals::alarmPulseTime));
 }
 
 void StateMachine::pipeControl()
 {
     if (stateMachineValues.expansionTemp > Globals::expansionUpperTemp) {
-        Sensor::mapOutputPin[CONSTANTS::EXTENSION_COOLING]->sendIfNew(1);
+        Sensor::output<CONSTANTS::EXTENSION_COOLING>().sendIfNew(1);
         Logger::info(QString("Pipe cooling on, expansionTemp = %1 > %2").arg(stateMachineValues.expansionTemp).arg(Globals::expansionUpperTemp));
     }
     else if (stateMachineValues.expansionTemp < Globals::expansionLowerTemp) {
-        Sensor::mapOutputPin[CONSTANTS::EXTENSION_COOLING]->sendIfNew(0);
+        Sensor::output<CONSTANTS::EXTENSION_COOLING>().sendIfNew(0);
         Logger::info(QString("Pipe cooling off, expansionTemp = %1 < %2").arg(stateMachineValues.expansionTemp).arg(Globals::expansionLowerTemp));
     }
 }
@@ -90,22 +102,22 @@ void StateMachine::tankControl()
 
         // Maintain temp of water inside tank ±1
         if (stateMachineValues.tankTemp > Globals::maintainWaterTankTemp + 1) {
-            Sensor::mapOutputPin[CONSTANTS::TANK_HEATING]->sendIfNew(0);
+            Sensor::output<CONSTANTS::TANK_HEATING>().sendIfNew(0);
             Logger::info(QString("Tank heating off, tankTemp = %1 > %2").arg(stateMachineValues.tankTemp).arg(Globals::maintainWaterTankTemp));
             
         } else if (stateMachineValues.tankTemp < Globals::maintainWaterTankTemp - 1) {
             if (isRunning()) { // Turn on heaters only while process is running            
-                Sensor::mapOutputPin[CONSTANTS::TANK_HEATING]->sendIfNew(1);
+                Sensor::output<CONSTANTS::TANK_HEATING>().sendIfNew(1);
                 Logger::info(QString("Tank heating on, tankTemp = %1 < %2").arg(stateMachineValues.tankTemp).arg(Globals::maintainWaterTankTemp));
             }
         }
     } else {
-        Sensor::mapOutputPin[CONSTANTS::TANK_HEATING]->sendIfNew(0);
+        Sensor::output<CONSTANTS::TANK_HEATING>().sendIfNew(0);
         Logger::info(QString("Tank heating off, tankWaterLevel = %1 <= %2").arg(stateMachineValues.tankWaterLevel).arg(Globals::heaterWaterLevel));
     }
 
     if (stateMachineValues.tankWaterLevel > 100 && state != State::COOLING) {
-        Sensor::mapOutputPin[CONSTANTS::FILL_TANK_WITH_WATER]->sendIfNew(0);
+        Sensor::output<CONSTANTS::FILL_TANK_WITH_WATER>().sendIfNew(0);
         Logger::info(QString("Tank filling off, tankWaterLevel >= 100 (%1) and not cooling").arg(stateMachineValues.tankWaterLevel));
     }
 }
@@ -130,7 +142,7 @@ bool StateMachine::start(ProcessConfig processConfig, ProcessInfo processInfo)
 
     this->processConfig = processConfig;
     this->processInfo = processInfo;
-    state = State::STARTING;
+    setState(State::STARTING);
 
     processStart = QDateTime::currentDateTime();    
 
@@ -197,20 +209,18 @@ bool StateMachine::stop()
         process->setInfo(processInfo);
     }
 
-    Sensor::mapOutputPin[CONSTANTS::FILL_TANK_WITH_WATER]->send(0);
-    Sensor::mapOutputPin[CONSTANTS::COOLING]->send(0);
-    Sensor::mapOutputPin[CONSTANTS::TANK_HEATING]->send(0);
-    Sensor::mapOutputPin[CONSTANTS::COOLING_HELPER]->send(0);
-    Sensor::mapOutputPin[CONSTANTS::AUTOKLAV_FILL]->send(0);
-    //Sensor::mapOutputPin[CONSTANTS::WATER_DRAIN]->send(0);
-    Sensor::mapOutputPin[CONSTANTS::STEAM_HEATING]->send(0);
-    Sensor::mapOutputPin[CONSTANTS::PUMP]->send(0);
-    Sensor::mapOutputPin[CONSTANTS::ELECTRIC_HEATING]->send(0);
-    Sensor::mapOutputPin[CONSTANTS::INCREASE_PRESSURE]->send(0);
-    Sensor::mapOutputPin[CONSTANTS::EXTENSION_COOLING]->send(0);
-    Sensor::mapOutputPin[CONSTANTS::ALARM_SIGNAL]->send(0);
-
-    state = State::READY;
+    // Every output except the water drain off in a single verified safety frame
+    QList<ushort> outputsOff;
+    Sensor::outputPins.forEach([&outputsOff](Sensor &pin) {
+        if (pin.id == CONSTANTS::WATER_DRAIN)
+            return;
+
+        pin.value = 0;
+        outputsOff.append(pin.id);
+    });
+    RelayImage::instance().emergencyStop(outputsOff);
+
+    setState(State::READY);
 
     // clear hardcoded ending values, empty string ("") can be used as well
     heatingEnd.clear();
@@ -237,15 +247,17 @@ bool StateMachine::skipToCooling()
                      .arg(heatingStart.msecsTo(QDateTime::currentDateTime()))
                      .arg(modeName(processConfig.mode)));
 
-    Sensor::mapOutputPin[CONSTANTS::STEAM_HEATING]->send(0);
-    Sensor::mapOutputPin[CONSTANTS::ELECTRIC_HEATING]->send(0);
+    RelayImage::Transaction relayTransaction;
+
+    Sensor::output<CONSTANTS::STEAM_HEATING>().send(0);
+    Sensor::output<CONSTANTS::ELECTRIC_HEATING>().send(0);
 
     // PRECOOLING block does not initialize coolingStart; in normal flow STERILIZING TIME-mode
     // sets it before the transition. Set it now so PRECOOLING→COOLING computes coolingEnd
     // and TIME-mode COOLING exit has a valid baseline.
     coolingStart = QDateTime::currentDateTime();
 
-    state = State::PRECOOLING;
+    setState(State::PRECOOLING);
     Logger::info("StateMachine: Pre cooling (skipped from STERILIZING)");
     return true;
 }
@@ -284,6 +296,7 @@ StateMachineValues StateMachine::readInputPinValues()
     updateStateMachineValues.doorClosed = sensorValues.doorClosed;
     updateStateMachineValues.burnerFault = sensorValues.burnerFault;
     updateStateMachineValues.waterShortage = sensorValues.waterShortage;
+    updateStateMachineValues.generation = sensorValues.generation;
 
     return updateStateMachineValues;    
 }
@@ -398,10 +411,10 @@ void StateMachine::autoklavControl()
     case State::STARTING:
         Logger::info("StateMachine: Starting");
 
-        Sensor::mapOutputPin[CONSTANTS::AUTOKLAV_FILL]->send(1);
+        Sensor::output<CONSTANTS::AUTOKLAV_FILL>().send(1);
         stopwatch1 = QDateTime::currentDateTime().addMSecs(3*60*1000); // 3 minutes TODO revert for testing to 1000
 
-        state = State::FILLING;
+        setState(State::FILLING);
         Logger::info("StateMachine: Filling");
         break;
 
@@ -412,8 +425,8 @@ void StateMachine::autoklavControl()
             break;
         }
 
-        Sensor::mapOutputPin[CONSTANTS::PUMP]->send(1);
-        Sensor::mapOutputPin[CONSTANTS::STEAM_HEATING]->send(1);
+        Sensor::output<CONSTANTS::PUMP>().send(1);
+        Sensor::output<CONSTANTS::STEAM_HEATING>().send(1);
 
 
         if(stateMachineValues.pressure < 0.16){
@@ -421,17 +434,17 @@ void StateMachine::autoklavControl()
             break;
         }
 
-        Sensor::mapOutputPin[CONSTANTS::AUTOKLAV_FILL]->send(0);
-        Sensor::mapOutputPin[CONSTANTS::INCREASE_PRESSURE]->send(1);
+        Sensor::output<CONSTANTS::AUTOKLAV_FILL>().send(0);
+        Sensor::output<CONSTANTS::INCREASE_PRESSURE>().send(1);
 
         if(stateMachineValues.pressure < 1.5){
             Logger::info(QString("Wait until pressure %1 reaches 1.5").arg(QString::number(stateMachineValues.pressure)));
             break;
         }
            
-        Sensor::mapOutputPin[CONSTANTS::INCREASE_PRESSURE]->send(0);
+        Sensor::output<CONSTANTS::INCREASE_PRESSURE>().send(0);
 
-        state = State::HEATING;
+        setState(State::HEATING);
                 
         Logger::info("StateMachine: Heating");
         break;
@@ -443,7 +456,7 @@ void StateMachine::autoklavControl()
             break; // TODO revert for testing
         }
 
-        state = State::STERILIZING;
+        setState(State::STERILIZING);
         heatingStart = QDateTime::currentDateTime();
         heatingEnd = (heatingStart.addMSecs(static_cast<qint64>(processInfo.targetHeatingTime.toDouble()))).toString(Qt::ISODate);
 
@@ -453,9 +466,9 @@ void StateMachine::autoklavControl()
     case State::STERILIZING:
 
         if (stateMachineValues.temp > processInfo.processType.maintainTemp + 0.5) {
-            Sensor::mapOutputPin[CONSTANTS::STEAM_HEATING]->send(0);
+            Sensor::output<CONSTANTS::STEAM_HEATING>().send(0);
         } else if (stateMachineValues.temp < processInfo.processType.maintainTemp - 0.5) {
-            Sensor::mapOutputPin[CONSTANTS::STEAM_HEATING]->send(1);
+            Sensor::output<CONSTANTS::STEAM_HEATING>().send(1);
         }        
 
         if (processConfig.mode == Mode::TARGETF) {
@@ -474,23 +487,23 @@ void StateMachine::autoklavControl()
         
         }
 
-        state = State::PRECOOLING;
+        setState(State::PRECOOLING);
         Logger::info("StateMachine: Pre cooling");
         break;
 
     case State::PRECOOLING:
 
-        Sensor::mapOutputPin[CONSTANTS::STEAM_HEATING]->send(0);
-        Sensor::mapOutputPin[CONSTANTS::COOLING]->send(1);
-        Sensor::mapOutputPin[CONSTANTS::COOLING_HELPER]->send(1);
-        Sensor::mapOutputPin[CONSTANTS::FILL_TANK_WITH_WATER]->send(1);
+        Sensor::output<CONSTANTS::STEAM_HEATING>().send(0);
+        Sensor::output<CONSTANTS::COOLING>().send(1);
+        Sensor::output<CONSTANTS::COOLING_HELPER>().send(1);
+        Sensor::output<CONSTANTS::FILL_TANK_WITH_WATER>().send(1);
 
         if(stateMachineValues.tankWaterLevel < Globals::tankWaterLevelThreshold) {
             Logger::info(QString("Wait until tank water level %1 is reached %2").arg(QString::number(stateMachineValues.tankWaterLevel)).arg(Globals::tankWaterLevelThreshold));
             break;
         }
 
-        state = State::COOLING;
+        setState(State::COOLING);
         coolingEnd = (coolingStart.addMSecs(static_cast<qint64>(processInfo.targetCoolingTime.toDouble()))).toString(Qt::ISODate);
 
         Logger::info("StateMachine: Cooling");
@@ -498,8 +511,8 @@ void StateMachine::autoklavControl()
 
     case State::COOLING:        
 
-        Sensor::mapOutputPin[CONSTANTS::COOLING]->send(0);
-        Sensor::mapOutputPin[CONSTANTS::FILL_TANK_WITH_WATER]->send(0);
+        Sensor::output<CONSTANTS::COOLING>().send(0);
+        Sensor::output<CONSTANTS::FILL_TANK_WITH_WATER>().send(0);
 
         if (processConfig.mode == Mode::TARGETF) {
             if(stateMachineValues.tempK > processInfo.finishTemp.toDouble()) {
@@ -514,11 +527,11 @@ void StateMachine::autoklavControl()
             }
         }
 
-        Sensor::mapOutputPin[CONSTANTS::COOLING_HELPER]->send(0);
-        Sensor::mapOutputPin[CONSTANTS::PUMP]->send(0);
-        //Sensor::mapOutputPin[CONSTANTS::WATER_DRAIN]->send(1);
+        Sensor::output<CONSTANTS::COOLING_HELPER>().send(0);
+        Sensor::output<CONSTANTS::PUMP>().send(0);
+        //Sensor::output<CONSTANTS::WATER_DRAIN>().send(1);
 
-        state = State::FINISHING;
+        setState(State::FINISHING);
         stopwatch1 = QDateTime::currentDateTime().addMSecs(10*60*1000); // 10 minutes
         Logger::info("StateMachine: Finishing");
         break;
@@ -530,22 +543,19 @@ void StateMachine::autoklavControl()
             //break;
         }
 
-        //Sensor::mapOutputPin[CONSTANTS::WATER_DRAIN]->send(0);
-        Sensor::mapOutputPin[CONSTANTS::EXTENSION_COOLING]->sendIfNew(0);
-        Sensor::mapOutputPin[CONSTANTS::TANK_HEATING]->sendIfNew(0);
-        Sensor::mapOutputPin[CONSTANTS::FILL_TANK_WITH_WATER]->sendIfNew(0);
+        //Sensor::output<CONSTANTS::WATER_DRAIN>().send(0);
+        Sensor::output<CONSTANTS::EXTENSION_COOLING>().sendIfNew(0);
+        Sensor::output<CONSTANTS::TANK_HEATING>().sendIfNew(0);
+        Sensor::output<CONSTANTS::FILL_TANK_WITH_WATER>().sendIfNew(0);
 
-        state = State::FINISHED;
+        setState(State::FINISHED);
         Logger::info("StateMachine: Finished");
         break;
 
     case State::FINISHED:
         timer.stop();
 
-        Sensor::mapOutputPin[CONSTANTS::ALARM_SIGNAL]->send(1);
-        Sensor::mapOutputPin[CONSTANTS::ALARM_SIGNAL]->send(0);
-        Sensor::mapOutputPin[CONSTANTS::ALARM_SIGNAL]->send(1);
-        Sensor::mapOutputPin[CONSTANTS::ALARM_SIGNAL]->send(0);
+        Sensor::output<CONSTANTS::ALARM_SIGNAL>().run(OutputProgram::blink(Globals::alarmPulseTime, Globals::alarmPulseTime, 2));
 
         Logger::info("StateMachine: Ready");
 
@@ -555,7 +565,7 @@ void StateMachine::autoklavControl()
             process->setInfo(processInfo);
         }
 
-        state = State::READY;
+        setState(State::READY);
 
         // clear hardcoded ending values, empty string ("") can be used as well
         heatingEnd.clear();
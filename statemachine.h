@@ -51,6 +51,9 @@ public:
     
     static StateMachine &instance();
 
+signals:
+    void stateChanged(StateMachine::State state);
+
 private:
     explicit StateMachine(QObject *parent = nullptr);
 
@@ -70,6 +73,7 @@ private:
 
     quint64 id;
 
+    void setState(State newState);
     bool verificationControl();
     void triggerAlarm();
 